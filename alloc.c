@@ -0,0 +1,404 @@
+/* alloc.c: Allocation of register arrays
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef _POSIX_MAPPED_FILES
+#include <sys/mman.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "alloc.h"
+#include "config.h"
+
+/* The amplitudes, basis states and hash tables of quantum registers
+   are allocated here. All arrays are aligned to QUANTUM_ALLOC_ALIGN
+   bytes. Large arrays are mapped anonymously, so that they can be
+   backed by huge pages and distributed over the NUMA nodes:
+
+   $QUHUGEPAGES: "thp" (default) asks for transparent huge pages,
+                 "2M" or "1G" uses explicit huge pages of that size,
+		 falling back to normal pages if none are reserved,
+		 "off" uses normal pages only
+   $QUNUMA:      "local" (default) places each page on the node of the
+                 thread which touches it first, which is done with
+		 the same static OpenMP schedule as the gate loops;
+		 "interleave" spreads the pages round-robin over all
+		 nodes
+
+   Each array is preceded by a header of QUANTUM_ALLOC_ALIGN bytes. */
+
+enum {
+  ALLOC_HUGE_OFF,
+  ALLOC_HUGE_THP,
+  ALLOC_HUGE_2M,
+  ALLOC_HUGE_1G
+};
+
+#define ALLOC_MPOL_INTERLEAVE 3
+
+/* Number of consecutive resizes to less than a quarter of the
+   capacity before an array is shrunk */
+
+#define ALLOC_LAZY 64
+
+struct quantum_alloc_header_struct
+{
+  void *base;       /* start of the allocation */
+  size_t size;      /* bytes in use */
+  size_t capacity;  /* usable bytes */
+  size_t maplen;    /* length of the mapping, 0 for heap memory */
+  unsigned long low;  /* consecutive resizes to less than a quarter */
+};
+
+typedef struct quantum_alloc_header_struct quantum_alloc_header;
+
+#define ALLOC_HEADER(p) ((quantum_alloc_header *) ((char *) (p) \
+                                                    - QUANTUM_ALLOC_ALIGN))
+
+static int alloc_huge = -1;
+static int alloc_interleave = 0;
+
+static quantum_alloc_stats alloc_stats = {0, 0, 0, 0, 0};
+
+/* Read the allocation policy from the environment */
+
+static void
+quantum_alloc_init()
+{
+  char *c;
+
+  alloc_huge = ALLOC_HUGE_THP;
+
+  c = getenv("QUHUGEPAGES");
+
+  if(c)
+    {
+      if(!strcmp(c, "off") || !strcmp(c, "0"))
+	alloc_huge = ALLOC_HUGE_OFF;
+      else if(!strcmp(c, "2M"))
+	alloc_huge = ALLOC_HUGE_2M;
+      else if(!strcmp(c, "1G"))
+	alloc_huge = ALLOC_HUGE_1G;
+    }
+
+  c = getenv("QUNUMA");
+
+  alloc_interleave = c && !strcmp(c, "interleave");
+}
+
+/* Touch the pages of a fresh mapping with the OpenMP schedule of the
+   gate loops, so that each thread finds its part on its own node */
+
+static void
+quantum_alloc_touch(char *p, size_t len)
+{
+#ifdef _OPENMP
+  long i, pages;
+  long pagesize = sysconf(_SC_PAGESIZE);
+
+  pages = len / pagesize;
+
+#pragma omp parallel for
+  for(i=0; i<pages; i++)
+    p[i * pagesize] = 0;
+#endif
+}
+
+#ifdef _POSIX_MAPPED_FILES
+
+/* Map LEN bytes, trying huge pages first if requested */
+
+static void *
+quantum_alloc_map(size_t *len)
+{
+  void *p = MAP_FAILED;
+  size_t huge = 0;
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+#ifdef MAP_HUGETLB
+  if(alloc_huge == ALLOC_HUGE_2M)
+    {
+      huge = (size_t) 1 << 21;
+#ifdef MAP_HUGE_2MB
+      flags |= MAP_HUGE_2MB;
+#endif
+    }
+  else if(alloc_huge == ALLOC_HUGE_1G)
+    {
+      huge = (size_t) 1 << 30;
+#ifdef MAP_HUGE_1GB
+      flags |= MAP_HUGE_1GB;
+#endif
+    }
+
+  if(huge)
+    {
+      size_t hlen = (*len + huge - 1) & ~(huge - 1);
+
+      p = mmap(0, hlen, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+
+      if(p != MAP_FAILED)
+	*len = hlen;
+    }
+#endif
+
+  if(p == MAP_FAILED)
+    {
+      long pagesize = sysconf(_SC_PAGESIZE);
+
+      *len = (*len + pagesize - 1) & ~((size_t) pagesize - 1);
+
+      p = mmap(0, *len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+	       -1, 0);
+
+      if(p == MAP_FAILED)
+	return 0;
+
+#ifdef MADV_HUGEPAGE
+      if(alloc_huge != ALLOC_HUGE_OFF)
+	madvise(p, *len, MADV_HUGEPAGE);
+#endif
+    }
+
+#if defined(__linux__) && defined(SYS_mbind)
+  if(alloc_interleave)
+    {
+      unsigned long nodes = ~0UL;
+
+      syscall(SYS_mbind, p, *len, ALLOC_MPOL_INTERLEAVE, &nodes, 
+	      8 * sizeof(nodes), 0);
+    }
+#endif
+
+  return p;
+}
+
+#endif /* _POSIX_MAPPED_FILES */
+
+/* Allocate N bytes with room for CAPACITY bytes */
+
+static void *
+quantum_alloc_capacity(size_t n, size_t capacity)
+{
+  quantum_alloc_header *h;
+  size_t len = capacity + QUANTUM_ALLOC_ALIGN;
+  void *base = 0;
+  char *p;
+
+  if(alloc_huge < 0)
+    quantum_alloc_init();
+
+#ifdef _POSIX_MAPPED_FILES
+  if(capacity >= QUANTUM_ALLOC_LARGE)
+    {
+      base = quantum_alloc_map(&len);
+
+      if(base)
+	quantum_alloc_touch(base, len);
+    }
+#endif
+
+  if(!base)
+    {
+      if(posix_memalign(&base, QUANTUM_ALLOC_ALIGN, len))
+	return 0;
+
+      len = 0;
+    }
+
+  p = (char *) base + QUANTUM_ALLOC_ALIGN;
+  h = ALLOC_HEADER(p);
+  h->base = base;
+  h->size = n;
+  h->maplen = len;
+  h->capacity = len ? len - QUANTUM_ALLOC_ALIGN : capacity;
+  h->low = 0;
+
+  alloc_stats.alloc++;
+
+  return p;
+}
+
+/* Allocate N bytes. The contents are undefined. */
+
+void *
+quantum_alloc(size_t n)
+{
+  return quantum_alloc_capacity(n, n);
+}
+
+/* Allocate an array of NUM zeroed elements */
+
+void *
+quantum_calloc(size_t num, size_t size)
+{
+  void *p;
+
+  p = quantum_alloc(num * size);
+
+  /* Fresh mappings are already zeroed */
+
+  if(p && !ALLOC_HEADER(p)->maplen)
+    memset(p, 0, num * size);
+
+  return p;
+}
+
+/* Resize an array to N bytes. Growing beyond the capacity moves the
+   array to a new one with at least 1.5 times the capacity. Shrinking
+   moves it only after it used less than a quarter of its capacity
+   for ALLOC_LAZY resizes in a row. Gates which repeatedly add and
+   remove basis states thus settle at a fixed capacity and stop
+   allocating memory. */
+
+void *
+quantum_realloc(void *p, size_t n)
+{
+  quantum_alloc_header *h;
+  void *q;
+  long i, blocks;
+  size_t size, capacity;
+
+  if(!p)
+    return quantum_alloc(n);
+
+  h = ALLOC_HEADER(p);
+
+  if(n <= h->capacity)
+    {
+      if(n >= h->capacity / 4)
+	h->low = 0;
+      else
+	h->low++;
+
+      if(h->low < ALLOC_LAZY)
+	{
+	  h->size = n;
+	  alloc_stats.resize++;
+	  return p;
+	}
+    }
+
+  capacity = n;
+
+  if(n > h->capacity)
+    {
+      if(capacity < h->capacity + h->capacity / 2)
+	capacity = h->capacity + h->capacity / 2;
+
+      alloc_stats.grow++;
+    }
+  else
+    alloc_stats.shrink++;
+
+  q = quantum_alloc_capacity(n, capacity);
+
+  if(!q)
+    return 0;
+
+  alloc_stats.alloc--;
+
+  size = h->size < n ? h->size : n;
+
+  /* Copy in parallel, so that the pages of a large array stay with
+     the threads working on them */
+
+  blocks = size / QUANTUM_ALLOC_LARGE;
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for(i=0; i<blocks; i++)
+    memcpy((char *) q + i * QUANTUM_ALLOC_LARGE, 
+	   (char *) p + i * QUANTUM_ALLOC_LARGE, QUANTUM_ALLOC_LARGE);
+
+  memcpy((char *) q + blocks * QUANTUM_ALLOC_LARGE, 
+	 (char *) p + blocks * QUANTUM_ALLOC_LARGE, 
+	 size - blocks * QUANTUM_ALLOC_LARGE);
+
+  quantum_free(p);
+
+  alloc_stats.free--;
+
+  return q;
+}
+
+/* Return a zeroed scratch buffer of N bytes. The buffer is reused by
+   the next call, so that per-gate bookkeeping does not allocate
+   memory in the steady state. */
+
+void *
+quantum_scratch(size_t n)
+{
+  static void *scratch = 0;
+
+  if(!scratch || n > ALLOC_HEADER(scratch)->capacity)
+    {
+      quantum_free(scratch);
+      scratch = quantum_alloc_capacity(n, n + n / 2);
+
+      if(!scratch)
+	return 0;
+    }
+
+  memset(scratch, 0, n);
+
+  return scratch;
+}
+
+/* Return the allocation statistics */
+
+quantum_alloc_stats
+quantum_get_alloc_stats()
+{
+  return alloc_stats;
+}
+
+/* Release an array */
+
+void
+quantum_free(void *p)
+{
+  quantum_alloc_header *h;
+
+  if(!p)
+    return;
+
+  h = ALLOC_HEADER(p);
+
+  alloc_stats.free++;
+
+#ifdef _POSIX_MAPPED_FILES
+  if(h->maplen)
+    {
+      munmap(h->base, h->maplen);
+      return;
+    }
+#endif
+
+  free(h->base);
+}
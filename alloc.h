@@ -0,0 +1,58 @@
+/* alloc.h: Declarations for alloc.c
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#ifndef __ALLOC_H
+
+#define __ALLOC_H
+
+#include <stddef.h>
+
+/* Alignment of all register arrays */
+
+#define QUANTUM_ALLOC_ALIGN 64
+
+/* Arrays of at least this size are mapped from the kernel directly */
+
+#define QUANTUM_ALLOC_LARGE (1 << 20)
+
+/* Allocation statistics */
+
+struct quantum_alloc_stats_struct
+{
+  unsigned long alloc;    /* arrays allocated */
+  unsigned long free;     /* arrays released */
+  unsigned long grow;     /* arrays moved to grow beyond their capacity */
+  unsigned long shrink;   /* arrays moved to release unused capacity */
+  unsigned long resize;   /* resizes within the capacity */
+};
+
+typedef struct quantum_alloc_stats_struct quantum_alloc_stats;
+
+extern void *quantum_alloc(size_t n);
+extern void *quantum_calloc(size_t num, size_t size);
+extern void *quantum_realloc(void *p, size_t n);
+extern void quantum_free(void *p);
+extern void *quantum_scratch(size_t n);
+extern quantum_alloc_stats quantum_get_alloc_stats();
+
+#endif
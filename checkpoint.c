@@ -0,0 +1,516 @@
+/* checkpoint.c: Saving and loading quantum registers
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _POSIX_MAPPED_FILES
+#include <sys/mman.h>
+#endif
+
+#include "checkpoint.h"
+#include "config.h"
+#include "matrix.h"
+#include "qureg.h"
+#include "gates.h"
+#include "defer.h"
+#include "error.h"
+#include "alloc.h"
+
+/* A register file consists of a header, followed by the amplitude
+   array and, if present, the array of basis states. All data is
+   stored in native byte order, and both arrays start at a page
+   boundary, so that a register can be mapped directly from disk. */
+
+#define QUREG_VERSION 1
+#define QUREG_ALIGN 4096
+#define QUREG_BOM 0x01020304
+#define QUREG_STATES 1
+
+struct quantum_qureg_header_struct
+{
+  char magic[4];             /* "QREG" */
+  unsigned char version;
+  unsigned char cfsize;      /* sizeof(COMPLEX_FLOAT) */
+  unsigned char musize;      /* sizeof(MAX_UNSIGNED) */
+  unsigned char flags;
+  unsigned int bom;          /* byte order mark */
+  int width;
+  int hashw;
+  int reserved;
+  unsigned long long size;
+  unsigned long long amplitude;  /* offset of the amplitude array */
+  unsigned long long state;      /* offset of the basis states */
+  unsigned long long gates;      /* gate counter at the time of saving */
+  char pad[8];
+};
+
+typedef struct quantum_qureg_header_struct quantum_qureg_header;
+
+/* Registers whose arrays live in a private file mapping */
+
+struct quantum_mapping_struct
+{
+  char *addr;
+  size_t len;
+};
+
+static struct quantum_mapping_struct *mappings = 0;
+static int nmappings = 0;
+
+/* Automatic checkpointing */
+
+static quantum_reg *checkpoint_reg = 0;
+static char *checkpoint_file = 0;
+static int checkpoint_freq = 0;
+static int checkpoint_last = 0;
+
+/* Round N up to the next page boundary */
+
+static unsigned long long
+quantum_qureg_align(unsigned long long n)
+{
+  return (n + QUREG_ALIGN - 1) & ~((unsigned long long) QUREG_ALIGN - 1);
+}
+
+/* Write N bytes from BUF, retrying on short writes */
+
+static int
+quantum_write_all(int fd, const void *buf, size_t n)
+{
+  const char *p = buf;
+  ssize_t i;
+
+  while(n > 0)
+    {
+      i = write(fd, p, n);
+
+      if(i <= 0)
+	return -1;
+
+      p += i;
+      n -= i;
+    }
+
+  return 0;
+}
+
+/* Read N bytes into BUF, retrying on short reads */
+
+static int
+quantum_read_all(int fd, void *buf, size_t n)
+{
+  char *p = buf;
+  ssize_t i;
+
+  while(n > 0)
+    {
+      i = read(fd, p, n);
+
+      if(i <= 0)
+	return -1;
+
+      p += i;
+      n -= i;
+    }
+
+  return 0;
+}
+
+/* Save the contents of a quantum register to FILE. The data is first
+   written to a temporary file which then replaces FILE, so that a
+   crash during saving never leaves a damaged checkpoint behind.
+   Returns 0 on success and -1 if the file could not be written. */
+
+int
+quantum_save_qureg(char *file, quantum_reg *reg)
+{
+  quantum_qureg_header hdr;
+  char *tmp, pad[QUREG_ALIGN];
+  unsigned long long len;
+  int fd, err;
+
+  quantum_flush(reg);
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, "QREG", 4);
+  hdr.version = QUREG_VERSION;
+  hdr.cfsize = sizeof(COMPLEX_FLOAT);
+  hdr.musize = sizeof(MAX_UNSIGNED);
+  hdr.flags = reg->state ? QUREG_STATES : 0;
+  hdr.bom = QUREG_BOM;
+  hdr.width = reg->width;
+  hdr.hashw = reg->hashw;
+  hdr.size = reg->size;
+  hdr.gates = quantum_gate_counter(0);
+
+  hdr.amplitude = quantum_qureg_align(sizeof(hdr));
+  len = hdr.amplitude + hdr.size * sizeof(COMPLEX_FLOAT);
+
+  if(reg->state)
+    hdr.state = quantum_qureg_align(len);
+
+  tmp = malloc(strlen(file) + 5);
+
+  if(!tmp)
+    quantum_error(QUANTUM_ENOMEM);
+
+  sprintf(tmp, "%s.tmp", file);
+
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if(fd < 0)
+    {
+      free(tmp);
+      return -1;
+    }
+
+  memset(pad, 0, sizeof(pad));
+
+  /* Write the header and both arrays in as few calls as possible */
+
+  err = quantum_write_all(fd, &hdr, sizeof(hdr))
+    || quantum_write_all(fd, pad, hdr.amplitude - sizeof(hdr))
+    || quantum_write_all(fd, reg->amplitude, hdr.size * sizeof(COMPLEX_FLOAT));
+
+  if(!err && reg->state)
+    err = quantum_write_all(fd, pad, hdr.state - hdr.amplitude 
+			    - hdr.size * sizeof(COMPLEX_FLOAT))
+      || quantum_write_all(fd, reg->state, hdr.size * sizeof(MAX_UNSIGNED));
+
+  if(!err)
+    err = fsync(fd);
+
+  if(close(fd) || err || rename(tmp, file))
+    {
+      unlink(tmp);
+      free(tmp);
+      return -1;
+    }
+
+  free(tmp);
+
+  return 0;
+}
+
+/* Check whether a register file header matches this build. A register
+   without any basis states has empty amplitude and state arrays. */
+
+static int
+quantum_check_header(quantum_qureg_header *hdr, unsigned long long len)
+{
+  unsigned long long end;
+
+  if(memcmp(hdr->magic, "QREG", 4) || hdr->version != QUREG_VERSION
+     || hdr->bom != QUREG_BOM || hdr->cfsize != sizeof(COMPLEX_FLOAT)
+     || hdr->musize != sizeof(MAX_UNSIGNED))
+    return -1;
+
+  if(hdr->width < 0 || hdr->hashw < 0 || hdr->hashw > 8 * sizeof(int) - 2
+     || hdr->size > (unsigned int) -1 >> 1)
+    return -1;
+
+  end = hdr->amplitude + hdr->size * sizeof(COMPLEX_FLOAT);
+
+  if(hdr->amplitude % QUREG_ALIGN || hdr->amplitude < sizeof(*hdr) 
+     || end > len)
+    return -1;
+
+  if(hdr->flags & QUREG_STATES)
+    {
+      if(hdr->state % QUREG_ALIGN || hdr->state < end 
+	 || hdr->state + hdr->size * sizeof(MAX_UNSIGNED) > len)
+	return -1;
+    }
+
+  return 0;
+}
+
+/* Load a quantum register previously saved with quantum_save_qureg.
+   If possible, the file is mapped copy-on-write, so that pages are
+   only read from disk when they are accessed and only copied when
+   they are modified. The gate counter is restored as well. Returns 0
+   on success and -1 if FILE is not a valid register file. */
+
+int
+quantum_load_qureg(char *file, quantum_reg *reg)
+{
+  quantum_qureg_header hdr;
+  struct stat st;
+  char *data;
+  int fd, mapped = 0;
+
+  fd = open(file, O_RDONLY);
+
+  if(fd < 0)
+    return -1;
+
+  if(fstat(fd, &st) || quantum_read_all(fd, &hdr, sizeof(hdr)) 
+     || quantum_check_header(&hdr, st.st_size))
+    {
+      close(fd);
+      return -1;
+    }
+
+  data = 0;
+
+#ifdef _POSIX_MAPPED_FILES
+  /* Empty arrays would point to the end of the mapping, where
+     quantum_find_mapping() cannot find them */
+
+  if(hdr.size)
+    data = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+  if(!data || data == MAP_FAILED)
+    data = 0;
+  else
+    {
+      mappings = realloc(mappings, (nmappings + 1) * sizeof(*mappings));
+
+      if(!mappings)
+	quantum_error(QUANTUM_ENOMEM);
+
+      mappings[nmappings].addr = data;
+      mappings[nmappings].len = st.st_size;
+      nmappings++;
+      mapped = 1;
+    }
+#endif
+
+  reg->width = hdr.width;
+  reg->size = hdr.size;
+  reg->hashw = hdr.hashw;
+
+  if(mapped)
+    {
+      reg->amplitude = (COMPLEX_FLOAT *) (data + hdr.amplitude);
+      reg->state = 0;
+
+      if(hdr.flags & QUREG_STATES)
+	reg->state = (MAX_UNSIGNED *) (data + hdr.state);
+    }
+  else
+    {
+      reg->amplitude = quantum_alloc(reg->size * sizeof(COMPLEX_FLOAT));
+      reg->state = 0;
+
+      if(hdr.flags & QUREG_STATES)
+	reg->state = quantum_alloc(reg->size * sizeof(MAX_UNSIGNED));
+
+      if(!reg->amplitude || (!reg->state && (hdr.flags & QUREG_STATES)))
+	quantum_error(QUANTUM_ENOMEM);
+
+      if(lseek(fd, hdr.amplitude, SEEK_SET) < 0
+	 || quantum_read_all(fd, reg->amplitude, 
+			     reg->size * sizeof(COMPLEX_FLOAT))
+	 || (reg->state 
+	     && (lseek(fd, hdr.state, SEEK_SET) < 0
+		 || quantum_read_all(fd, reg->state, 
+				     reg->size * sizeof(MAX_UNSIGNED)))))
+	{
+	  quantum_free(reg->amplitude);
+	  quantum_free(reg->state);
+	  close(fd);
+	  return -1;
+	}
+    }
+
+  close(fd);
+
+  /* Mapped arrays are accounted for like heap arrays, as they turn
+     into anonymous memory once they are written to */
+
+  quantum_memman(reg->size * sizeof(COMPLEX_FLOAT));
+
+  if(reg->state)
+    quantum_memman(reg->size * sizeof(MAX_UNSIGNED));
+
+  reg->hash = 0;
+
+  if(reg->hashw)
+    {
+      reg->hash = quantum_calloc(1 << reg->hashw, sizeof(int));
+
+      if(!reg->hash)
+	quantum_error(QUANTUM_ENOMEM);
+
+      quantum_memman((1 << reg->hashw) * sizeof(int));
+    }
+
+  quantum_gate_counter(-1);
+  quantum_gate_counter(hdr.gates);
+
+  return 0;
+}
+
+/* Return the index of the mapping holding the arrays of REG, or -1
+   if they have been allocated on the heap */
+
+static int
+quantum_find_mapping(quantum_reg *reg)
+{
+  char *p = (char *) reg->amplitude;
+  int i;
+
+  for(i=0; i<nmappings; i++)
+    {
+      if(p >= mappings[i].addr && p < mappings[i].addr + mappings[i].len)
+	return i;
+    }
+
+  return -1;
+}
+
+/* Remove a mapping from the list and unmap it */
+
+static void
+quantum_drop_mapping(int i)
+{
+#ifdef _POSIX_MAPPED_FILES
+  munmap(mappings[i].addr, mappings[i].len);
+#endif
+  mappings[i] = mappings[--nmappings];
+}
+
+/* Move the arrays of a mapped register to the heap. This has to be
+   done before the arrays are resized, as quantum_realloc() cannot handle
+   memory it has not allocated. The memory counter stays unchanged,
+   as mapped arrays have already been accounted for. */
+
+void
+quantum_copy_mapped(quantum_reg *reg)
+{
+  COMPLEX_FLOAT *amplitude;
+  MAX_UNSIGNED *state = 0;
+  int i;
+
+  if(!nmappings || (i = quantum_find_mapping(reg)) < 0)
+    return;
+
+  amplitude = quantum_alloc(reg->size * sizeof(COMPLEX_FLOAT));
+
+  if(reg->state)
+    state = quantum_alloc(reg->size * sizeof(MAX_UNSIGNED));
+
+  if(!amplitude || (reg->state && !state))
+    quantum_error(QUANTUM_ENOMEM);
+
+  memcpy(amplitude, reg->amplitude, reg->size * sizeof(COMPLEX_FLOAT));
+
+  if(reg->state)
+    memcpy(state, reg->state, reg->size * sizeof(MAX_UNSIGNED));
+
+  quantum_drop_mapping(i);
+
+  reg->amplitude = amplitude;
+  reg->state = state;
+}
+
+/* Release the arrays of a mapped register. Returns 1 if REG was
+   mapped and 0 if its arrays have to be freed by the caller. */
+
+int
+quantum_unmap_qureg(quantum_reg *reg)
+{
+  int i;
+
+  if(!nmappings || (i = quantum_find_mapping(reg)) < 0)
+    return 0;
+
+  quantum_drop_mapping(i);
+
+  quantum_memman(-reg->size * sizeof(COMPLEX_FLOAT));
+  reg->amplitude = 0;
+
+  if(reg->state)
+    {
+      quantum_memman(-reg->size * sizeof(MAX_UNSIGNED));
+      reg->state = 0;
+    }
+
+  return 1;
+}
+
+/* Save REG to FILE every FREQUENCY gates. A frequency of 0 disables
+   automatic checkpointing. */
+
+void
+quantum_checkpoint(char *file, int frequency, quantum_reg *reg)
+{
+  free(checkpoint_file);
+  checkpoint_file = 0;
+  checkpoint_reg = 0;
+  checkpoint_freq = 0;
+
+  if(frequency <= 0)
+    return;
+
+  checkpoint_file = malloc(strlen(file) + 1);
+
+  if(!checkpoint_file)
+    quantum_error(QUANTUM_ENOMEM);
+
+  strcpy(checkpoint_file, file);
+  checkpoint_reg = reg;
+  checkpoint_freq = frequency;
+  checkpoint_last = quantum_gate_counter(0);
+}
+
+/* Check whether automatic checkpointing is enabled */
+
+int
+quantum_checkpoint_active()
+{
+  return checkpoint_freq > 0;
+}
+
+/* Called after each gate. Writes a checkpoint if enough gates have
+   been applied since the last one. */
+
+void
+quantum_checkpoint_counter(quantum_reg *reg)
+{
+  int gates;
+
+  if(reg != checkpoint_reg)
+    return;
+
+  gates = quantum_gate_counter(0);
+
+  /* The counter may have been reset in the meantime */
+
+  if(gates < checkpoint_last)
+    checkpoint_last = gates;
+
+  if(gates - checkpoint_last < checkpoint_freq)
+    return;
+
+  checkpoint_last = gates;
+
+  if(quantum_save_qureg(checkpoint_file, reg))
+    perror(checkpoint_file);
+}
@@ -0,0 +1,501 @@
+/* circuit.c: In-memory object code programs and their optimization
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "circuit.h"
+#include "objcode.h"
+#include "matrix.h"
+#include "qureg.h"
+#include "defs.h"
+#include "error.h"
+
+/* Create an empty circuit */
+
+quantum_circuit
+quantum_new_circuit()
+{
+  quantum_circuit circ;
+
+  circ.num = 0;
+  circ.allocated = 0;
+  circ.insn = 0;
+
+  return circ;
+}
+
+/* Release the memory occupied by a circuit */
+
+void
+quantum_delete_circuit(quantum_circuit *circ)
+{
+  free(circ->insn);
+  quantum_memman(-circ->allocated * sizeof(quantum_objcode_insn));
+  circ->insn = 0;
+  circ->num = 0;
+  circ->allocated = 0;
+}
+
+/* Append an instruction to a circuit */
+
+void
+quantum_circuit_add(quantum_objcode_insn *insn, quantum_circuit *circ)
+{
+  unsigned long n;
+
+  if(circ->num == circ->allocated)
+    {
+      n = circ->allocated ? 2 * circ->allocated : 1024;
+
+      circ->insn = realloc(circ->insn, n * sizeof(quantum_objcode_insn));
+
+      if(!circ->insn)
+	quantum_error(QUANTUM_ENOMEM);
+
+      quantum_memman((n - circ->allocated) * sizeof(quantum_objcode_insn));
+      circ->allocated = n;
+    }
+
+  circ->insn[circ->num++] = *insn;
+}
+
+/* Count the gates of a circuit, i.e. all instructions except INIT and
+   NOP */
+
+unsigned long
+quantum_circuit_gates(quantum_circuit *circ)
+{
+  unsigned long i, n = 0;
+
+  for(i=0; i<circ->num; i++)
+    {
+      if(circ->insn[i].op != INIT && circ->insn[i].op != NOP)
+	n++;
+    }
+
+  return n;
+}
+
+/* Read an object code file into a circuit. Returns 0 on success. */
+
+int
+quantum_circuit_load(char *file, quantum_circuit *circ)
+{
+  quantum_objcode_map map;
+  quantum_objcode_insn insn;
+
+  if(quantum_objcode_open(file, &map))
+    return -1;
+
+  /* Clear the fields which are not used by an instruction */
+
+  memset(&insn, 0, sizeof(quantum_objcode_insn));
+
+  while(quantum_objcode_next(&map, &insn))
+    {
+      quantum_circuit_add(&insn, circ);
+      memset(&insn, 0, sizeof(quantum_objcode_insn));
+    }
+
+  quantum_objcode_close(&map);
+
+  return 0;
+}
+
+/* Write a circuit to an object code file. This uses the object code
+   recorder, so it is not possible while a program is being
+   recorded. Returns 0 on success. */
+
+int
+quantum_circuit_write(char *file, quantum_circuit *circ)
+{
+  unsigned long i;
+  int ret;
+
+  if(quantum_objcode_status())
+    {
+      fprintf(stderr, "quantum_circuit_write: Object code recording is "
+	      "active!\n");
+      return -1;
+    }
+
+  quantum_objcode_start();
+
+  for(i=0; i<circ->num; i++)
+    quantum_objcode_put_insn(&circ->insn[i]);
+
+  ret = quantum_objcode_write(file);
+
+  quantum_objcode_stop();
+
+  return ret;
+}
+
+/* Execute a circuit */
+
+void
+quantum_circuit_run(quantum_circuit *circ, quantum_reg *reg)
+{
+  unsigned long i;
+
+  for(i=0; i<circ->num; i++)
+    quantum_objcode_exec(&circ->insn[i], reg);
+}
+
+/* Store the qubits an instruction acts on in Q. Returns their number,
+   or -1 if the instruction acts on the whole register and must not be
+   moved (INIT, SWAPLEADS, ADDSCRATCH and the measurements). For
+   controlled gates the target comes last. */
+
+int
+quantum_circuit_qubits(quantum_objcode_insn *insn, int *q)
+{
+  switch(insn->op)
+    {
+    case TOFFOLI:
+      q[2] = insn->arg[2];
+    case CNOT:
+    case COND_PHASE:
+    case CPHASE_KICK:
+      q[1] = insn->arg[1];
+    case SIGMA_X:
+    case SIGMA_Y:
+    case SIGMA_Z:
+    case HADAMARD:
+    case ROT_X:
+    case ROT_Y:
+    case ROT_Z:
+    case PHASE_KICK:
+      q[0] = insn->arg[0];
+      break;
+    case PHASE_SCALE:
+      return 0;
+    default:
+      return -1;
+    }
+
+  switch(insn->op)
+    {
+    case TOFFOLI:
+      return 3;
+    case CNOT:
+    case COND_PHASE:
+    case CPHASE_KICK:
+      return 2;
+    default:
+      return 1;
+    }
+}
+
+/* Gates which are diagonal in the computational basis */
+
+int
+quantum_circuit_diagonal(unsigned char op)
+{
+  switch(op)
+    {
+    case SIGMA_Z:
+    case ROT_Z:
+    case PHASE_KICK:
+    case PHASE_SCALE:
+    case COND_PHASE:
+    case CPHASE_KICK:
+      return 1;
+    default:
+      return 0;
+    }
+}
+
+/* Gates which flip their last qubit, conditioned on all others */
+
+static int
+quantum_circuit_flip(unsigned char op)
+{
+  return op == SIGMA_X || op == CNOT || op == TOFFOLI;
+}
+
+static int
+quantum_circuit_member(int j, int *q, int n)
+{
+  int i;
+
+  for(i=0; i<n; i++)
+    {
+      if(q[i] == j)
+	return 1;
+    }
+
+  return 0;
+}
+
+/* Check whether two instructions commute */
+
+static int
+quantum_circuit_commute(quantum_objcode_insn *a, quantum_objcode_insn *b)
+{
+  int i, na, nb, qa[3], qb[3];
+
+  na = quantum_circuit_qubits(a, qa);
+  nb = quantum_circuit_qubits(b, qb);
+
+  if(na < 0 || nb < 0)
+    return 0;
+
+  for(i=0; i<na; i++)
+    {
+      if(quantum_circuit_member(qa[i], qb, nb))
+	break;
+    }
+
+  /* Gates acting on different qubits always commute */
+
+  if(i == na)
+    return 1;
+
+  if(quantum_circuit_diagonal(a->op) && quantum_circuit_diagonal(b->op))
+    return 1;
+
+  /* A diagonal gate commutes with a controlled-not if it does not act
+     on the target */
+
+  if(quantum_circuit_diagonal(a->op) && quantum_circuit_flip(b->op))
+    return !quantum_circuit_member(qb[nb-1], qa, na);
+
+  if(quantum_circuit_flip(a->op) && quantum_circuit_diagonal(b->op))
+    return !quantum_circuit_member(qa[na-1], qb, nb);
+
+  /* Two controlled-nots commute unless the target of one of them is a
+     control of the other */
+
+  if(quantum_circuit_flip(a->op) && quantum_circuit_flip(b->op))
+    return !quantum_circuit_member(qa[na-1], qb, nb-1)
+      && !quantum_circuit_member(qb[nb-1], qa, na-1);
+
+  return 0;
+}
+
+static int
+quantum_circuit_cphase_valid(quantum_objcode_insn *insn)
+{
+  return insn->arg[0] > insn->arg[1] 
+    && insn->arg[0] - insn->arg[1] < sizeof(MAX_UNSIGNED) * 8;
+}
+
+/* Angle of a conditional phase gate, which is taken modulo 2 pi */
+
+static double
+quantum_circuit_cphase(quantum_objcode_insn *insn)
+{
+  if(insn->op == COND_PHASE)
+    return pi / ((MAX_UNSIGNED) 1 << (insn->arg[0] - insn->arg[1]));
+
+  return insn->d;
+}
+
+/* Check whether a gate is the identity. Rotations have a period of 4
+   pi, phases a period of 2 pi. */
+
+static int
+quantum_circuit_identity(quantum_objcode_insn *insn)
+{
+  double period;
+
+  switch(insn->op)
+    {
+    case ROT_X:
+    case ROT_Y:
+    case ROT_Z:
+      period = 4 * pi;
+      break;
+    case PHASE_KICK:
+    case PHASE_SCALE:
+    case CPHASE_KICK:
+      period = 2 * pi;
+      break;
+    case NOP:
+      return 1;
+    default:
+      return 0;
+    }
+
+  return fabs(remainder(insn->d, period)) < epsilon;
+}
+
+/* Try to merge instruction B into the preceding instruction A. Returns
+   0 if this is not possible, 1 if A has been replaced by the product
+   of both gates, and 2 if the product is the identity. */
+
+static int
+quantum_circuit_merge(quantum_objcode_insn *a, quantum_objcode_insn *b)
+{
+  double d;
+
+  switch(b->op)
+    {
+    case SIGMA_X:
+    case SIGMA_Y:
+    case SIGMA_Z:
+    case HADAMARD:
+      if(a->op == b->op && a->arg[0] == b->arg[0])
+	return 2;
+      return 0;
+
+    case CNOT:
+      if(a->op == CNOT && a->arg[0] == b->arg[0] && a->arg[1] == b->arg[1])
+	return 2;
+      return 0;
+
+    case TOFFOLI:
+      if(a->op == TOFFOLI && a->arg[2] == b->arg[2]
+	 && ((a->arg[0] == b->arg[0] && a->arg[1] == b->arg[1])
+	     || (a->arg[0] == b->arg[1] && a->arg[1] == b->arg[0])))
+	return 2;
+      return 0;
+
+    case ROT_X:
+    case ROT_Y:
+    case ROT_Z:
+    case PHASE_KICK:
+      if(a->op != b->op || a->arg[0] != b->arg[0])
+	return 0;
+      a->d += b->d;
+      break;
+
+    case PHASE_SCALE:
+      if(a->op != PHASE_SCALE)
+	return 0;
+      a->d += b->d;
+      break;
+
+    case COND_PHASE:
+    case CPHASE_KICK:
+
+      /* Conditional phases are symmetric in both qubits */
+
+      if((a->op != COND_PHASE && a->op != CPHASE_KICK)
+	 || !((a->arg[0] == b->arg[0] && a->arg[1] == b->arg[1])
+	      || (a->arg[0] == b->arg[1] && a->arg[1] == b->arg[0])))
+	return 0;
+
+      /* COND_PHASE is only defined for CONTROL > TARGET */
+
+      if((a->op == COND_PHASE && !quantum_circuit_cphase_valid(a))
+	 || (b->op == COND_PHASE && !quantum_circuit_cphase_valid(b)))
+	return 0;
+
+      d = quantum_circuit_cphase(a) + quantum_circuit_cphase(b);
+      a->op = CPHASE_KICK;
+      a->d = d;
+      break;
+
+    default:
+      return 0;
+    }
+
+  return quantum_circuit_identity(a) ? 2 : 1;
+}
+
+/* Optimize a circuit without changing its effect on the quantum
+   register. Pairs of self-inverse gates cancel, subsequent rotations
+   and phases on the same qubits are merged, and gates which are the
+   identity are removed. An instruction is moved backwards past up to
+   QUANTUM_CIRCUIT_WINDOW instructions it commutes with to find a
+   partner. Returns the number of instructions removed. */
+
+unsigned long
+quantum_circuit_optimize(quantum_circuit *circ)
+{
+  unsigned long i, j, k, n, total = 0;
+  int merge;
+  quantum_objcode_insn *insn = circ->insn;
+
+  do
+    {
+      /* INSN[0..N-1] holds the optimized instructions, removed ones
+	 are replaced by NOPs and compacted afterwards */
+
+      for(i=0, n=0; i<circ->num; i++)
+	{
+	  if(quantum_circuit_identity(&insn[i]))
+	    continue;
+
+	  for(j=n, k=0, merge=0; j>0 && k<QUANTUM_CIRCUIT_WINDOW; j--, k++)
+	    {
+	      if(insn[j-1].op == NOP)
+		continue;
+
+	      merge = quantum_circuit_merge(&insn[j-1], &insn[i]);
+
+	      if(merge || !quantum_circuit_commute(&insn[j-1], &insn[i]))
+		break;
+	    }
+
+	  if(merge == 2)
+	    insn[j-1].op = NOP;
+	  else if(!merge)
+	    insn[n++] = insn[i];
+
+	  while(n > 0 && insn[n-1].op == NOP)
+	    n--;
+	}
+
+      for(i=0, j=0; i<n; i++)
+	{
+	  if(insn[i].op != NOP)
+	    insn[j++] = insn[i];
+	}
+
+      total += circ->num - j;
+      k = circ->num - j;
+      circ->num = j;
+
+    } while(k);
+
+  return total;
+}
+
+/* Optimize the object code file INFILE and write the result to
+   OUTFILE. Returns 0 on success. */
+
+int
+quantum_objcode_optimize(char *infile, char *outfile)
+{
+  quantum_circuit circ;
+  int ret;
+
+  circ = quantum_new_circuit();
+
+  if(quantum_circuit_load(infile, &circ))
+    return -1;
+
+  quantum_circuit_optimize(&circ);
+
+  ret = quantum_circuit_write(outfile, &circ);
+
+  quantum_delete_circuit(&circ);
+
+  return ret;
+}
@@ -0,0 +1,60 @@
+/* circuit.h: Declarations for circuit.c
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#ifndef __CIRCUIT_H
+
+#define __CIRCUIT_H
+
+#include "objcode.h"
+#include "qureg.h"
+
+/* Number of preceding instructions the optimizer looks at when trying
+   to move an instruction backwards */
+
+#define QUANTUM_CIRCUIT_WINDOW 64
+
+/* An object code program held in memory */
+
+struct quantum_circuit_struct
+{
+  unsigned long num;          /* number of instructions */
+  unsigned long allocated;    /* size of the INSN array */
+  quantum_objcode_insn *insn; /* instructions */
+};
+
+typedef struct quantum_circuit_struct quantum_circuit;
+
+extern quantum_circuit quantum_new_circuit();
+extern void quantum_delete_circuit(quantum_circuit *circ);
+extern void quantum_circuit_add(quantum_objcode_insn *insn, 
+				quantum_circuit *circ);
+extern unsigned long quantum_circuit_gates(quantum_circuit *circ);
+extern int quantum_circuit_load(char *file, quantum_circuit *circ);
+extern int quantum_circuit_write(char *file, quantum_circuit *circ);
+extern void quantum_circuit_run(quantum_circuit *circ, quantum_reg *reg);
+extern int quantum_circuit_qubits(quantum_objcode_insn *insn, int *q);
+extern int quantum_circuit_diagonal(unsigned char op);
+extern unsigned long quantum_circuit_optimize(quantum_circuit *circ);
+extern int quantum_objcode_optimize(char *infile, char *outfile);
+
+#endif
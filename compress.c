@@ -0,0 +1,219 @@
+/* compress.c: Block compression for object code files
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#include <string.h>
+
+#include "compress.h"
+
+/* This is a small LZ77 variant in the spirit of LZ4 and zstd's fast
+   modes, tuned for the highly repetitive gate sequences found in
+   object code. A compressed block is a series of sequences, each
+   consisting of a token byte (number of literals in the upper, match
+   length - 4 in the lower four bits), optional length extension
+   bytes, the literals, and a two-byte little-endian match
+   offset. Nibbles of 15 are continued by bytes which are added to the
+   length until a byte different from 255 occurs. The final sequence
+   consists of literals only. */
+
+#define HASH_BITS 13
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+
+/* Hash the four bytes starting at P */
+
+static inline unsigned int
+quantum_compress_hash(unsigned char *p)
+{
+  unsigned int v;
+
+  v = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+
+  return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+/* Store the remainder of a length which did not fit into a nibble */
+
+static unsigned char *
+quantum_compress_length(unsigned char *out, unsigned long len)
+{
+  while(len >= 255)
+    {
+      *out++ = 255;
+      len -= 255;
+    }
+
+  *out++ = len;
+
+  return out;
+}
+
+/* Emit a sequence of LIT literals starting at IN, followed by a match
+   of LEN bytes at distance OFFSET. A LEN of zero terminates the
+   block. */
+
+static unsigned char *
+quantum_compress_sequence(unsigned char *out, unsigned char *in, 
+			  unsigned long lit, unsigned long len, 
+			  unsigned long offset)
+{
+  unsigned char *token = out++;
+
+  *token = (lit < 15 ? lit : 15) << 4;
+
+  if(lit >= 15)
+    out = quantum_compress_length(out, lit - 15);
+
+  memcpy(out, in, lit);
+  out += lit;
+
+  if(!len)
+    return out;
+
+  *out++ = offset & 0xFF;
+  *out++ = offset >> 8;
+
+  len -= MIN_MATCH;
+  *token |= (len < 15 ? len : 15);
+
+  if(len >= 15)
+    out = quantum_compress_length(out, len - 15);
+
+  return out;
+}
+
+/* Compress N bytes from IN to OUT, which must be able to hold
+   QUANTUM_COMPRESS_BOUND(N) bytes. Returns the compressed size. */
+
+unsigned long
+quantum_compress(unsigned char *in, unsigned long n, unsigned char *out)
+{
+  long table[1 << HASH_BITS];
+  long i = 0, anchor = 0, ref, len;
+  unsigned int h;
+  unsigned char *p = out;
+
+  for(h=0; h<(1 << HASH_BITS); h++)
+    table[h] = -1;
+
+  while(i + MIN_MATCH <= n)
+    {
+      h = quantum_compress_hash(&in[i]);
+      ref = table[h];
+      table[h] = i;
+
+      if(ref >= 0 && i - ref <= MAX_OFFSET 
+	 && !memcmp(&in[ref], &in[i], MIN_MATCH))
+	{
+	  for(len=MIN_MATCH; i + len < n && in[ref+len] == in[i+len]; len++);
+
+	  p = quantum_compress_sequence(p, &in[anchor], i - anchor, len, 
+					i - ref);
+	  i += len;
+	  anchor = i;
+	}
+      else
+	i++;
+    }
+
+  p = quantum_compress_sequence(p, &in[anchor], n - anchor, 0, 0);
+
+  return p - out;
+}
+
+/* Decompress N bytes from IN to OUT, which can hold MAX bytes. Returns
+   the size of the decompressed data or -1 if the input is
+   corrupted. */
+
+long
+quantum_decompress(unsigned char *in, unsigned long n, unsigned char *out,
+		   unsigned long max)
+{
+  unsigned long ip = 0, op = 0, lit, len, offset;
+  unsigned char token, b;
+
+  while(ip < n)
+    {
+      token = in[ip++];
+
+      /* Copy the literals */
+
+      lit = token >> 4;
+
+      if(lit == 15)
+	{
+	  do
+	    {
+	      if(ip >= n)
+		return -1;
+	      b = in[ip++];
+	      lit += b;
+	    } while(b == 255);
+	}
+
+      if(ip + lit > n || op + lit > max)
+	return -1;
+
+      memcpy(&out[op], &in[ip], lit);
+      ip += lit;
+      op += lit;
+
+      /* The last sequence has no match */
+
+      if(ip == n)
+	break;
+
+      if(ip + 2 > n)
+	return -1;
+
+      offset = in[ip] | (in[ip+1] << 8);
+      ip += 2;
+
+      if(!offset || offset > op)
+	return -1;
+
+      len = token & 15;
+
+      if(len == 15)
+	{
+	  do
+	    {
+	      if(ip >= n)
+		return -1;
+	      b = in[ip++];
+	      len += b;
+	    } while(b == 255);
+	}
+
+      len += MIN_MATCH;
+
+      if(op + len > max)
+	return -1;
+
+      /* Matches may overlap their source, so copy bytewise */
+
+      for(; len>0; len--, op++)
+	out[op] = out[op-offset];
+    }
+
+  return op;
+}
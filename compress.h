@@ -0,0 +1,37 @@
+/* compress.h: Declarations for compress.c
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#ifndef __COMPRESS_H
+
+#define __COMPRESS_H
+
+/* Worst case size of the compressed representation of N bytes */
+
+#define QUANTUM_COMPRESS_BOUND(n) ((n) + (n) / 255 + 16)
+
+extern unsigned long quantum_compress(unsigned char *in, unsigned long n, 
+				      unsigned char *out);
+extern long quantum_decompress(unsigned char *in, unsigned long n, 
+			       unsigned char *out, unsigned long max);
+
+#endif
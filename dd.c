@@ -0,0 +1,1324 @@
+/* dd.c: Decision diagram representation of quantum registers
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "dd.h"
+#include "config.h"
+#include "complex.h"
+#include "matrix.h"
+#include "qureg.h"
+#include "objcode.h"
+#include "measure.h"
+#include "decoherence.h"
+#include "gates.h"
+#include "defer.h"
+#include "defs.h"
+#include "error.h"
+#include "alloc.h"
+
+/* A state vector can be stored as a decision diagram with one level
+   per qubit, where every node splits its part of the vector according
+   to the value of its qubit and equal parts up to a complex factor are
+   shared (QMDDs, D. M. Miller and M. A. Thornton, Proc. ISMVL 2006).
+   Structured states, like the periodic superpositions created by
+   modular exponentiation, need exponentially fewer nodes than
+   amplitudes. While a register is represented this way, gates and
+   measurements act on the diagram, with results memoized in a compute
+   cache. Any other operation first builds the state vector. As in
+   deferred mode, only one register can be represented this way at a
+   time. */
+
+#define DD_BITS (8 * (int) sizeof(MAX_UNSIGNED))
+
+/* Kinds of compute cache entries */
+
+enum {
+  DD_ADD      = 1,
+  DD_GATE     = 2,
+  DD_PROJECT  = 3,
+  DD_COLLAPSE = 4,
+  DD_SHIFT    = 5
+};
+
+/* A compute cache entry, mapping the operation OP on the nodes A and
+   B with the relative weight W to the result R */
+
+struct quantum_dd_entry_struct
+{
+  unsigned int op;
+  int a, b;
+  COMPLEX_FLOAT w;
+  quantum_dd_edge r;
+};
+
+typedef struct quantum_dd_entry_struct quantum_dd_entry;
+
+/* The register represented by a decision diagram, or 0 */
+
+static quantum_reg *dd_reg = 0;
+
+/* Its diagram */
+
+static quantum_dd dd;
+
+/* The compute cache */
+
+static quantum_dd_entry *dd_cache = 0;
+
+/* Number of the current operation, distinguishing cache entries of
+   different gates */
+
+static unsigned int dd_serial = 0;
+
+/* The current gate: a 2x2 matrix acting on DD_TARGET if all qubits in
+   DD_CTRL are set. DD_LOW is the lowest control below the target, or
+   -1. */
+
+static COMPLEX_FLOAT dd_m[4];
+static int dd_target;
+static int dd_ctrl[2];
+static int dd_nctrl;
+static int dd_low;
+
+/* The current measurement */
+
+static int dd_pos;
+static int dd_value;
+static int dd_remove;
+
+/* The chain of |0> nodes added by quantum_dd_addscratch */
+
+static quantum_dd_edge dd_scratch;
+
+static const quantum_dd_edge dd_zero = {0, 0};
+
+/* Check whether the weight W is zero */
+
+static inline int
+quantum_dd_iszero(COMPLEX_FLOAT w)
+{
+  return (fabs(quantum_real(w)) < QUANTUM_DD_TOLERANCE)
+    && (fabs(quantum_imag(w)) < QUANTUM_DD_TOLERANCE);
+}
+
+/* Check whether two weights are equal */
+
+static inline int
+quantum_dd_equal(COMPLEX_FLOAT a, COMPLEX_FLOAT b)
+{
+  return quantum_dd_iszero(a - b);
+}
+
+/* Multiply an edge with the factor F */
+
+static inline quantum_dd_edge
+quantum_dd_scale(quantum_dd_edge e, COMPLEX_FLOAT f)
+{
+  e.w *= f;
+
+  if(quantum_dd_iszero(e.w))
+    return dd_zero;
+
+  return e;
+}
+
+/* Hash a weight. Weights are rounded to a grid much coarser than the
+   tolerance, so that equal weights almost always end up in the same
+   bucket. */
+
+static inline unsigned int
+quantum_dd_hash_weight(COMPLEX_FLOAT w)
+{
+  long re, im;
+
+  re = floor(quantum_real(w) / (100 * QUANTUM_DD_TOLERANCE) + 0.5);
+  im = floor(quantum_imag(w) / (100 * QUANTUM_DD_TOLERANCE) + 0.5);
+
+  return (unsigned int) re * 40503u + (unsigned int) im;
+}
+
+/* Hash a node for the unique table */
+
+static inline unsigned int
+quantum_dd_hash_node(int var, quantum_dd_edge e0, quantum_dd_edge e1)
+{
+  unsigned int h;
+
+  h = var * 2654435761u;
+  h ^= e0.node * 97u + quantum_dd_hash_weight(e0.w);
+  h = h * 31u + e1.node * 9973u + quantum_dd_hash_weight(e1.w);
+
+  return h ^ (h >> 15);
+}
+
+/* Rebuild the unique table for 2^HASHW buckets */
+
+static void
+quantum_dd_rehash(int hashw)
+{
+  unsigned int b;
+  int n;
+
+  if(hashw != dd.hashw)
+    {
+      quantum_free(dd.table);
+      quantum_memman(((1L << hashw) - (1L << dd.hashw)) * sizeof(int));
+      dd.hashw = hashw;
+
+      dd.table = quantum_alloc((1L << hashw) * sizeof(int));
+
+      if(!dd.table)
+	quantum_error(QUANTUM_ENOMEM);
+    }
+
+  memset(dd.table, 0, (1L << hashw) * sizeof(int));
+
+  for(n=1; n<dd.num; n++)
+    {
+      b = quantum_dd_hash_node(dd.node[n].var, dd.node[n].e[0], 
+			       dd.node[n].e[1]) & ((1 << hashw) - 1);
+      dd.node[n].next = dd.table[b];
+      dd.table[b] = n;
+    }
+}
+
+/* Create an empty diagram for WIDTH qubits together with the compute
+   cache */
+
+static void
+quantum_dd_new(int width)
+{
+  dd.width = width;
+  dd.num = 1;
+  dd.alloc = 1024;
+  dd.limit = QUANTUM_DD_GC;
+  dd.hashw = 10;
+  dd.root = dd_zero;
+
+  dd.node = quantum_alloc(dd.alloc * sizeof(quantum_dd_node));
+  dd.table = quantum_calloc(1 << dd.hashw, sizeof(int));
+  dd_cache = quantum_calloc(1 << QUANTUM_DD_CACHE, sizeof(quantum_dd_entry));
+
+  if(!(dd.node && dd.table && dd_cache))
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman(dd.alloc * sizeof(quantum_dd_node)
+		 + (1 << dd.hashw) * sizeof(int)
+		 + (1 << QUANTUM_DD_CACHE) * sizeof(quantum_dd_entry));
+
+  /* The terminal node */
+
+  dd.node[0].var = -1;
+  dd.node[0].next = 0;
+  dd.node[0].e[0] = dd_zero;
+  dd.node[0].e[1] = dd_zero;
+
+  dd_serial = 0;
+}
+
+/* Release the diagram and the compute cache */
+
+static void
+quantum_dd_delete()
+{
+  quantum_free(dd.node);
+  quantum_free(dd.table);
+  quantum_free(dd_cache);
+
+  quantum_memman(-(dd.alloc * sizeof(quantum_dd_node)
+		   + (1 << dd.hashw) * sizeof(int)
+		   + (1 << QUANTUM_DD_CACHE) * sizeof(quantum_dd_entry)));
+
+  dd.node = 0;
+  dd.table = 0;
+  dd_cache = 0;
+}
+
+/* Return the node with qubit VAR and the successors E0 and E1, scaled
+   so that the larger weight is 1. The unique table makes sure that
+   each such node exists only once. */
+
+static quantum_dd_edge
+quantum_dd_make(int var, quantum_dd_edge e0, quantum_dd_edge e1)
+{
+  quantum_dd_edge r;
+  quantum_dd_node *p;
+  unsigned int b;
+  int n;
+
+  if(quantum_dd_iszero(e0.w))
+    e0 = dd_zero;
+
+  if(quantum_dd_iszero(e1.w))
+    e1 = dd_zero;
+
+  if((e0.w == 0) && (e1.w == 0))
+    return dd_zero;
+
+  if((e0.w == 0) || (quantum_prob_inline(e1.w) 
+		     > quantum_prob_inline(e0.w) * (1 + QUANTUM_DD_TOLERANCE)))
+    {
+      r.w = e1.w;
+      e0.w /= r.w;
+      e1.w = 1;
+    }
+  else
+    {
+      r.w = e0.w;
+      e1.w /= r.w;
+      e0.w = 1;
+    }
+
+  b = quantum_dd_hash_node(var, e0, e1);
+
+  for(n=dd.table[b & ((1 << dd.hashw) - 1)]; n; n=dd.node[n].next)
+    {
+      p = &dd.node[n];
+
+      if((p->var == var) && (p->e[0].node == e0.node) 
+	 && (p->e[1].node == e1.node) && quantum_dd_equal(p->e[0].w, e0.w)
+	 && quantum_dd_equal(p->e[1].w, e1.w))
+	{
+	  r.node = n;
+	  return r;
+	}
+    }
+
+  /* Add a new node, growing the node array and the unique table
+     geometrically */
+
+  if(dd.num == dd.alloc)
+    {
+      dd.node = quantum_realloc(dd.node, 2 * dd.alloc * sizeof(quantum_dd_node));
+
+      if(!dd.node)
+	quantum_error(QUANTUM_ENOMEM);
+
+      quantum_memman(dd.alloc * sizeof(quantum_dd_node));
+      dd.alloc *= 2;
+    }
+
+  n = dd.num++;
+
+  dd.node[n].var = var;
+  dd.node[n].e[0] = e0;
+  dd.node[n].e[1] = e1;
+
+  if(dd.num > (1 << dd.hashw))
+    quantum_dd_rehash(dd.hashw + 1);
+  else
+    {
+      b &= (1 << dd.hashw) - 1;
+      dd.node[n].next = dd.table[b];
+      dd.table[b] = n;
+    }
+
+  r.node = n;
+
+  return r;
+}
+
+/* Look up the result of an operation in the compute cache */
+
+static inline quantum_dd_entry *
+quantum_dd_cache(unsigned int op, int a, int b, COMPLEX_FLOAT w)
+{
+  unsigned int h;
+
+  h = op * 2654435761u ^ a * 40503u ^ b * 9973u ^ quantum_dd_hash_weight(w);
+
+  return &dd_cache[(h ^ (h >> 16)) & ((1 << QUANTUM_DD_CACHE) - 1)];
+}
+
+static inline int
+quantum_dd_lookup(unsigned int op, int a, int b, COMPLEX_FLOAT w, 
+		  quantum_dd_edge *r)
+{
+  quantum_dd_entry *c = quantum_dd_cache(op, a, b, w);
+
+  if((c->op == op) && (c->a == a) && (c->b == b) && quantum_dd_equal(c->w, w))
+    {
+      *r = c->r;
+      return 1;
+    }
+
+  return 0;
+}
+
+static inline void
+quantum_dd_store(unsigned int op, int a, int b, COMPLEX_FLOAT w, 
+		 quantum_dd_edge r)
+{
+  quantum_dd_entry *c = quantum_dd_cache(op, a, b, w);
+
+  c->op = op;
+  c->a = a;
+  c->b = b;
+  c->w = w;
+  c->r = r;
+}
+
+/* Start a new operation. Its cache entries are told apart from those
+   of previous operations by the serial number. */
+
+static unsigned int
+quantum_dd_op(int kind)
+{
+  if(++dd_serial >= (1u << 28))
+    {
+      memset(dd_cache, 0, (1 << QUANTUM_DD_CACHE) * sizeof(quantum_dd_entry));
+      dd_serial = 1;
+    }
+
+  return (dd_serial << 3) | kind;
+}
+
+/* Add two vectors */
+
+static quantum_dd_edge
+quantum_dd_add(quantum_dd_edge x, quantum_dd_edge y)
+{
+  quantum_dd_edge r, t, a[2], b[2];
+  COMPLEX_FLOAT f;
+  int var;
+
+  if(quantum_dd_iszero(x.w))
+    return y;
+
+  if(quantum_dd_iszero(y.w))
+    return x;
+
+  if(x.node == y.node)
+    return quantum_dd_scale(x, 1 + y.w / x.w);
+
+  if(x.node > y.node)
+    {
+      t = x;
+      x = y;
+      y = t;
+    }
+
+  /* x + y = x.w (X + f Y) */
+
+  f = y.w / x.w;
+
+  if(!quantum_dd_lookup(DD_ADD, x.node, y.node, f, &r))
+    {
+      var = dd.node[x.node].var;
+      a[0] = dd.node[x.node].e[0];
+      a[1] = dd.node[x.node].e[1];
+      b[0] = quantum_dd_scale(dd.node[y.node].e[0], f);
+      b[1] = quantum_dd_scale(dd.node[y.node].e[1], f);
+
+      a[0] = quantum_dd_add(a[0], b[0]);
+      a[1] = quantum_dd_add(a[1], b[1]);
+
+      r = quantum_dd_make(var, a[0], a[1]);
+
+      quantum_dd_store(DD_ADD, x.node, y.node, f, r);
+    }
+
+  return quantum_dd_scale(r, x.w);
+}
+
+/* Check whether VAR is a control qubit of the current gate */
+
+static inline int
+quantum_dd_isctrl(int var)
+{
+  return ((dd_nctrl > 0) && (dd_ctrl[0] == var)) 
+    || ((dd_nctrl > 1) && (dd_ctrl[1] == var));
+}
+
+/* Project the vector of node N onto the subspace where all controls
+   below the target are set */
+
+static quantum_dd_edge
+quantum_dd_project(unsigned int op, int n)
+{
+  quantum_dd_edge r, e[2];
+  int var = dd.node[n].var;
+
+  if(var < dd_low)
+    {
+      r.node = n;
+      r.w = 1;
+      return r;
+    }
+
+  if(quantum_dd_lookup(op, n, 0, 1, &r))
+    return r;
+
+  e[0] = dd.node[n].e[0];
+  e[1] = dd.node[n].e[1];
+
+  if(quantum_dd_isctrl(var))
+    e[0] = dd_zero;
+  else
+    e[0] = quantum_dd_scale(quantum_dd_project(op, e[0].node), e[0].w);
+
+  e[1] = quantum_dd_scale(quantum_dd_project(op, e[1].node), e[1].w);
+
+  r = quantum_dd_make(var, e[0], e[1]);
+
+  quantum_dd_store(op, n, 0, 1, r);
+
+  return r;
+}
+
+/* Apply the current gate to the vector of node N. Above the target,
+   only the branches with all controls set are followed. At the
+   target, the matrix mixes both branches. Controls below the target
+   restrict this to the projection P onto their set values: with
+   branches E0 and E1, the result is Es + sum_t (M(s,t) - delta(s,t))
+   P Et. */
+
+static quantum_dd_edge
+quantum_dd_gate_node(unsigned int op, int n)
+{
+  quantum_dd_edge r, e[2], p[2], c[2];
+  int var = dd.node[n].var;
+  int s;
+
+  if(var < dd_target)
+    {
+      r.node = n;
+      r.w = 1;
+      return r;
+    }
+
+  if(quantum_dd_lookup(op, n, 0, 1, &r))
+    return r;
+
+  e[0] = dd.node[n].e[0];
+  e[1] = dd.node[n].e[1];
+
+  if(var > dd_target)
+    {
+      if(!quantum_dd_isctrl(var))
+	e[0] = quantum_dd_scale(quantum_dd_gate_node(op, e[0].node), e[0].w);
+
+      e[1] = quantum_dd_scale(quantum_dd_gate_node(op, e[1].node), e[1].w);
+    }
+
+  else if(dd_low < 0)
+    {
+      for(s=0; s<2; s++)
+	c[s] = quantum_dd_add(quantum_dd_scale(e[0], dd_m[2*s]), 
+			      quantum_dd_scale(e[1], dd_m[2*s+1]));
+
+      e[0] = c[0];
+      e[1] = c[1];
+    }
+
+  else
+    {
+      for(s=0; s<2; s++)
+	p[s] = quantum_dd_scale(quantum_dd_project(op + DD_PROJECT - DD_GATE,
+						   e[s].node), e[s].w);
+
+      for(s=0; s<2; s++)
+	c[s] = quantum_dd_add(e[s], quantum_dd_add(
+          quantum_dd_scale(p[0], dd_m[2*s] - (s == 0)), 
+	  quantum_dd_scale(p[1], dd_m[2*s+1] - (s == 1))));
+
+      e[0] = c[0];
+      e[1] = c[1];
+    }
+
+  r = quantum_dd_make(var, e[0], e[1]);
+
+  quantum_dd_store(op, n, 0, 1, r);
+
+  return r;
+}
+
+/* Renumber the nodes reachable from node N in depth-first order, so
+   that successors still come first */
+
+static void
+quantum_dd_mark(int n, int *map, int *num)
+{
+  if(map[n] >= 0)
+    return;
+
+  quantum_dd_mark(dd.node[n].e[0].node, map, num);
+  quantum_dd_mark(dd.node[n].e[1].node, map, num);
+
+  map[n] = (*num)++;
+}
+
+/* Remove all nodes no longer reachable from the root. The remaining
+   nodes are moved into a new array sized to twice their number, so
+   that the memory of dead nodes is returned. As node numbers change,
+   the compute cache is cleared. */
+
+static void
+quantum_dd_collect()
+{
+  quantum_dd_node *node;
+  int *map;
+  int i, n, num = 1, alloc, hashw;
+
+  if(dd.num < dd.limit)
+    return;
+
+  map = malloc(dd.num * sizeof(int));
+
+  if(!map)
+    quantum_error(QUANTUM_ENOMEM);
+
+  for(i=0; i<dd.num; i++)
+    map[i] = -1;
+
+  map[0] = 0;
+
+  quantum_dd_mark(dd.root.node, map, &num);
+
+  for(alloc=1024; alloc<2*num; alloc*=2);
+
+  node = quantum_alloc(alloc * sizeof(quantum_dd_node));
+
+  if(!node)
+    quantum_error(QUANTUM_ENOMEM);
+
+  for(i=0; i<dd.num; i++)
+    {
+      n = map[i];
+
+      if(n < 0)
+	continue;
+
+      node[n] = dd.node[i];
+      node[n].e[0].node = map[dd.node[i].e[0].node];
+      node[n].e[1].node = map[dd.node[i].e[1].node];
+    }
+
+  quantum_free(dd.node);
+  quantum_memman((alloc - dd.alloc) * (long) sizeof(quantum_dd_node));
+
+  dd.node = node;
+  dd.alloc = alloc;
+  dd.num = num;
+  dd.root.node = map[dd.root.node];
+
+  dd.limit = 2 * num;
+
+  if(dd.limit < QUANTUM_DD_GC)
+    dd.limit = QUANTUM_DD_GC;
+
+  for(hashw=10; (1 << hashw) < num; hashw++);
+
+  quantum_dd_rehash(hashw);
+
+  memset(dd_cache, 0, (1 << QUANTUM_DD_CACHE) * sizeof(quantum_dd_entry));
+
+  free(map);
+}
+
+/* Apply the 2x2 matrix M to qubit TARGET, controlled by the NCTRL
+   qubits C0 and C1 */
+
+static void
+quantum_dd_gate(int target, int nctrl, int c0, int c1, COMPLEX_FLOAT m0,
+		COMPLEX_FLOAT m1, COMPLEX_FLOAT m2, COMPLEX_FLOAT m3)
+{
+  int i;
+
+  dd_target = target;
+  dd_nctrl = nctrl;
+  dd_ctrl[0] = c0;
+  dd_ctrl[1] = c1;
+  dd_m[0] = m0;
+  dd_m[1] = m1;
+  dd_m[2] = m2;
+  dd_m[3] = m3;
+
+  dd_low = -1;
+
+  for(i=0; i<nctrl; i++)
+    {
+      if((dd_ctrl[i] < target) && ((dd_low < 0) || (dd_ctrl[i] < dd_low)))
+	dd_low = dd_ctrl[i];
+    }
+
+  dd.root = quantum_dd_scale(quantum_dd_gate_node(quantum_dd_op(DD_GATE), 
+						  dd.root.node), dd.root.w);
+}
+
+/* Squared norms of the vectors of all nodes */
+
+static double *
+quantum_dd_norms()
+{
+  double *norm;
+  int n;
+
+  norm = malloc(dd.num * sizeof(double));
+
+  if(!norm)
+    quantum_error(QUANTUM_ENOMEM);
+
+  norm[0] = 1;
+
+  for(n=1; n<dd.num; n++)
+    norm[n] = quantum_prob_inline(dd.node[n].e[0].w) 
+      * norm[dd.node[n].e[0].node]
+      + quantum_prob_inline(dd.node[n].e[1].w) * norm[dd.node[n].e[1].node];
+
+  return norm;
+}
+
+/* Build the diagram of a sorted list of basis states, all of which
+   agree in the qubits above VAR */
+
+struct quantum_dd_pair_struct
+{
+  MAX_UNSIGNED state;
+  COMPLEX_FLOAT amplitude;
+};
+
+typedef struct quantum_dd_pair_struct quantum_dd_pair;
+
+static int
+quantum_dd_compare(const void *a, const void *b)
+{
+  MAX_UNSIGNED x = ((quantum_dd_pair *) a)->state;
+  MAX_UNSIGNED y = ((quantum_dd_pair *) b)->state;
+
+  return (x > y) - (x < y);
+}
+
+static quantum_dd_edge
+quantum_dd_build(quantum_dd_pair *p, int n, int var)
+{
+  quantum_dd_edge e0, e1;
+  int k;
+
+  if(!n)
+    return dd_zero;
+
+  if(var < 0)
+    {
+      e0.node = 0;
+      e0.w = p[0].amplitude;
+      return e0;
+    }
+
+  /* States with bit VAR cleared come first */
+
+  for(k=0; (k < n) && (var < DD_BITS) 
+	&& !(p[k].state & ((MAX_UNSIGNED) 1 << var)); k++);
+
+  if(var >= DD_BITS)
+    k = n;
+
+  e0 = quantum_dd_build(p, k, var - 1);
+  e1 = quantum_dd_build(p + k, n - k, var - 1);
+
+  return quantum_dd_make(var, e0, e1);
+}
+
+/* Create a new quantum register to be represented by a decision
+   diagram. As with quantum_new_stabilizer_qureg, no hash table is
+   allocated until the state vector is needed and the register has
+   to be passed to quantum_dd_start before any gates are applied to
+   it. */
+
+quantum_reg
+quantum_new_dd_qureg(MAX_UNSIGNED initval, int width)
+{
+  quantum_reg reg;
+
+  reg.width = width;
+  reg.size = 1;
+  reg.hashw = width + 2;
+  reg.hash = 0;
+
+  reg.state = quantum_calloc(1, sizeof(MAX_UNSIGNED));
+  reg.amplitude = quantum_calloc(1, sizeof(COMPLEX_FLOAT));
+
+  if(!(reg.state && reg.amplitude))
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman(sizeof(MAX_UNSIGNED) + sizeof(COMPLEX_FLOAT));
+
+  reg.state[0] = initval;
+  reg.amplitude[0] = 1;
+
+  quantum_objcode_put(INIT, initval, width);
+
+  return reg;
+}
+
+/* Start representing REG by a decision diagram. Its state vector and
+   hash table are released until the register is converted back by
+   quantum_dd_stop. */
+
+void
+quantum_dd_start(quantum_reg *reg)
+{
+  quantum_dd_pair *p;
+  int i;
+
+  if(quantum_dd_active(reg))
+    return;
+
+  quantum_flush(reg);
+
+  if(dd_reg)
+    quantum_dd_stop(dd_reg);
+
+  if(!reg->state)
+    return;
+
+  quantum_dd_new(reg->width);
+
+  p = malloc(reg->size * sizeof(quantum_dd_pair));
+
+  if(!p)
+    quantum_error(QUANTUM_ENOMEM);
+
+  for(i=0; i<reg->size; i++)
+    {
+      p[i].state = reg->state[i];
+      p[i].amplitude = reg->amplitude[i];
+    }
+
+  qsort(p, reg->size, sizeof(quantum_dd_pair), quantum_dd_compare);
+
+  dd.root = quantum_dd_build(p, reg->size, reg->width - 1);
+
+  free(p);
+
+  if(reg->hash)
+    quantum_destroy_hash(reg);
+
+  reg->state = quantum_realloc(reg->state, sizeof(MAX_UNSIGNED));
+  reg->amplitude = quantum_realloc(reg->amplitude, sizeof(COMPLEX_FLOAT));
+
+  if(!(reg->state && reg->amplitude))
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman((1 - reg->size) * (sizeof(MAX_UNSIGNED) 
+				    + sizeof(COMPLEX_FLOAT)));
+
+  reg->size = 1;
+
+  dd_reg = reg;
+}
+
+/* Write the basis states below node N to OUT */
+
+static void
+quantum_dd_emit(int n, MAX_UNSIGNED state, COMPLEX_FLOAT a, quantum_reg *out)
+{
+  quantum_dd_node *p = &dd.node[n];
+  int s;
+
+  if(!n)
+    {
+      out->state[out->size] = state;
+      out->amplitude[out->size] = a;
+      out->size++;
+      return;
+    }
+
+  for(s=0; s<2; s++)
+    {
+      if(p->e[s].w != 0)
+	quantum_dd_emit(p->e[s].node, state | ((MAX_UNSIGNED) s << p->var), 
+			a * p->e[s].w, out);
+    }
+}
+
+/* Build the state vector of REG from its diagram and stop
+   representing it this way. REG may also be a copy of the register,
+   as passed by value to quantum_print_qureg, in which case it is
+   updated afterwards. */
+
+void
+quantum_dd_stop(quantum_reg *reg)
+{
+  quantum_reg *out;
+  double *count;
+  int n, s, size;
+
+  if(!quantum_dd_active(reg))
+    return;
+
+  out = dd_reg;
+
+  /* Count the non-zero amplitudes */
+
+  count = malloc(dd.num * sizeof(double));
+
+  if(!count)
+    quantum_error(QUANTUM_ENOMEM);
+
+  count[0] = 1;
+
+  for(n=1; n<dd.num; n++)
+    {
+      count[n] = 0;
+
+      for(s=0; s<2; s++)
+	{
+	  if(dd.node[n].e[s].w != 0)
+	    count[n] += count[dd.node[n].e[s].node];
+	}
+    }
+
+  if((dd.width > DD_BITS) || (count[dd.root.node] > (1 << 30)) 
+     || (!out->hash && out->hashw > 30))
+    quantum_error(QUANTUM_EWIDTH);
+
+  size = dd.root.w != 0 ? count[dd.root.node] : 0;
+
+  free(count);
+
+  out->state = quantum_realloc(out->state, size * sizeof(MAX_UNSIGNED));
+  out->amplitude = quantum_realloc(out->amplitude, 
+				   size * sizeof(COMPLEX_FLOAT));
+
+  if(size && !(out->state && out->amplitude))
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman((size - out->size) * (sizeof(MAX_UNSIGNED) 
+				       + sizeof(COMPLEX_FLOAT)));
+
+  out->size = 0;
+
+  if(size)
+    quantum_dd_emit(dd.root.node, 0, dd.root.w, out);
+
+  if(!out->hash)
+    {
+      out->hash = quantum_calloc(1 << out->hashw, sizeof(int));
+
+      if(!out->hash)
+	quantum_error(QUANTUM_ENOMEM);
+
+      quantum_memman((1 << out->hashw) * sizeof(int));
+    }
+
+  quantum_reconstruct_hash(out);
+
+  quantum_dd_delete();
+  dd_reg = 0;
+
+  if(reg != out)
+    *reg = *out;
+}
+
+/* Stop representing a register which is about to be deleted */
+
+void
+quantum_dd_drop(quantum_reg *reg)
+{
+  if(!quantum_dd_active(reg))
+    return;
+
+  quantum_dd_delete();
+  dd_reg = 0;
+}
+
+/* Check whether REG is represented by a decision diagram */
+
+int
+quantum_dd_active(quantum_reg *reg)
+{
+  return dd_reg && ((reg == dd_reg) || (reg->state == dd_reg->state));
+}
+
+/* Return the number of nodes of the diagram of REG, including dead
+   nodes not yet garbage collected */
+
+int
+quantum_dd_nodes(quantum_reg *reg)
+{
+  if(!quantum_dd_active(reg))
+    return 0;
+
+  return dd.num;
+}
+
+/* Check whether A is a qubit of the diagram */
+
+static inline int
+quantum_dd_qubit(int a)
+{
+  return (a >= 0) && (a < dd.width);
+}
+
+/* Apply a gate to the diagram. Returns 0 if the gate is not
+   supported. */
+
+static int
+quantum_dd_exec(quantum_objcode_insn *insn)
+{
+  COMPLEX_FLOAT z;
+  float c, s;
+  int i;
+  int *a = insn->arg;
+
+  switch(insn->op)
+    {
+    case CNOT:
+      if(!quantum_dd_qubit(a[0]) || !quantum_dd_qubit(a[1]) 
+	 || (a[0] == a[1]))
+	return 0;
+      quantum_dd_gate(a[1], 1, a[0], -1, 0, 1, 1, 0);
+      return 1;
+
+    case TOFFOLI:
+      if(!quantum_dd_qubit(a[0]) || !quantum_dd_qubit(a[1]) 
+	 || !quantum_dd_qubit(a[2]) || (a[0] == a[2]) || (a[1] == a[2]))
+	return 0;
+      quantum_dd_gate(a[2], 2, a[0], a[1], 0, 1, 1, 0);
+      return 1;
+
+    case SIGMA_X:
+      if(!quantum_dd_qubit(a[0]))
+	return 0;
+      quantum_dd_gate(a[0], 0, -1, -1, 0, 1, 1, 0);
+      return 1;
+
+    case SIGMA_Y:
+      if(!quantum_dd_qubit(a[0]))
+	return 0;
+      quantum_dd_gate(a[0], 0, -1, -1, 0, -IMAGINARY, IMAGINARY, 0);
+      return 1;
+
+    case SIGMA_Z:
+      if(!quantum_dd_qubit(a[0]))
+	return 0;
+      quantum_dd_gate(a[0], 0, -1, -1, 1, 0, 0, -1);
+      return 1;
+
+    case HADAMARD:
+      if(!quantum_dd_qubit(a[0]))
+	return 0;
+      quantum_dd_gate(a[0], 0, -1, -1, sqrt(1.0/2), sqrt(1.0/2), 
+		      sqrt(1.0/2), -sqrt(1.0/2));
+      return 1;
+
+    case ROT_X:
+      if(!quantum_dd_qubit(a[0]))
+	return 0;
+      c = cos(insn->d / 2);
+      s = sin(insn->d / 2);
+      quantum_dd_gate(a[0], 0, -1, -1, c, -IMAGINARY * s, -IMAGINARY * s, c);
+      return 1;
+
+    case ROT_Y:
+      if(!quantum_dd_qubit(a[0]))
+	return 0;
+      c = cos(insn->d / 2);
+      s = sin(insn->d / 2);
+      quantum_dd_gate(a[0], 0, -1, -1, c, -s, s, c);
+      return 1;
+
+    case ROT_Z:
+      if(!quantum_dd_qubit(a[0]))
+	return 0;
+      z = quantum_cexp(insn->d / 2);
+      quantum_dd_gate(a[0], 0, -1, -1, 1 / z, 0, 0, z);
+      return 1;
+
+    case PHASE_KICK:
+      if(!quantum_dd_qubit(a[0]))
+	return 0;
+      quantum_dd_gate(a[0], 0, -1, -1, 1, 0, 0, quantum_cexp(insn->d));
+      return 1;
+
+    case PHASE_SCALE:
+      dd.root.w *= quantum_cexp(insn->d);
+      return 1;
+
+    case COND_PHASE:
+    case CPHASE_KICK:
+      if(!quantum_dd_qubit(a[0]) || !quantum_dd_qubit(a[1]))
+	return 0;
+
+      if(insn->op == CPHASE_KICK)
+	z = quantum_cexp(insn->d);
+      else if(a[0] >= a[1])
+	z = quantum_cexp(pi / ((MAX_UNSIGNED) 1 << (a[0] - a[1])));
+      else
+	return 0;
+
+      if(a[0] == a[1])
+	quantum_dd_gate(a[1], 0, -1, -1, 1, 0, 0, z);
+      else
+	quantum_dd_gate(a[1], 1, a[0], -1, 1, 0, 0, z);
+      return 1;
+
+    case SWAPLEADS:
+      if(2 * a[0] > dd.width)
+	return 0;
+      for(i=0; i<a[0]; i++)
+	{
+	  quantum_dd_gate(a[0] + i, 1, i, -1, 0, 1, 1, 0);
+	  quantum_dd_gate(i, 1, a[0] + i, -1, 0, 1, 1, 0);
+	  quantum_dd_gate(a[0] + i, 1, i, -1, 0, 1, 1, 0);
+	}
+      return 1;
+
+    case SWAPBITS:
+      if(!quantum_dd_qubit(a[0]) || !quantum_dd_qubit(a[1]))
+	return 0;
+      if(a[0] != a[1])
+	{
+	  quantum_dd_gate(a[1], 1, a[0], -1, 0, 1, 1, 0);
+	  quantum_dd_gate(a[0], 1, a[1], -1, 0, 1, 1, 0);
+	  quantum_dd_gate(a[1], 1, a[0], -1, 0, 1, 1, 0);
+	}
+      return 1;
+
+    case BITREVERSE:
+      if(a[0] > dd.width)
+	return 0;
+      for(i=0; i<a[0]/2; i++)
+	{
+	  quantum_dd_gate(a[0] - i - 1, 1, i, -1, 0, 1, 1, 0);
+	  quantum_dd_gate(i, 1, a[0] - i - 1, -1, 0, 1, 1, 0);
+	  quantum_dd_gate(a[0] - i - 1, 1, i, -1, 0, 1, 1, 0);
+	}
+      return 1;
+
+    default:
+      return 0;
+    }
+}
+
+/* Apply the gate INSN to REG if it is represented by a decision
+   diagram. Returns 1 if the gate has been applied and must not be
+   executed. Otherwise, the state vector is built for the gate to act
+   on. Decoherence is only simulated on the state vector. */
+
+int
+quantum_dd_put(quantum_reg *reg, quantum_objcode_insn *insn)
+{
+  if(!quantum_dd_active(reg))
+    return 0;
+
+  if(!quantum_status && quantum_dd_exec(insn))
+    {
+      quantum_gate_counter(1);
+      quantum_dd_collect();
+      return 1;
+    }
+
+  quantum_dd_stop(reg);
+
+  return 0;
+}
+
+/* Measure all qubits of REG without changing it, see
+   quantum_measure. Each qubit is sampled from the top, conditioned
+   on the values of the ones above. For registers wider than
+   MAX_UNSIGNED, only the lower bits are returned. */
+
+MAX_UNSIGNED
+quantum_dd_measure(quantum_reg *reg)
+{
+  MAX_UNSIGNED result = 0;
+  double *norm, p0, p1;
+  quantum_dd_node *p;
+  int n, s;
+
+  norm = quantum_dd_norms();
+
+  for(n=dd.root.node; n; n=p->e[s].node)
+    {
+      p = &dd.node[n];
+
+      p0 = quantum_prob_inline(p->e[0].w) * norm[p->e[0].node];
+      p1 = quantum_prob_inline(p->e[1].w) * norm[p->e[1].node];
+
+      s = quantum_frand() > p0 / (p0 + p1);
+
+      if(s && (p->var < DD_BITS))
+	result |= (MAX_UNSIGNED) 1 << p->var;
+    }
+
+  free(norm);
+
+  return result;
+}
+
+/* Restrict the vector of node N to qubit DD_POS having the value
+   DD_VALUE. If DD_REMOVE is set, the qubit is removed. */
+
+static quantum_dd_edge
+quantum_dd_collapse(unsigned int op, int n)
+{
+  quantum_dd_edge r, e[2];
+  int var = dd.node[n].var;
+
+  if(quantum_dd_lookup(op, n, 0, 1, &r))
+    return r;
+
+  e[0] = dd.node[n].e[0];
+  e[1] = dd.node[n].e[1];
+
+  if(var > dd_pos)
+    {
+      e[0] = quantum_dd_scale(quantum_dd_collapse(op, e[0].node), e[0].w);
+      e[1] = quantum_dd_scale(quantum_dd_collapse(op, e[1].node), e[1].w);
+      r = quantum_dd_make(var - dd_remove, e[0], e[1]);
+    }
+
+  else if(dd_remove)
+    r = e[dd_value];
+
+  else
+    {
+      e[!dd_value] = dd_zero;
+      r = quantum_dd_make(var, e[0], e[1]);
+    }
+
+  quantum_dd_store(op, n, 0, 1, r);
+
+  return r;
+}
+
+/* Measure qubit POS of REG, see quantum_bmeasure and
+   quantum_bmeasure_bitpreserve. Unless PRESERVE is set, the qubit is
+   removed from the register afterwards. */
+
+int
+quantum_dd_bmeasure(int pos, int preserve, quantum_reg *reg)
+{
+  double *norm, *q, pa;
+  quantum_dd_edge r;
+  int n, result;
+
+  if(!quantum_dd_qubit(pos))
+    return 0;
+
+  /* Q holds the squared norm of the part with qubit POS cleared */
+
+  norm = quantum_dd_norms();
+  q = malloc(dd.num * sizeof(double));
+
+  if(!q)
+    quantum_error(QUANTUM_ENOMEM);
+
+  q[0] = 0;
+
+  for(n=1; n<dd.num; n++)
+    {
+      if(dd.node[n].var == pos)
+	q[n] = quantum_prob_inline(dd.node[n].e[0].w) 
+	  * norm[dd.node[n].e[0].node];
+      else if(dd.node[n].var > pos)
+	q[n] = quantum_prob_inline(dd.node[n].e[0].w) 
+	  * q[dd.node[n].e[0].node]
+	  + quantum_prob_inline(dd.node[n].e[1].w) * q[dd.node[n].e[1].node];
+    }
+
+  pa = q[dd.root.node] / norm[dd.root.node];
+  result = quantum_frand() > pa;
+
+  dd_pos = pos;
+  dd_value = result;
+  dd_remove = !preserve;
+
+  r = quantum_dd_collapse(quantum_dd_op(DD_COLLAPSE), dd.root.node);
+
+  /* Normalize the remaining part */
+
+  r.w *= dd.root.w / sqrt(quantum_prob_inline(dd.root.w) 
+			  * norm[dd.root.node] * (result ? 1 - pa : pa));
+  dd.root = r;
+
+  free(q);
+  free(norm);
+
+  if(!preserve)
+    {
+      dd.width--;
+      dd_reg->width--;
+      reg->width = dd_reg->width;
+    }
+
+  quantum_dd_collect();
+
+  return result;
+}
+
+/* Move all qubits of the vector of node N up by the number of qubits
+   in the chain DD_SCRATCH, which is attached to the bottom */
+
+static quantum_dd_edge
+quantum_dd_shift(unsigned int op, int n, int bits)
+{
+  quantum_dd_edge r, e[2];
+
+  if(!n)
+    return dd_scratch;
+
+  if(quantum_dd_lookup(op, n, 0, 1, &r))
+    return r;
+
+  e[0] = dd.node[n].e[0];
+  e[1] = dd.node[n].e[1];
+
+  e[0] = quantum_dd_scale(quantum_dd_shift(op, e[0].node, bits), e[0].w);
+  e[1] = quantum_dd_scale(quantum_dd_shift(op, e[1].node, bits), e[1].w);
+
+  r = quantum_dd_make(dd.node[n].var + bits, e[0], e[1]);
+
+  quantum_dd_store(op, n, 0, 1, r);
+
+  return r;
+}
+
+/* Add BITS scratch qubits in the state 0 below the qubits of REG,
+   see quantum_addscratch */
+
+void
+quantum_dd_addscratch(int bits, quantum_reg *reg)
+{
+  quantum_dd_edge one = {0, 1};
+  int i;
+
+  dd_scratch = one;
+
+  for(i=0; i<bits; i++)
+    dd_scratch = quantum_dd_make(i, dd_scratch, dd_zero);
+
+  dd.root = quantum_dd_scale(quantum_dd_shift(quantum_dd_op(DD_SHIFT), 
+					      dd.root.node, bits), dd.root.w);
+
+  dd.width += bits;
+  dd_reg->width += bits;
+  reg->width = dd_reg->width;
+
+  quantum_dd_collect();
+}
@@ -0,0 +1,95 @@
+/* dd.h: Declarations for dd.c
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#ifndef __DD_H
+
+#define __DD_H
+
+#include "config.h"
+#include "qureg.h"
+#include "objcode.h"
+
+/* Edge weights closer than this are considered equal */
+
+#define QUANTUM_DD_TOLERANCE 1e-6
+
+/* Log2 of the number of compute cache entries */
+
+#define QUANTUM_DD_CACHE 16
+
+/* Minimum number of nodes before the first garbage collection */
+
+#define QUANTUM_DD_GC 65536
+
+/* An edge of a decision diagram, pointing to a node and scaling the
+   vector it represents by a complex weight */
+
+struct quantum_dd_edge_struct
+{
+  int node;          /* target node, 0 for the terminal */
+  COMPLEX_FLOAT w;   /* weight, 0 for the zero vector */
+};
+
+typedef struct quantum_dd_edge_struct quantum_dd_edge;
+
+/* A node of a decision diagram. It splits the vector of the qubits up
+   to VAR into the parts with qubit VAR being 0 and 1. */
+
+struct quantum_dd_node_struct
+{
+  int var;              /* qubit, -1 for the terminal */
+  int next;             /* next node in the same unique table bucket */
+  quantum_dd_edge e[2]; /* successors */
+};
+
+typedef struct quantum_dd_node_struct quantum_dd_node;
+
+/* A decision diagram with its unique table. Nodes are stored after
+   their successors, the terminal is node 0. */
+
+struct quantum_dd_struct
+{
+  int width;             /* number of qubits */
+  int num;               /* nodes in use */
+  int alloc;             /* allocated nodes */
+  int limit;             /* node count triggering garbage collection */
+  int hashw;             /* log2 of the number of unique table buckets */
+  int *table;            /* unique table */
+  quantum_dd_node *node; /* nodes */
+  quantum_dd_edge root;  /* the state vector */
+};
+
+typedef struct quantum_dd_struct quantum_dd;
+
+extern quantum_reg quantum_new_dd_qureg(MAX_UNSIGNED initval, int width);
+extern void quantum_dd_start(quantum_reg *reg);
+extern void quantum_dd_stop(quantum_reg *reg);
+extern void quantum_dd_drop(quantum_reg *reg);
+extern int quantum_dd_active(quantum_reg *reg);
+extern int quantum_dd_nodes(quantum_reg *reg);
+extern int quantum_dd_put(quantum_reg *reg, quantum_objcode_insn *insn);
+extern MAX_UNSIGNED quantum_dd_measure(quantum_reg *reg);
+extern int quantum_dd_bmeasure(int pos, int preserve, quantum_reg *reg);
+extern void quantum_dd_addscratch(int bits, quantum_reg *reg);
+
+#endif
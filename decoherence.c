@@ -30,6 +30,7 @@
 #include "gates.h"
 #include "complex.h"
 #include "error.h"
+#include "checkpoint.h"
 
 /* Status of the decoherence simulation. Non-zero means enabled and
    decoherence effects will be simulated. */
@@ -77,6 +78,7 @@ quantum_decohere(quantum_reg *reg)
   /* Increase the gate counter */
 
   quantum_gate_counter(1);
+  quantum_checkpoint_counter(reg);
 
   if(quantum_status)
     {
@@ -25,6 +25,8 @@
 
 #define __DECOHERENCE_H
 
+extern int quantum_status;
+
 extern float quantum_get_decoherence();
 
 extern void quantum_set_decoherence(float lambda);
@@ -0,0 +1,170 @@
+/* defer.c: Deferred execution of quantum gates
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "defer.h"
+#include "circuit.h"
+#include "objcode.h"
+#include "qureg.h"
+#include "decoherence.h"
+#include "stabilizer.h"
+#include "dd.h"
+#include "product.h"
+#include "remap.h"
+
+/* In deferred mode, gates applied to a single register are not
+   executed immediately, but queued as object code instructions.
+   Before the register is used in any other way, e.g. measured, the
+   queue is optimized as a whole and executed. */
+
+/* The deferred register, or 0 if deferred mode is not active */
+
+static quantum_reg *defer_reg = 0;
+
+/* Queued instructions */
+
+static quantum_circuit defer_circ = {0, 0, 0};
+
+/* Non-zero while the queue is being executed */
+
+static int defer_flushing = 0;
+
+/* Start deferring the gates applied to REG. Only one register can be
+   deferred at a time, a previously deferred register is flushed. */
+
+void
+quantum_defer_start(quantum_reg *reg)
+{
+  if(defer_reg && defer_reg != reg)
+    quantum_defer_stop(defer_reg);
+
+  defer_reg = reg;
+}
+
+/* Execute all queued gates and return to immediate mode */
+
+void
+quantum_defer_stop(quantum_reg *reg)
+{
+  if(!quantum_defer_active(reg))
+    return;
+
+  quantum_flush(reg);
+
+  defer_reg = 0;
+  quantum_delete_circuit(&defer_circ);
+}
+
+/* Discard the queued gates of a register which is about to be
+   deleted. Deferred mode stays active, as the register is often
+   replaced by a new one. */
+
+void
+quantum_defer_drop(quantum_reg *reg)
+{
+  if(quantum_defer_active(reg))
+    defer_circ.num = 0;
+}
+
+/* Check whether gates applied to REG are currently deferred */
+
+int
+quantum_defer_active(quantum_reg *reg)
+{
+  return defer_reg && reg == defer_reg && !defer_flushing;
+}
+
+/* Queue an instruction. Returns 1 if the gate has been queued and must
+   not be executed. */
+
+int
+quantum_defer_put(quantum_reg *reg, quantum_objcode_insn *insn)
+{
+  if(!quantum_defer_active(reg))
+    return 0;
+
+  quantum_circuit_add(insn, &defer_circ);
+
+  return 1;
+}
+
+/* Execute the queued gates of REG. REG may also be a copy of the
+   deferred register, as passed by value to quantum_measure, in which
+   case it is updated afterwards. The queue is not optimized if
+   decoherence is simulated, as the noise depends on the number of
+   gates. */
+
+void
+quantum_defer_flush(quantum_reg *reg)
+{
+  if(!defer_reg || defer_flushing)
+    return;
+
+  if(reg != defer_reg && reg->state != defer_reg->state)
+    return;
+
+  if(defer_circ.num)
+    {
+      defer_flushing = 1;
+
+      if(!quantum_status)
+	quantum_circuit_optimize(&defer_circ);
+
+      quantum_circuit_run(&defer_circ, defer_reg);
+      defer_circ.num = 0;
+
+      defer_flushing = 0;
+    }
+
+  if(reg != defer_reg)
+    *reg = *defer_reg;
+}
+
+/* Bring the state vector of REG up to date before it is used in any
+   other way than by a gate: execute its queued gates and, if it is
+   simulated with a stabilizer tableau, represented by a decision
+   diagram or kept as a product, build its amplitudes. If it has a
+   qubit map, move its qubits to their own bits. */
+
+void
+quantum_flush(quantum_reg *reg)
+{
+  quantum_defer_flush(reg);
+  quantum_stabilizer_stop(reg);
+  quantum_dd_stop(reg);
+  quantum_product_stop(reg);
+  quantum_remap_stop(reg);
+}
+
+/* Return non-zero if quantum_flush would change REG, i.e. if its gates
+   do not act on the state vector directly */
+
+int
+quantum_flush_pending(quantum_reg *reg)
+{
+  return quantum_defer_active(reg) || quantum_stabilizer_active(reg)
+    || quantum_dd_active(reg) || quantum_product_active(reg)
+    || quantum_remap_active(reg);
+}
@@ -0,0 +1,40 @@
+/* defer.h: Declarations for defer.c
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#ifndef __DEFER_H
+
+#define __DEFER_H
+
+#include "objcode.h"
+#include "qureg.h"
+
+extern void quantum_defer_start(quantum_reg *reg);
+extern void quantum_defer_stop(quantum_reg *reg);
+extern void quantum_defer_drop(quantum_reg *reg);
+extern int quantum_defer_active(quantum_reg *reg);
+extern int quantum_defer_put(quantum_reg *reg, quantum_objcode_insn *insn);
+extern void quantum_defer_flush(quantum_reg *reg);
+extern void quantum_flush(quantum_reg *reg);
+extern int quantum_flush_pending(quantum_reg *reg);
+
+#endif
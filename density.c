@@ -30,6 +30,7 @@
 #include "matrix.h"
 #include "complex.h"
 #include "error.h"
+#include "defer.h"
 
 /* Build a new density operator from multiple state vectors */
 
@@ -41,6 +42,9 @@ quantum_new_density_op(int num, float *prob, quantum_reg *reg)
   int *phash;
   int hashw;
 
+  for(i=0; i<num; i++)
+    quantum_flush(&reg[i]);
+
   rho.num = num;
   
   rho.prob = calloc(num, sizeof(float));
@@ -0,0 +1,1151 @@
+/* dist.c: Quantum registers distributed over several processes
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <math.h>
+
+#include "dist.h"
+#include "config.h"
+#include "matrix.h"
+#include "complex.h"
+#include "qureg.h"
+#include "objcode.h"
+#include "circuit.h"
+#include "gates.h"
+#include "measure.h"
+#include "defs.h"
+#include "error.h"
+#include "alloc.h"
+
+/* A distributed register holds all 2^WIDTH amplitudes as a dense
+   array, split into equal slices by the highest bits of the amplitude
+   index. Each process holds one slice of 2^LOCALW amplitudes, the
+   remaining bits of the index are given by its rank. A qubit does not
+   need to stay at the bit it started from: MAP records which bit of
+   the index holds it. Gates on qubits at local bits, and diagonal
+   gates on any qubit, work on each slice without communication. Before
+   any other gate acts on a qubit at a global bit, that qubit is
+   swapped with the local qubit which has been idle the longest,
+   exchanging half of each slice with a partner process. It then stays
+   local until it is swapped out again. When a whole circuit is run by
+   quantum_dist_circuit_run, the qubit swapped out is instead the one
+   needed furthest in the future.
+
+   All processes must apply the same gates in the same order, as in
+   the usual SPMD style. The processes are connected by a transport,
+   which may for instance be built on MPI. quantum_dist_local provides
+   one for a single machine, based on Unix sockets. */
+
+/* The instructions following the current one, while a circuit is
+   run */
+
+static quantum_objcode_insn *dist_ahead = 0;
+static unsigned long dist_ahead_num = 0;
+
+/* Data of the local transport */
+
+struct quantum_dist_local_struct
+{
+  int *fd;      /* socket to each other process */
+  pid_t *pid;   /* child processes, only known to process 0 */
+};
+
+/* Write N bytes to the socket FD */
+
+static void
+quantum_dist_write(int fd, void *buf, size_t n)
+{
+  char *p = buf;
+  ssize_t i;
+
+  while(n > 0)
+    {
+      i = write(fd, p, n);
+
+      if(i <= 0)
+	quantum_error(QUANTUM_ECOMM);
+
+      p += i;
+      n -= i;
+    }
+}
+
+/* Read N bytes from the socket FD */
+
+static void
+quantum_dist_read(int fd, void *buf, size_t n)
+{
+  char *p = buf;
+  ssize_t i;
+
+  while(n > 0)
+    {
+      i = read(fd, p, n);
+
+      if(i <= 0)
+	quantum_error(QUANTUM_ECOMM);
+
+      p += i;
+      n -= i;
+    }
+}
+
+/* Swap N bytes with process PEER. The lower process sends first, so
+   that the two never wait for each other. */
+
+static void
+quantum_dist_local_exchange(int peer, void *send, void *recv, 
+			    unsigned long n, quantum_dist_transport *t)
+{
+  struct quantum_dist_local_struct *d = t->data;
+
+  if(t->rank < peer)
+    {
+      quantum_dist_write(d->fd[peer], send, n);
+      quantum_dist_read(d->fd[peer], recv, n);
+    }
+  else
+    {
+      quantum_dist_read(d->fd[peer], recv, n);
+      quantum_dist_write(d->fd[peer], send, n);
+    }
+}
+
+/* Sum up X over all processes. Process 0 adds the arrays in the order
+   of the ranks and sends back the result, so that all processes
+   obtain exactly the same numbers. */
+
+static void
+quantum_dist_local_sum(double *x, int n, quantum_dist_transport *t)
+{
+  struct quantum_dist_local_struct *d = t->data;
+  double *y;
+  int i, k;
+
+  if(t->rank)
+    {
+      quantum_dist_write(d->fd[0], x, n * sizeof(double));
+      quantum_dist_read(d->fd[0], x, n * sizeof(double));
+      return;
+    }
+
+  y = malloc(n * sizeof(double));
+
+  if(!y)
+    quantum_error(QUANTUM_ENOMEM);
+
+  for(k=1; k<t->nodes; k++)
+    {
+      quantum_dist_read(d->fd[k], y, n * sizeof(double));
+
+      for(i=0; i<n; i++)
+	x[i] += y[i];
+    }
+
+  for(k=1; k<t->nodes; k++)
+    quantum_dist_write(d->fd[k], x, n * sizeof(double));
+
+  free(y);
+}
+
+/* Close the local transport. All processes but process 0 exit here,
+   process 0 waits for them to finish. */
+
+static void
+quantum_dist_local_close(quantum_dist_transport *t)
+{
+  struct quantum_dist_local_struct *d = t->data;
+  int k;
+
+  for(k=0; k<t->nodes; k++)
+    {
+      if(k != t->rank)
+	close(d->fd[k]);
+    }
+
+  if(t->rank)
+    exit(0);
+
+  for(k=1; k<t->nodes; k++)
+    waitpid(d->pid[k], 0, 0);
+
+  free(d->fd);
+  free(d->pid);
+  free(d);
+  free(t);
+}
+
+/* Run the calling program in NODES processes on this machine, which
+   must be a power of two. The processes are connected to each other
+   by Unix sockets. Returns the transport of each process, which can
+   tell them apart by its rank. */
+
+quantum_dist_transport *
+quantum_dist_local(int nodes)
+{
+  quantum_dist_transport *t;
+  struct quantum_dist_local_struct *d;
+  int *fd;
+  int sv[2];
+  int i, j, rank = 0;
+  pid_t pid;
+
+  if((nodes < 1) || (nodes & (nodes - 1)))
+    quantum_error(QUANTUM_ENODES);
+
+  t = malloc(sizeof(quantum_dist_transport));
+  d = malloc(sizeof(struct quantum_dist_local_struct));
+  fd = malloc(nodes * nodes * sizeof(int));
+
+  if(!(t && d && fd))
+    quantum_error(QUANTUM_ENOMEM);
+
+  d->fd = malloc(nodes * sizeof(int));
+  d->pid = calloc(nodes, sizeof(pid_t));
+
+  if(!(d->fd && d->pid))
+    quantum_error(QUANTUM_ENOMEM);
+
+  for(i=0; i<nodes; i++)
+    {
+      for(j=i+1; j<nodes; j++)
+	{
+	  if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv))
+	    quantum_error(QUANTUM_ECOMM);
+
+	  fd[i*nodes+j] = sv[0];
+	  fd[j*nodes+i] = sv[1];
+	}
+    }
+
+  /* Buffered output would otherwise be written by every process */
+
+  fflush(0);
+
+  for(i=1; i<nodes; i++)
+    {
+      pid = fork();
+
+      if(pid < 0)
+	quantum_error(QUANTUM_ECOMM);
+
+      if(!pid)
+	{
+	  rank = i;
+	  break;
+	}
+
+      d->pid[i] = pid;
+    }
+
+  /* Keep only the sockets of this process */
+
+  for(i=0; i<nodes; i++)
+    {
+      for(j=0; j<nodes; j++)
+	{
+	  if(i == j)
+	    continue;
+
+	  if(i == rank)
+	    d->fd[j] = fd[i*nodes+j];
+	  else
+	    close(fd[i*nodes+j]);
+	}
+    }
+
+  free(fd);
+
+  t->rank = rank;
+  t->nodes = nodes;
+  t->exchange = &quantum_dist_local_exchange;
+  t->sum = &quantum_dist_local_sum;
+  t->close = &quantum_dist_local_close;
+  t->data = d;
+
+  return t;
+}
+
+/* Close the transport T */
+
+void
+quantum_dist_close(quantum_dist_transport *t)
+{
+  t->close(t);
+}
+
+/* Return log2 of the number of amplitudes exchanged at once */
+
+static int
+quantum_dist_chunkw(quantum_dist_reg *reg)
+{
+  if(reg->localw - 1 < QUANTUM_DIST_CHUNK)
+    return reg->localw - 1;
+
+  return QUANTUM_DIST_CHUNK;
+}
+
+/* Insert the bit V at position POS into K */
+
+static inline MAX_UNSIGNED
+quantum_dist_insert(MAX_UNSIGNED k, int pos, int v)
+{
+  return ((k >> pos) << (pos + 1)) | ((MAX_UNSIGNED) v << pos)
+    | (k & (((MAX_UNSIGNED) 1 << pos) - 1));
+}
+
+/* Translate a mask of qubits into a mask of index bits */
+
+static MAX_UNSIGNED
+quantum_dist_mask(MAX_UNSIGNED qubits, quantum_dist_reg *reg)
+{
+  MAX_UNSIGNED mask = 0;
+  int q;
+
+  for(q=0; q<reg->width; q++)
+    {
+      if(qubits & ((MAX_UNSIGNED) 1 << q))
+	mask |= (MAX_UNSIGNED) 1 << reg->map[q];
+    }
+
+  return mask;
+}
+
+/* Translate an amplitude index into the basis state it stands for */
+
+static MAX_UNSIGNED
+quantum_dist_state(MAX_UNSIGNED a, quantum_dist_reg *reg)
+{
+  MAX_UNSIGNED state = 0;
+  int q;
+
+  for(q=0; q<reg->width; q++)
+    {
+      if(a & ((MAX_UNSIGNED) 1 << reg->map[q]))
+	state |= (MAX_UNSIGNED) 1 << q;
+    }
+
+  return state;
+}
+
+/* Create a distributed register of WIDTH qubits in the basis state
+   INITVAL. Each process of the transport T holds a slice of the
+   register. */
+
+quantum_dist_reg
+quantum_dist_new(MAX_UNSIGNED initval, int width, quantum_dist_transport *t)
+{
+  quantum_dist_reg reg;
+  MAX_UNSIGNED n;
+  size_t m;
+  int i, nodew = 0;
+
+  while((1 << nodew) < t->nodes)
+    nodew++;
+
+  /* Each slice needs at least one local qubit to swap with */
+
+  if(width <= nodew)
+    quantum_error(QUANTUM_ENODES);
+
+  reg.width = width;
+  reg.localw = width - nodew;
+  reg.clock = 0;
+  reg.swaps = 0;
+  reg.t = t;
+
+  reg.map = malloc(width * sizeof(int));
+  reg.used = calloc(width, sizeof(long));
+
+  if(!(reg.map && reg.used))
+    quantum_error(QUANTUM_ENOMEM);
+
+  for(i=0; i<width; i++)
+    reg.map[i] = i;
+
+  n = (MAX_UNSIGNED) 1 << reg.localw;
+  m = sizeof(COMPLEX_FLOAT) << quantum_dist_chunkw(&reg);
+
+  reg.amplitude = quantum_calloc(n, sizeof(COMPLEX_FLOAT));
+  reg.buf[0] = quantum_alloc(m);
+  reg.buf[1] = quantum_alloc(m);
+
+  if(!(reg.amplitude && reg.buf[0] && reg.buf[1]))
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman(n * sizeof(COMPLEX_FLOAT) + 2 * m);
+
+  if((initval >> reg.localw) == (MAX_UNSIGNED) t->rank)
+    reg.amplitude[initval & (n - 1)] = 1;
+
+  return reg;
+}
+
+/* Delete the slice of a distributed register held by this process */
+
+void
+quantum_dist_delete(quantum_dist_reg *reg)
+{
+  quantum_free(reg->amplitude);
+  quantum_free(reg->buf[0]);
+  quantum_free(reg->buf[1]);
+
+  quantum_memman(-(sizeof(COMPLEX_FLOAT) << reg->localw) 
+		 - 2 * (sizeof(COMPLEX_FLOAT) << quantum_dist_chunkw(reg)));
+
+  free(reg->map);
+  free(reg->used);
+
+  reg->amplitude = 0;
+  reg->buf[0] = 0;
+  reg->buf[1] = 0;
+  reg->map = 0;
+  reg->used = 0;
+}
+
+/* Swap the qubits at the global bit G and the local bit L. Each
+   process keeps the half of its slice where bit L equals its own bit
+   G, and swaps the other half with the process differing only in bit
+   G. */
+
+static void
+quantum_dist_swap(int g, int l, quantum_dist_reg *reg)
+{
+  MAX_UNSIGNED c, k, half, n;
+  int b, q, peer;
+
+  b = (reg->t->rank >> (g - reg->localw)) & 1;
+  peer = reg->t->rank ^ (1 << (g - reg->localw));
+
+  half = (MAX_UNSIGNED) 1 << (reg->localw - 1);
+  n = (MAX_UNSIGNED) 1 << quantum_dist_chunkw(reg);
+
+  for(c=0; c<half; c+=n)
+    {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+      for(k=0; k<n; k++)
+	reg->buf[0][k] = reg->amplitude[quantum_dist_insert(c + k, l, !b)];
+
+      reg->t->exchange(peer, reg->buf[0], reg->buf[1], 
+		       n * sizeof(COMPLEX_FLOAT), reg->t);
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+      for(k=0; k<n; k++)
+	reg->amplitude[quantum_dist_insert(c + k, l, !b)] = reg->buf[1][k];
+    }
+
+  for(q=0; q<reg->width; q++)
+    {
+      if(reg->map[q] == g)
+	reg->map[q] = l;
+      else if(reg->map[q] == l)
+	reg->map[q] = g;
+    }
+
+  reg->swaps++;
+}
+
+/* Mark the qubits in QUBITS as used by the current gate */
+
+static void
+quantum_dist_use(MAX_UNSIGNED qubits, quantum_dist_reg *reg)
+{
+  int q;
+
+  reg->clock++;
+
+  for(q=0; q<reg->width; q++)
+    {
+      if(qubits & ((MAX_UNSIGNED) 1 << q))
+	reg->used[q] = reg->clock;
+    }
+}
+
+/* Return the number of upcoming instructions before qubit Q has to be
+   at a local bit, i.e. becomes the target of a non-diagonal gate */
+
+static unsigned long
+quantum_dist_next_use(int q)
+{
+  unsigned long i;
+  int k[3];
+  int n;
+
+  for(i=0; (i<dist_ahead_num) && (i<QUANTUM_DIST_LOOKAHEAD); i++)
+    {
+      n = quantum_circuit_qubits(&dist_ahead[i], k);
+
+      if((n > 0) && !quantum_circuit_diagonal(dist_ahead[i].op) 
+	 && (k[n-1] == q))
+	break;
+    }
+
+  return i;
+}
+
+/* Bring qubit Q to a local bit and return that bit. The local qubit
+   to swap out is the one needed furthest ahead if the upcoming
+   instructions are known, and the one idle the longest otherwise. */
+
+static int
+quantum_dist_localize(int q, quantum_dist_reg *reg)
+{
+  unsigned long next, best = 0;
+  int i, victim = -1;
+
+  if(reg->map[q] < reg->localw)
+    return reg->map[q];
+
+  for(i=0; i<reg->width; i++)
+    {
+      if(reg->map[i] >= reg->localw)
+	continue;
+
+      next = dist_ahead ? quantum_dist_next_use(i) : 0;
+
+      if((victim < 0) || (next > best) 
+	 || ((next == best) && (reg->used[i] < reg->used[victim])))
+	{
+	  victim = i;
+	  best = next;
+	}
+    }
+
+  quantum_dist_swap(reg->map[q], reg->map[victim], reg);
+
+  return reg->map[q];
+}
+
+/* Multiply all amplitudes where the index bits in MASK are set with
+   Z1, all others with Z0 */
+
+static void
+quantum_dist_scale(MAX_UNSIGNED mask, COMPLEX_FLOAT z0, COMPLEX_FLOAT z1, 
+		   quantum_dist_reg *reg)
+{
+  MAX_UNSIGNED i, base, n;
+
+  base = (MAX_UNSIGNED) reg->t->rank << reg->localw;
+  n = (MAX_UNSIGNED) 1 << reg->localw;
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for(i=0; i<n; i++)
+    {
+      if(((base | i) & mask) == mask)
+	reg->amplitude[i] *= z1;
+      else
+	reg->amplitude[i] *= z0;
+    }
+}
+
+/* Apply the 2x2 matrix M to TARGET in all basis states where the
+   qubits in CTRL are set */
+
+static void
+quantum_dist_apply(MAX_UNSIGNED ctrl, int target, quantum_matrix m, 
+		   quantum_dist_reg *reg)
+{
+  MAX_UNSIGNED i, j, k, base, mask, half, bit;
+  COMPLEX_FLOAT a, b;
+  int pos;
+
+  if((m.cols != 2) || (m.rows != 2))
+    quantum_error(QUANTUM_EMSIZE);
+
+  quantum_dist_use(ctrl | ((MAX_UNSIGNED) 1 << target), reg);
+
+  pos = quantum_dist_localize(target, reg);
+  mask = quantum_dist_mask(ctrl, reg);
+
+  base = (MAX_UNSIGNED) reg->t->rank << reg->localw;
+  half = (MAX_UNSIGNED) 1 << (reg->localw - 1);
+  bit = (MAX_UNSIGNED) 1 << pos;
+
+#ifdef _OPENMP
+#pragma omp parallel for private (i, j, a, b)
+#endif
+  for(k=0; k<half; k++)
+    {
+      i = quantum_dist_insert(k, pos, 0);
+
+      if(((base | i) & mask) != mask)
+	continue;
+
+      j = i | bit;
+      a = reg->amplitude[i];
+      b = reg->amplitude[j];
+      reg->amplitude[i] = m.t[0] * a + m.t[1] * b;
+      reg->amplitude[j] = m.t[2] * a + m.t[3] * b;
+    }
+
+  quantum_gate_counter(1);
+}
+
+/* Multiply all amplitudes where the qubits in QUBITS are set with Z1,
+   all others with Z0 */
+
+static void
+quantum_dist_diag(MAX_UNSIGNED qubits, COMPLEX_FLOAT z0, COMPLEX_FLOAT z1, 
+		  quantum_dist_reg *reg)
+{
+  quantum_dist_use(qubits, reg);
+
+  quantum_dist_scale(quantum_dist_mask(qubits, reg), z0, z1, reg);
+
+  quantum_gate_counter(1);
+}
+
+/* Apply the 2x2 matrix M to the target bit. M should be unitary. */
+
+void
+quantum_dist_gate1(int target, quantum_matrix m, quantum_dist_reg *reg)
+{
+  quantum_dist_apply(0, target, m, reg);
+}
+
+/* Apply the 2x2 matrix M to the target qubit in all basis states
+   where the qubits in CTRL are set */
+
+void
+quantum_dist_gate1_controlled(MAX_UNSIGNED ctrl, int target, 
+			      quantum_matrix m, quantum_dist_reg *reg)
+{
+  quantum_dist_apply(ctrl, target, m, reg);
+}
+
+/* Apply a hadamard gate */
+
+void
+quantum_dist_hadamard(int target, quantum_dist_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = sqrt(1.0/2);  m.t[1] = sqrt(1.0/2);
+  m.t[2] = sqrt(1.0/2);  m.t[3] = -sqrt(1.0/2);
+
+  quantum_dist_apply(0, target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a NOT gate to TARGET where all qubits in CTRL are set */
+
+void
+quantum_dist_toffoli_controlled(MAX_UNSIGNED ctrl, int target, 
+				quantum_dist_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = 0;  m.t[1] = 1;
+  m.t[2] = 1;  m.t[3] = 0;
+
+  quantum_dist_apply(ctrl, target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a controlled-controlled-not gate */
+
+void
+quantum_dist_toffoli(int control1, int control2, int target, 
+		     quantum_dist_reg *reg)
+{
+  quantum_dist_toffoli_controlled(((MAX_UNSIGNED) 1 << control1) 
+				  | ((MAX_UNSIGNED) 1 << control2), target, 
+				  reg);
+}
+
+/* Apply a controlled-not gate */
+
+void
+quantum_dist_cnot(int control, int target, quantum_dist_reg *reg)
+{
+  quantum_dist_toffoli(control, control, target, reg);
+}
+
+/* Apply a pauli x spin operator */
+
+void
+quantum_dist_sigma_x(int target, quantum_dist_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = 0;  m.t[1] = 1;
+  m.t[2] = 1;  m.t[3] = 0;
+
+  quantum_dist_apply(0, target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a pauli y spin operator */
+
+void
+quantum_dist_sigma_y(int target, quantum_dist_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = 0;          m.t[1] = -IMAGINARY;
+  m.t[2] = IMAGINARY;  m.t[3] = 0;
+
+  quantum_dist_apply(0, target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a rotation about the x-axis by the angle GAMMA */
+
+void
+quantum_dist_r_x(int target, float gamma, quantum_dist_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = cos(gamma / 2);              m.t[1] = -IMAGINARY * sin(gamma / 2);
+  m.t[2] = -IMAGINARY * sin(gamma / 2); m.t[3] = cos(gamma / 2);
+
+  quantum_dist_apply(0, target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a rotation about the y-axis by the angle GAMMA */
+
+void
+quantum_dist_r_y(int target, float gamma, quantum_dist_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = cos(gamma / 2);  m.t[1] = -sin(gamma / 2);
+  m.t[2] = sin(gamma / 2);  m.t[3] = cos(gamma / 2);
+
+  quantum_dist_apply(0, target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a pauli z spin operator */
+
+void
+quantum_dist_sigma_z(int target, quantum_dist_reg *reg)
+{
+  quantum_dist_diag((MAX_UNSIGNED) 1 << target, 1, -1, reg);
+}
+
+/* Apply a rotation about the z-axis by the angle GAMMA */
+
+void
+quantum_dist_r_z(int target, float gamma, quantum_dist_reg *reg)
+{
+  COMPLEX_FLOAT z = quantum_cexp(gamma/2);
+
+  quantum_dist_diag((MAX_UNSIGNED) 1 << target, 1 / z, z, reg);
+}
+
+/* Scale the phase of the qubit */
+
+void
+quantum_dist_phase_scale(int target, float gamma, quantum_dist_reg *reg)
+{
+  COMPLEX_FLOAT z = quantum_cexp(gamma);
+
+  quantum_dist_diag(0, z, z, reg);
+}
+
+/* Phase shift a qubit by GAMMA */
+
+void
+quantum_dist_phase_kick(int target, float gamma, quantum_dist_reg *reg)
+{
+  quantum_dist_diag((MAX_UNSIGNED) 1 << target, 1, quantum_cexp(gamma), 
+		    reg);
+}
+
+/* Apply a conditional phase shift by PI / 2^(CONTROL - TARGET) */
+
+void
+quantum_dist_cond_phase(int control, int target, quantum_dist_reg *reg)
+{
+  quantum_dist_diag(((MAX_UNSIGNED) 1 << control) 
+		    | ((MAX_UNSIGNED) 1 << target), 1, 
+		    quantum_cexp(pi / ((MAX_UNSIGNED) 1 << (control - target))),
+		    reg);
+}
+
+/* Apply a conditional phase shift by GAMMA */
+
+void
+quantum_dist_cond_phase_kick(int control, int target, float gamma, 
+			     quantum_dist_reg *reg)
+{
+  quantum_dist_diag(((MAX_UNSIGNED) 1 << control) 
+		    | ((MAX_UNSIGNED) 1 << target), 1, quantum_cexp(gamma), 
+		    reg);
+}
+
+/* Measure the contents of a distributed register without changing it.
+   All processes obtain the same result. Returns -1 if no basis state
+   could be selected. */
+
+MAX_UNSIGNED
+quantum_dist_measure(quantum_dist_reg *reg)
+{
+  quantum_dist_transport *t = reg->t;
+  MAX_UNSIGNED i, n, result = (MAX_UNSIGNED) -1;
+  double *x, r, sum = 0;
+  int k;
+
+  n = (MAX_UNSIGNED) 1 << reg->localw;
+
+  x = calloc(t->nodes + 1, sizeof(double));
+
+  if(!x)
+    quantum_error(QUANTUM_ENOMEM);
+
+  /* Collect the probability held by each process, along with a random
+     number drawn by process 0 */
+
+  for(i=0; i<n; i++)
+    sum += quantum_prob_inline(reg->amplitude[i]);
+
+  x[t->rank] = sum;
+
+  if(!t->rank)
+    x[t->nodes] = quantum_frand();
+
+  t->sum(x, t->nodes + 1, t);
+
+  r = x[t->nodes];
+
+  for(k=0; k<t->rank; k++)
+    r -= x[k];
+
+  /* Only the process holding the selected basis state finds it */
+
+  if((r > 0) && (r <= sum))
+    {
+      for(i=0; i<n; i++)
+	{
+	  r -= quantum_prob_inline(reg->amplitude[i]);
+
+	  if(r <= 0)
+	    {
+	      result = quantum_dist_state(((MAX_UNSIGNED) t->rank 
+					   << reg->localw) | i, reg);
+	      break;
+	    }
+	}
+    }
+
+  /* Tell all processes about it, 32 bits at a time to keep the
+     doubles exact */
+
+  memset(x, 0, 3 * sizeof(double));
+
+  if(result != (MAX_UNSIGNED) -1)
+    {
+      x[0] = 1;
+      x[1] = (double) (result >> 32);
+      x[2] = (double) (result & 0xFFFFFFFF);
+    }
+
+  t->sum(x, 3, t);
+
+  if(x[0])
+    result = ((MAX_UNSIGNED) x[1] << 32) | (MAX_UNSIGNED) x[2];
+
+  free(x);
+
+  return result;
+}
+
+/* Measure a single qubit and collapse the register accordingly */
+
+int
+quantum_dist_bmeasure(int pos, quantum_dist_reg *reg)
+{
+  quantum_dist_transport *t = reg->t;
+  MAX_UNSIGNED i, n, base, bit;
+  double x[2], pa;
+  int result;
+
+  n = (MAX_UNSIGNED) 1 << reg->localw;
+  base = (MAX_UNSIGNED) t->rank << reg->localw;
+  bit = (MAX_UNSIGNED) 1 << reg->map[pos];
+
+  x[0] = 0;
+  x[1] = 0;
+
+  for(i=0; i<n; i++)
+    {
+      if(!((base | i) & bit))
+	x[0] += quantum_prob_inline(reg->amplitude[i]);
+    }
+
+  if(!t->rank)
+    x[1] = quantum_frand();
+
+  t->sum(x, 2, t);
+
+  pa = x[0];
+  result = x[1] > pa;
+
+  /* Remove all basis states with the other value of the qubit and
+     normalize the rest */
+
+  if(result)
+    quantum_dist_scale(bit, 0, 1 / sqrt(1 - pa), reg);
+  else
+    quantum_dist_scale(bit, 1 / sqrt(pa), 0, reg);
+
+  return result;
+}
+
+/* Collect the non-zero amplitudes of a distributed register in a
+   regular quantum register, which all processes obtain. As the whole
+   register is summed up in one go, this is only meant for small
+   registers, e.g. to check results. */
+
+quantum_reg
+quantum_dist_to_qureg(quantum_dist_reg *reg)
+{
+  quantum_reg out;
+  MAX_UNSIGNED i, n, base;
+  double *x;
+  int size = 0;
+
+  if(reg->width + 2 > 30)
+    quantum_error(QUANTUM_EWIDTH);
+
+  n = (MAX_UNSIGNED) 1 << reg->localw;
+  base = (MAX_UNSIGNED) reg->t->rank << reg->localw;
+
+  x = calloc((size_t) 2 << reg->width, sizeof(double));
+
+  if(!x)
+    quantum_error(QUANTUM_ENOMEM);
+
+  for(i=0; i<n; i++)
+    {
+      x[2*(base | i)] = quantum_real(reg->amplitude[i]);
+      x[2*(base | i)+1] = quantum_imag(reg->amplitude[i]);
+    }
+
+  reg->t->sum(x, 2 << reg->width, reg->t);
+
+  for(i=0; i<((MAX_UNSIGNED) 1 << reg->width); i++)
+    {
+      if(x[2*i] || x[2*i+1])
+	size++;
+    }
+
+  out = quantum_new_qureg_sparse(size, reg->width);
+
+  /* Allocate the hash table */
+
+  out.hashw = reg->width + 2;
+  out.hash = quantum_calloc(1 << out.hashw, sizeof(int));
+
+  if(!out.hash)
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman((1 << out.hashw) * sizeof(int));
+
+  size = 0;
+
+  for(i=0; i<((MAX_UNSIGNED) 1 << reg->width); i++)
+    {
+      if(x[2*i] || x[2*i+1])
+	{
+	  out.state[size] = quantum_dist_state(i, reg);
+	  out.amplitude[size] = x[2*i] + IMAGINARY * x[2*i+1];
+	  size++;
+	}
+    }
+
+  free(x);
+
+  return out;
+}
+
+/* Execute a single object code instruction. SWAPLEADS, SWAPBITS and
+   BITREVERSE only change the qubit map. Instructions removing or adding qubits are not
+   supported. */
+
+static void
+quantum_dist_exec(quantum_objcode_insn *insn, quantum_dist_reg *reg)
+{
+  MAX_UNSIGNED a;
+  int i, *arg = insn->arg;
+
+  switch(insn->op)
+    {
+    case INIT:
+      a = quantum_dist_mask(insn->mu, reg);
+
+      memset(reg->amplitude, 0, sizeof(COMPLEX_FLOAT) << reg->localw);
+
+      if((a >> reg->localw) == (MAX_UNSIGNED) reg->t->rank)
+	reg->amplitude[a & (((MAX_UNSIGNED) 1 << reg->localw) - 1)] = 1;
+      break;
+    case CNOT:
+      quantum_dist_cnot(arg[0], arg[1], reg);
+      break;
+    case TOFFOLI:
+      quantum_dist_toffoli(arg[0], arg[1], arg[2], reg);
+      break;
+    case MCTOFFOLI:
+      quantum_dist_toffoli_controlled(insn->mu, arg[0], reg);
+      break;
+    case SIGMA_X:
+      quantum_dist_sigma_x(arg[0], reg);
+      break;
+    case SIGMA_Y:
+      quantum_dist_sigma_y(arg[0], reg);
+      break;
+    case SIGMA_Z:
+      quantum_dist_sigma_z(arg[0], reg);
+      break;
+    case HADAMARD:
+      quantum_dist_hadamard(arg[0], reg);
+      break;
+    case ROT_X:
+      quantum_dist_r_x(arg[0], insn->d, reg);
+      break;
+    case ROT_Y:
+      quantum_dist_r_y(arg[0], insn->d, reg);
+      break;
+    case ROT_Z:
+      quantum_dist_r_z(arg[0], insn->d, reg);
+      break;
+    case PHASE_KICK:
+      quantum_dist_phase_kick(arg[0], insn->d, reg);
+      break;
+    case PHASE_SCALE:
+      quantum_dist_phase_scale(arg[0], insn->d, reg);
+      break;
+    case COND_PHASE:
+      quantum_dist_cond_phase(arg[0], arg[1], reg);
+      break;
+    case CPHASE_KICK:
+      quantum_dist_cond_phase_kick(arg[0], arg[1], insn->d, reg);
+      break;
+    case SWAPLEADS:
+      for(i=0; i<arg[0]; i++)
+	{
+	  a = reg->map[i];
+	  reg->map[i] = reg->map[arg[0] + i];
+	  reg->map[arg[0] + i] = a;
+	}
+      break;
+    case SWAPBITS:
+      a = reg->map[arg[0]];
+      reg->map[arg[0]] = reg->map[arg[1]];
+      reg->map[arg[1]] = a;
+      break;
+    case BITREVERSE:
+      for(i=0; i<arg[0]/2; i++)
+	{
+	  a = reg->map[i];
+	  reg->map[i] = reg->map[arg[0] - i - 1];
+	  reg->map[arg[0] - i - 1] = a;
+	}
+      break;
+    case MEASURE:
+      quantum_dist_measure(reg);
+      break;
+    case BMEASURE_P:
+      quantum_dist_bmeasure(arg[0], reg);
+      break;
+    case NOP:
+      break;
+    default:
+      quantum_error(QUANTUM_EOPCODE);
+    }
+}
+
+/* Run the circuit CIRC on REG. Knowing the upcoming gates, the qubits
+   swapped out of the slices are those needed furthest ahead. */
+
+void
+quantum_dist_circuit_run(quantum_circuit *circ, quantum_dist_reg *reg)
+{
+  unsigned long i;
+
+  for(i=0; i<circ->num; i++)
+    {
+      dist_ahead = &circ->insn[i];
+      dist_ahead_num = circ->num - i;
+
+      quantum_dist_exec(&circ->insn[i], reg);
+    }
+
+  dist_ahead = 0;
+  dist_ahead_num = 0;
+}
+
+/* Run the contents of an object code file on REG, see
+   quantum_dist_circuit_run. Returns 0 on success. */
+
+int
+quantum_dist_run(char *file, quantum_dist_reg *reg)
+{
+  quantum_circuit circ;
+
+  circ = quantum_new_circuit();
+
+  if(quantum_circuit_load(file, &circ))
+    {
+      quantum_delete_circuit(&circ);
+      return -1;
+    }
+
+  quantum_dist_circuit_run(&circ, reg);
+
+  quantum_delete_circuit(&circ);
+
+  return 0;
+}
@@ -0,0 +1,121 @@
+/* dist.h: Declarations for dist.c
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#ifndef __DIST_H
+
+#define __DIST_H
+
+#include "config.h"
+#include "matrix.h"
+#include "qureg.h"
+#include "circuit.h"
+
+/* Log2 of the number of amplitudes sent at once when exchanging
+   slices */
+
+#define QUANTUM_DIST_CHUNK 20
+
+/* Number of instructions quantum_dist_circuit_run looks ahead when
+   choosing a qubit to swap out */
+
+#define QUANTUM_DIST_LOOKAHEAD 256
+
+/* A transport connects the processes sharing a distributed register.
+   EXCHANGE sends N bytes to process PEER while receiving as many from
+   it, SUM adds up an array of N doubles over all processes. */
+
+struct quantum_dist_transport_struct
+{
+  int rank;     /* number of this process */
+  int nodes;    /* number of processes, a power of two */
+  void (*exchange)(int peer, void *send, void *recv, unsigned long n,
+		   struct quantum_dist_transport_struct *t);
+  void (*sum)(double *x, int n, struct quantum_dist_transport_struct *t);
+  void (*close)(struct quantum_dist_transport_struct *t);
+  void *data;   /* private data of the transport */
+};
+
+typedef struct quantum_dist_transport_struct quantum_dist_transport;
+
+/* A quantum register whose amplitudes are distributed over several
+   processes */
+
+struct quantum_dist_reg_struct
+{
+  int width;    /* number of qubits in the qureg */
+  int localw;   /* number of qubits within each process */
+  int *map;     /* position of each qubit in the amplitude index */
+  long *used;   /* time of the last gate on each qubit */
+  long clock;   /* number of gates so far */
+  long swaps;   /* number of slice exchanges so far */
+  COMPLEX_FLOAT *amplitude;  /* the 2^LOCALW amplitudes of this process */
+  COMPLEX_FLOAT *buf[2];     /* send and receive buffers */
+  quantum_dist_transport *t;
+};
+
+typedef struct quantum_dist_reg_struct quantum_dist_reg;
+
+extern quantum_dist_transport *quantum_dist_local(int nodes);
+extern void quantum_dist_close(quantum_dist_transport *t);
+
+extern quantum_dist_reg quantum_dist_new(MAX_UNSIGNED initval, int width,
+					 quantum_dist_transport *t);
+extern void quantum_dist_delete(quantum_dist_reg *reg);
+
+extern void quantum_dist_gate1(int target, quantum_matrix m,
+			       quantum_dist_reg *reg);
+extern void quantum_dist_gate1_controlled(MAX_UNSIGNED ctrl, int target, 
+					  quantum_matrix m, 
+					  quantum_dist_reg *reg);
+extern void quantum_dist_hadamard(int target, quantum_dist_reg *reg);
+extern void quantum_dist_sigma_x(int target, quantum_dist_reg *reg);
+extern void quantum_dist_sigma_y(int target, quantum_dist_reg *reg);
+extern void quantum_dist_r_x(int target, float gamma, quantum_dist_reg *reg);
+extern void quantum_dist_r_y(int target, float gamma, quantum_dist_reg *reg);
+extern void quantum_dist_cnot(int control, int target, quantum_dist_reg *reg);
+extern void quantum_dist_toffoli(int control1, int control2, int target,
+				 quantum_dist_reg *reg);
+extern void quantum_dist_toffoli_controlled(MAX_UNSIGNED ctrl, int target, 
+					    quantum_dist_reg *reg);
+
+extern void quantum_dist_sigma_z(int target, quantum_dist_reg *reg);
+extern void quantum_dist_r_z(int target, float gamma, quantum_dist_reg *reg);
+extern void quantum_dist_phase_scale(int target, float gamma,
+				     quantum_dist_reg *reg);
+extern void quantum_dist_phase_kick(int target, float gamma,
+				    quantum_dist_reg *reg);
+extern void quantum_dist_cond_phase(int control, int target,
+				    quantum_dist_reg *reg);
+extern void quantum_dist_cond_phase_kick(int control, int target, float gamma,
+					 quantum_dist_reg *reg);
+
+extern MAX_UNSIGNED quantum_dist_measure(quantum_dist_reg *reg);
+extern int quantum_dist_bmeasure(int pos, quantum_dist_reg *reg);
+
+extern quantum_reg quantum_dist_to_qureg(quantum_dist_reg *reg);
+
+extern void quantum_dist_circuit_run(quantum_circuit *circ, 
+				     quantum_dist_reg *reg);
+extern int quantum_dist_run(char *file, quantum_dist_reg *reg);
+
+#endif
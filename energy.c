@@ -30,6 +30,7 @@
 #include "qureg.h"
 #include "qtime.h"
 #include "complex.h"
+#include "defer.h"
 
 extern void dstevd_(char *jobz, int *n, double *d, double *e, double *z, 
 		    int *ldz, double *work, int *lwork, int *iwork, int *liwork,
@@ -305,6 +306,8 @@ quantum_groundstate(quantum_reg *reg, double epsilon,
 		    quantum_reg H(MAX_UNSIGNED, double), int solver,
 		    double stepsize)
 {
+  quantum_flush(reg);
+
   switch(solver)
     {
     case QUANTUM_SOLVER_LANCZOS:
@@ -58,6 +58,18 @@ quantum_strerr(int errno)
       return "matrix not Hermitian";
     case QUANTUM_ENOCONVERGE:
       return "method failed to converge";
+    case QUANTUM_EIO:
+      return "file input/output failed";
+    case QUANTUM_EWIDTH:
+      return "register too large for a state vector";
+    case QUANTUM_ENODES:
+      return "unsuitable number of processes";
+    case QUANTUM_ECOMM:
+      return "communication between processes failed";
+    case QUANTUM_EPERM:
+      return "invalid qubit permutation";
+    case QUANTUM_ERECORD:
+      return "operation cannot be recorded as object code";
     case QUANTUM_ENOLAPACK:
       return "LAPACK support not compiled in";
     case QUANTUM_ELAPACKARG:
@@ -35,6 +35,12 @@ enum {
   QUANTUM_EHERMITIAN   = 6, 
   QUANTUM_ENOCONVERGE  = 7,
   QUANTUM_ENOSOLVER    = 8,
+  QUANTUM_EIO          = 9,
+  QUANTUM_EWIDTH       = 10,
+  QUANTUM_ENODES       = 11,
+  QUANTUM_ECOMM        = 12,
+  QUANTUM_EPERM        = 13,
+  QUANTUM_ERECORD      = 14,
   QUANTUM_ENOLAPACK    = 32768, /* LAPACK errors start at 32768 */
   QUANTUM_ELAPACKARG   = 32769,
   QUANTUM_ELAPACKCONV  = 32770,
@@ -29,6 +29,7 @@
 #include "gates.h"
 #include "omuln.h"
 #include "qureg.h"
+#include "measure.h"
 
 void 
 quantum_exp_mod_n(int N, int x, int width_input, int width, quantum_reg *reg)
@@ -49,3 +50,60 @@ quantum_exp_mod_n(int N, int x, int width_input, int width, quantum_reg *reg)
 		mul_mod_n(N,f,3*width+1+i, width, reg);
 		}
 	}
+
+/* Perform the modular exponentiation of quantum_exp_mod_n, a QFT of
+   the WIDTH_INPUT input qubits and their measurement, using a single
+   control qubit at position 3 * WIDTH + 2 instead of the input
+   register. Starting with the most significant input qubit, the
+   control qubit is prepared, enables the multiplication and is
+   measured and reset (the semiclassical QFT of Griffiths and
+   Niu). The conditional phase shifts of the QFT become rotations
+   depending on the bits measured so far. Returns the measured value,
+   which is distributed like the input register after quantum_qft and
+   reversing the order of its bits. */
+
+MAX_UNSIGNED
+quantum_exp_mod_n_semiclassical(int N, int x, int width_input, int width, 
+				quantum_reg *reg)
+{
+  int i, j, f, ctl;
+  double phi;
+  MAX_UNSIGNED y = 0;
+
+  ctl = 3 * width + 2;
+
+  quantum_sigma_x(2*width+2, reg);
+
+  for(i=0; i<width_input; i++)
+    {
+      /* x^2^(width_input-i-1) */
+
+      f = x % N;
+
+      for(j=1; j<width_input-i; j++)
+	f = (f * f) % N;
+
+      quantum_hadamard(ctl, reg);
+
+      mul_mod_n(N, f, ctl, width, reg);
+
+      for(j=0, phi=0; j<i; j++)
+	{
+	  if(y & ((MAX_UNSIGNED) 1 << j))
+	    phi += ldexp(pi, j - i);
+	}
+
+      if(phi)
+	quantum_r_z(ctl, phi, reg);
+
+      quantum_hadamard(ctl, reg);
+
+      if(quantum_bmeasure_bitpreserve(ctl, reg))
+	{
+	  y |= (MAX_UNSIGNED) 1 << i;
+	  quantum_sigma_x(ctl, reg);
+	}
+    }
+
+  return y;
+}
@@ -29,5 +29,8 @@
 
 extern void quantum_exp_mod_n(int N, int x, int width_input, int width, 
 			      quantum_reg *reg);
+extern MAX_UNSIGNED quantum_exp_mod_n_semiclassical(int N, int x, 
+						int width_input, int width,
+						quantum_reg *reg);
 
 #endif
@@ -33,7 +33,10 @@
 #include "decoherence.h"
 #include "qec.h"
 #include "objcode.h"
+#include "defer.h"
+#include "checkpoint.h"
 #include "error.h"
+#include "alloc.h"
 
 /* Apply a controlled-not gate */
 
@@ -49,7 +52,7 @@ quantum_cnot(int control, int target, quantum_reg *reg)
     quantum_cnot_ft(control, target, reg);
   else
     {
-      if(quantum_objcode_put(CNOT, control, target))
+      if(quantum_objcode_putreg(reg, CNOT, control, target))
 	return;
 
 #ifdef _OPENMP
@@ -80,7 +83,7 @@ quantum_toffoli(int control1, int control2, int target, quantum_reg *reg)
     quantum_toffoli_ft(control1, control2, target, reg);
   else
     {
-      if(quantum_objcode_put(TOFFOLI, control1, control2, target))
+      if(quantum_objcode_putreg(reg, TOFFOLI, control1, control2, target))
 	return;
 
 #ifdef _OPENMP
@@ -103,6 +106,44 @@ quantum_toffoli(int control1, int control2, int target, quantum_reg *reg)
     }
 }
 
+/* Apply a NOT gate to TARGET if all qubits in the bit mask CTRL are
+   set. The controls are tested with a single comparison per basis
+   state, which the compiler can vectorize. */
+
+void
+quantum_toffoli_controlled(MAX_UNSIGNED ctrl, int target, quantum_reg *reg)
+{
+  int i;
+  MAX_UNSIGNED t = (MAX_UNSIGNED) 1 << target;
+
+  if(quantum_objcode_putreg(reg, MCTOFFOLI, target, ctrl))
+    return;
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif      
+  for(i=0; i<reg->size; i++)
+    reg->state[i] ^= t & -(MAX_UNSIGNED) ((reg->state[i] & ctrl) == ctrl);
+
+  quantum_decohere(reg);
+}
+
+/* Apply a toffoli gate with the CONTROLLING qubits given in the array
+   CONTROLS */
+
+void
+quantum_toffoli_array(int controlling, int *controls, int target, 
+		      quantum_reg *reg)
+{
+  int i;
+  MAX_UNSIGNED ctrl = 0;
+
+  for(i=0; i<controlling; i++)
+    ctrl |= (MAX_UNSIGNED) 1 << controls[i];
+
+  quantum_toffoli_controlled(ctrl, target, reg);
+}
+
 /* Apply an unbounded toffoli gate. This gate is not considered
 elementary and is not available on all physical realizations of a
 quantum computer. Be sure to pass the function the correct number of
@@ -112,45 +153,20 @@ void
 quantum_unbounded_toffoli(int controlling, quantum_reg *reg, ...)
 {
   va_list bits;
-  int target;
-  int *controls;
-  int i, j;
-
-  controls = malloc(controlling * sizeof(int));
-
-  if(!controls)
-    quantum_error(QUANTUM_ENOMEM);
-
-  quantum_memman(controlling * sizeof(int));
+  int i;
+  MAX_UNSIGNED ctrl = 0;
 
   va_start(bits, reg);
   
   for(i=0; i<controlling; i++)
-    controls[i] = va_arg(bits, int);
+    ctrl |= (MAX_UNSIGNED) 1 << va_arg(bits, int);
 
-  target = va_arg(bits, int);
+  i = va_arg(bits, int);
 
   va_end(bits);
 
-#ifdef _OPENMP
-#pragma omp parallel for private (j)
-#endif      
-  for(i=0; i<reg->size; i++)
-    {
-      for(j=0; (j < controlling) && 
-	    (reg->state[i] & (MAX_UNSIGNED) 1 << controls[j]); j++);
-      
-      if(j == controlling) /* all control bits are set */
-	reg->state[i] ^= ((MAX_UNSIGNED) 1 << target);
-    }
-
-  free(controls);
-  quantum_memman(-controlling * sizeof(int));
-
-  quantum_decohere(reg);
-
+  quantum_toffoli_controlled(ctrl, i, reg);
 }
-  
 
 /* Apply a sigma_x (or not) gate */
 
@@ -166,7 +182,7 @@ quantum_sigma_x(int target, quantum_reg *reg)
     quantum_sigma_x_ft(target, reg);
   else
     {
-      if(quantum_objcode_put(SIGMA_X, target))
+      if(quantum_objcode_putreg(reg, SIGMA_X, target))
 	return;
 
 #ifdef _OPENMP
@@ -189,7 +205,7 @@ quantum_sigma_y(int target, quantum_reg *reg)
 {
   int i;
 
-  if(quantum_objcode_put(SIGMA_Y, target))
+  if(quantum_objcode_putreg(reg, SIGMA_Y, target))
     return;
 
 #ifdef _OPENMP
@@ -218,7 +234,7 @@ quantum_sigma_z(int target, quantum_reg *reg)
 {
   int i;
 
-  if(quantum_objcode_put(SIGMA_Z, target))
+  if(quantum_objcode_putreg(reg, SIGMA_Z, target))
     return;
 
 #ifdef _OPENMP
@@ -235,7 +251,8 @@ quantum_sigma_z(int target, quantum_reg *reg)
 }
 
 /* Swap the first WIDTH bits of the quantum register. This is done
-   classically by renaming the bits, unless QEC is enabled. */
+   classically by renaming the bits, unless QEC is enabled. If the
+   register has a qubit map (see remap.c), only the map is changed. */
 
 void
 quantum_swaptheleads(int width, quantum_reg *reg)
@@ -261,7 +278,7 @@ quantum_swaptheleads(int width, quantum_reg *reg)
       for(i=0; i<reg->size; i++)
 	{
 
-	  if(quantum_objcode_put(SWAPLEADS, width))
+	  if(quantum_objcode_putreg(reg, SWAPLEADS, width))
 	    return;
 
 	  /* calculate left bit pattern */
@@ -285,6 +302,188 @@ quantum_swaptheleads(int width, quantum_reg *reg)
     }
 }
 
+/* Exchange the qubits A and B. Only the basis states are relabeled;
+   if the register has a qubit map, only the map is changed. */
+
+void
+quantum_swap_bits(int a, int b, quantum_reg *reg)
+{
+  int i;
+  int qec;
+  MAX_UNSIGNED t;
+
+  quantum_qec_get_status(&qec, NULL);
+
+  if(qec)
+    {
+      quantum_cnot(a, b, reg);
+      quantum_cnot(b, a, reg);
+      quantum_cnot(a, b, reg);
+      return;
+    }
+
+  if(quantum_objcode_putreg(reg, SWAPBITS, a, b))
+    return;
+
+#ifdef _OPENMP
+#pragma omp parallel for private (t)
+#endif
+  for(i=0; i<reg->size; i++)
+    {
+      t = ((reg->state[i] >> a) ^ (reg->state[i] >> b)) & 1;
+      reg->state[i] ^= (t << a) | (t << b);
+    }
+}
+
+/* Move bit I of all basis states to bit PERM[I], for the lowest WIDTH
+   bits. Each state is relabeled with one table lookup per byte. */
+
+static void
+quantum_permute_states(int width, int *perm, quantum_reg *reg)
+{
+  int i, j, k, n;
+  MAX_UNSIGNED (*table)[256];
+  MAX_UNSIGNED mask, s;
+
+  n = (width + 7) / 8;
+
+  table = quantum_alloc(n * sizeof(*table));
+
+  if(n && !table)
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman(n * sizeof(*table));
+
+  for(j=0; j<n; j++)
+    {
+      for(k=0; k<256; k++)
+	{
+	  table[j][k] = 0;
+
+	  for(i=0; (i<8) && (8*j+i < width); i++)
+	    {
+	      if(k & (1 << i))
+		table[j][k] |= (MAX_UNSIGNED) 1 << perm[8*j+i];
+	    }
+	}
+    }
+
+  mask = (width < sizeof(MAX_UNSIGNED) * 8) 
+    ? ((MAX_UNSIGNED) 1 << width) - 1 : ~(MAX_UNSIGNED) 0;
+
+#ifdef _OPENMP
+#pragma omp parallel for private (j, s)
+#endif
+  for(i=0; i<reg->size; i++)
+    {
+      s = reg->state[i] & ~mask;
+
+      for(j=0; j<n; j++)
+	s |= table[j][(reg->state[i] >> (8*j)) & 0xFF];
+
+      reg->state[i] = s;
+    }
+
+  quantum_free(table);
+  quantum_memman(-n * sizeof(*table));
+}
+
+/* Reverse the order of the lowest WIDTH qubits in a single pass over
+   the basis states, as needed after a QFT */
+
+void
+quantum_bit_reverse(int width, quantum_reg *reg)
+{
+  int i;
+  int qec;
+  int perm[sizeof(MAX_UNSIGNED) * 8];
+
+  quantum_qec_get_status(&qec, NULL);
+
+  if(qec)
+    {
+      for(i=0; i<width/2; i++)
+	quantum_swap_bits(i, width-i-1, reg);
+      return;
+    }
+
+  if(quantum_objcode_putreg(reg, BITREVERSE, width))
+    return;
+
+  for(i=0; i<width; i++)
+    perm[i] = width-i-1;
+
+  quantum_permute_states(width, perm, reg);
+}
+
+/* Move qubit I to position PERM[I], for all qubits of the register.
+   PERM has to be a permutation of 0 ... width-1. This is a single
+   pass over the basis states, unless object code is recorded or
+   quantum_flush is pending. In that case, at most width-1 calls of
+   quantum_swap_bits are made instead. */
+
+void
+quantum_permute_bits(int *perm, quantum_reg *reg)
+{
+  int i, p, q;
+  int qec;
+  int pos[sizeof(MAX_UNSIGNED) * 8], at[sizeof(MAX_UNSIGNED) * 8];
+  int inv[sizeof(MAX_UNSIGNED) * 8];
+
+  if(reg->width > sizeof(MAX_UNSIGNED) * 8)
+    {
+      quantum_error(QUANTUM_EPERM);
+      return;
+    }
+
+  for(i=0; i<reg->width; i++)
+    inv[i] = -1;
+
+  for(i=0; i<reg->width; i++)
+    {
+      if((perm[i] < 0) || (perm[i] >= reg->width) || (inv[perm[i]] >= 0))
+	{
+	  quantum_error(QUANTUM_EPERM);
+	  return;
+	}
+
+      inv[perm[i]] = i;
+    }
+
+  quantum_qec_get_status(&qec, NULL);
+
+  if(!qec && !quantum_objcode_status() && !quantum_flush_pending(reg))
+    {
+      quantum_permute_states(reg->width, perm, reg);
+      return;
+    }
+
+  /* POS is the current position of a qubit, AT the qubit at a
+     position */
+
+  for(i=0; i<reg->width; i++)
+    {
+      pos[i] = i;
+      at[i] = i;
+    }
+
+  for(i=0; i<reg->width; i++)
+    {
+      q = inv[i];
+      p = pos[q];
+
+      if(p != i)
+	{
+	  quantum_swap_bits(p, i, reg);
+
+	  at[p] = at[i];
+	  pos[at[i]] = p;
+	  at[i] = q;
+	  pos[q] = i;
+	}
+    }
+}
+
 /* Swap WIDTH bits starting at WIDTH and 2*WIDTH+2 controlled by
    CONTROL */
 
@@ -301,71 +500,145 @@ quantum_swaptheleads_omuln_controlled(int control, int width, quantum_reg *reg)
     }
 }
 
-/* Apply the 2x2 matrix M to the target bit. M should be unitary. */
+/* Basis states created by quantum_gate1 and quantum_gate2. They are
+   collected here while the register is traversed and merged into it
+   afterwards, so that the hash table is probed only once per state
+   and the register arrays are resized only once per gate. */
 
-void 
-quantum_gate1(int target, quantum_matrix m, quantum_reg *reg)
+static MAX_UNSIGNED *overflow_state = 0;
+static COMPLEX_FLOAT *overflow_amplitude = 0;
+static int overflow_size = 0;
+static int overflow_alloc = 0;
+
+/* Add a new basis state to the overflow buffer */
+
+static void
+quantum_overflow_add(MAX_UNSIGNED a, COMPLEX_FLOAT t)
 {
-  int i, j, k, iset;
-  int addsize=0, decsize=0;
-  COMPLEX_FLOAT t, tnot=0;
-  float limit;
-  char *done;
+  if(overflow_size == overflow_alloc)
+    {
+      overflow_alloc = overflow_alloc ? 2 * overflow_alloc : 1024;
 
-  if((m.cols != 2) || (m.rows != 2))
-    quantum_error(QUANTUM_EMSIZE);
+      overflow_state = quantum_realloc(overflow_state, 
+				       overflow_alloc * sizeof(MAX_UNSIGNED));
+      overflow_amplitude = quantum_realloc(overflow_amplitude, 
+				 overflow_alloc * sizeof(COMPLEX_FLOAT));
+
+      if(!(overflow_state && overflow_amplitude))
+	quantum_error(QUANTUM_ENOMEM);
+    }
+
+  overflow_state[overflow_size] = a;
+  overflow_amplitude[overflow_size] = t;
+  overflow_size++;
+}
+
+/* Remove basis states with a probability below LIMIT from the
+   register (if it has a hash table) and append the states from the
+   overflow buffer. */
+
+static void
+quantum_overflow_merge(float limit, quantum_reg *reg)
+{
+  int i, j, size;
+
+  size = reg->size;
 
   if(reg->hashw)
     {
-      quantum_reconstruct_hash(reg);
+      for(i=0, j=0; i<reg->size; i++)
+	{
+	  if(quantum_prob_inline(reg->amplitude[i]) < limit)
+	    j++;
+	  
+	  else if(j)
+	    {
+	      reg->state[i-j] = reg->state[i];
+	      reg->amplitude[i-j] = reg->amplitude[i];
+	    }
+	}
 
-      /* calculate the number of basis states to be added */
+      reg->size -= j;
 
-      for(i=0; i<reg->size; i++)
+      for(i=0, j=0; i<overflow_size; i++)
 	{
-	  /* determine whether XORed basis state already exists */
-
-	  if(quantum_get_state(reg->state[i] 
-			       ^ ((MAX_UNSIGNED) 1 << target), *reg) == -1)
-	    addsize++;
+	  if(quantum_prob_inline(overflow_amplitude[i]) < limit)
+	    j++;
+	  
+	  else if(j)
+	    {
+	      overflow_state[i-j] = overflow_state[i];
+	      overflow_amplitude[i-j] = overflow_amplitude[i];
+	    }
 	}
-      
-      /* allocate memory for the new basis states */
-  
-      reg->state = realloc(reg->state, 
-			       (reg->size + addsize) * sizeof(MAX_UNSIGNED));
-      reg->amplitude = realloc(reg->amplitude, 
-			       (reg->size + addsize) * sizeof(COMPLEX_FLOAT));
-      
-      if(reg->size && !(reg->state && reg->amplitude)) 
+
+      overflow_size -= j;
+    }
+
+  if(reg->size + overflow_size != size)
+    {
+      reg->state = quantum_realloc(reg->state, (reg->size + overflow_size)
+				   * sizeof(MAX_UNSIGNED));
+      reg->amplitude = quantum_realloc(reg->amplitude, 
+				       (reg->size + overflow_size)
+				       * sizeof(COMPLEX_FLOAT));
+
+      if(reg->size + overflow_size && !(reg->state && reg->amplitude))
 	quantum_error(QUANTUM_ENOMEM);
 
-      quantum_memman(addsize*(sizeof(COMPLEX_FLOAT) + sizeof(MAX_UNSIGNED)));
-      
-      for(i=0; i<addsize; i++)
-	{
-	  reg->state[i+reg->size] = 0;
-	  reg->amplitude[i+reg->size] = 0;
-	}
-       
+      quantum_memman((reg->size + overflow_size - size) 
+		     * (long) (sizeof(MAX_UNSIGNED) + sizeof(COMPLEX_FLOAT)));
     }
 
-  done = calloc(reg->size + addsize, sizeof(char));
+  for(i=0; i<overflow_size; i++)
+    {
+      reg->state[reg->size + i] = overflow_state[i];
+      reg->amplitude[reg->size + i] = overflow_amplitude[i];
+    }
 
-  if(!done)
-    quantum_error(QUANTUM_ENOMEM);
+  reg->size += overflow_size;
+
+  overflow_size = 0;
+}
+
+/* Apply the 2x2 matrix M to the target bit in all basis states where
+   the bits in CTRL are set. M should be unitary. Basis states failing
+   the control test are left alone, as are their partners, which share
+   the control bits. */
 
-  quantum_memman(reg->size + addsize * sizeof(char));
+void 
+quantum_gate1_controlled(MAX_UNSIGNED ctrl, int target, quantum_matrix m, 
+			 quantum_reg *reg)
+{
+  int i, j, iset;
+  COMPLEX_FLOAT t, tnot=0;
+  float limit;
+  char *done;
+
+  quantum_flush(reg);
+  quantum_copy_mapped(reg);
+
+  if((m.cols != 2) || (m.rows != 2))
+    quantum_error(QUANTUM_EMSIZE);
+
+  if(reg->hashw)
+    quantum_reconstruct_hash(reg);
 
-  k = reg->size;
+  done = quantum_scratch(reg->size * sizeof(char));
+
+  if(reg->size && !done)
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman(reg->size * sizeof(char));
 
   limit = (1.0 / ((MAX_UNSIGNED) 1 << reg->width)) * epsilon;
 
-  /* perform the actual matrix multiplication */
+  /* perform the actual matrix multiplication. Partner states that do
+     not exist yet go to the overflow buffer. */
 
   for(i=0; i<reg->size; i++)
     {
-      if(!done[i])
+      if(!done[i] && ((reg->state[i] & ctrl) == ctrl))
 	{
 	  /* determine if the target of the basis state is set */
 	  
@@ -392,75 +665,31 @@ quantum_gate1(int target, quantum_matrix m, quantum_reg *reg)
 
 	      else
 		reg->amplitude[j] = m.t[2] * t + m.t[3] * tnot;
+
+	      done[j] = 1;
 	    }
 
-	  
 	  else /* new basis state will be created */
 	    {
-	      
-	      if((m.t[1] == 0) && (iset))
-		break;
-	      if((m.t[2] == 0) && !(iset))
-		 break; 
-
-	      reg->state[k] = reg->state[i] 
-		^ ((MAX_UNSIGNED) 1 << target);
-
-	      if(iset)
-		reg->amplitude[k] = m.t[1] * t;
-
-	      else
-		reg->amplitude[k] = m.t[2] * t;
-
-	      k++;
+	      if(iset && (m.t[1] != 0))
+		quantum_overflow_add(reg->state[i] 
+				     ^ ((MAX_UNSIGNED) 1 << target),
+				     m.t[1] * t);
+
+	      else if(!iset && (m.t[2] != 0))
+		quantum_overflow_add(reg->state[i] 
+				     ^ ((MAX_UNSIGNED) 1 << target),
+				     m.t[2] * t);
 	    }
-
-	  if(j >= 0)
-	    done[j] = 1;
-
 	}
     }
 
-  reg->size += addsize;
-
-  free(done);
   quantum_memman(-reg->size * sizeof(char));
 
-  /* remove basis states with extremely small amplitude */
-
-  if(reg->hashw)
-    {
-      for(i=0, j=0; i<reg->size; i++)
-	{
-	  if(quantum_prob_inline(reg->amplitude[i]) < limit)
-	    {
-	      j++;
-	      decsize++;
-	    }
-	  
-	  else if(j)
-	    {
-	      reg->state[i-j] = reg->state[i];
-	      reg->amplitude[i-j] = reg->amplitude[i];
-	    }
-	}
-    
-      if(decsize)
-	{
-	  reg->size -= decsize;
-	  reg->amplitude = realloc(reg->amplitude, 
-				   reg->size * sizeof(COMPLEX_FLOAT));
-	  reg->state = realloc(reg->state, 
-			       reg->size * sizeof(MAX_UNSIGNED));
-	  
-	  
-	  if(reg->size && !(reg->state && reg->amplitude)) 
-	    quantum_error(QUANTUM_ENOMEM);
+  /* merge the new basis states and remove those with extremely small
+     amplitude */
 
-	  quantum_memman(-decsize * (sizeof(MAX_UNSIGNED) 
-				     + sizeof(COMPLEX_FLOAT)));
-	}
-    }
+  quantum_overflow_merge(limit, reg);
 
   if(reg->size > (1 << (reg->hashw-1)))
     fprintf(stderr, "Warning: inefficient hash table (size %i vs hash %i)\n", 
@@ -470,78 +699,54 @@ quantum_gate1(int target, quantum_matrix m, quantum_reg *reg)
   quantum_decohere(reg);
 }
 
-/* Apply the 4x4 matrix M to the bits TARGET1 and TARGET2. M should be
-   unitary. 
+/* Apply the 2x2 matrix M to the target bit. M should be unitary. */
 
-   Warning: code is mostly untested.*/
+void 
+quantum_gate1(int target, quantum_matrix m, quantum_reg *reg)
+{
+  quantum_gate1_controlled(0, target, m, reg);
+}
+
+/* Apply the 4x4 matrix M to the bits TARGET1 and TARGET2. M should be
+   unitary. */
 
 void 
 quantum_gate2(int target1, int target2, quantum_matrix m, quantum_reg *reg)
 {
-  int i, j, k, l;
-  int addsize=0, decsize=0;
-  COMPLEX_FLOAT psi_sub[4];
+  int i, j, k;
+  COMPLEX_FLOAT psi_sub[4], psi;
   int base[4];
   int bits[2];
+  MAX_UNSIGNED a;
   float limit;
   char *done;
 
+  quantum_flush(reg);
+  quantum_copy_mapped(reg);
+
   if((m.cols != 4) || (m.rows != 4))
     quantum_error(QUANTUM_EMSIZE);
   
-  /* Build hash table */
-
-  for(i=0; i<(1 << reg->hashw); i++)
-    reg->hash[i] = 0;
-      
-  for(i=0; i<reg->size; i++)
-    quantum_add_hash(reg->state[i], i, reg);
-
-  /* calculate the number of basis states to be added */
-
-  for(i=0; i<reg->size; i++)
-    {
-      if(quantum_get_state(reg->state[i] ^ ((MAX_UNSIGNED) 1 << target1),
-			   *reg) == -1)
-	addsize++;
-      if(quantum_get_state(reg->state[i] ^ ((MAX_UNSIGNED) 1 << target2),
-			   *reg) == -1)
-	addsize++;
-    }
+  if(reg->hashw)
+    quantum_reconstruct_hash(reg);
 
-  /* allocate memory for the new basis states */
+  done = quantum_scratch(reg->size * sizeof(char));
 
-  reg->state = realloc(reg->state, 
-		       (reg->size + addsize) * sizeof(MAX_UNSIGNED));
-  reg->amplitude = realloc(reg->amplitude, 
-			   (reg->size + addsize) * sizeof(COMPLEX_FLOAT));
-      
-  if(reg->size && !(reg->state && reg->amplitude)) 
+  if(reg->size && !done)
     quantum_error(QUANTUM_ENOMEM);
 
-  quantum_memman(addsize*(sizeof(COMPLEX_FLOAT) + sizeof(MAX_UNSIGNED)));
-
-  for(i=0; i<addsize; i++)
-    {
-      reg->state[i+reg->size] = 0;
-      reg->amplitude[i+reg->size] = 0;
-    }
-
-  done = calloc(reg->size + addsize, sizeof(char));
-
-  if(!done)
-    quantum_error(QUANTUM_EMSIZE);
-
-  quantum_memman(reg->size + addsize * sizeof(char));
-
-  l = reg->size;
+  quantum_memman(reg->size * sizeof(char));
 
   limit = (1.0 / ((MAX_UNSIGNED) 1 << reg->width)) / 1000000;
 
-  bits[0] = target1;
-  bits[1] = target2;
+  /* TARGET1 is the more significant bit of the matrix index */
+
+  bits[0] = target2;
+  bits[1] = target1;
 
-  /* perform the actual matrix multiplication */
+  /* perform the actual matrix multiplication. Each group of four
+     basis states differing only in the target bits is handled once,
+     starting from its first existing member. */
 
   for(i=0; i<reg->size; i++)
     {
@@ -563,65 +768,46 @@ quantum_gate2(int target1, int target2, quantum_matrix m, quantum_reg *reg)
 	  for(j=0; j<4; j++)
 	    {
 	      if(base[j] == -1)
-		{
-		  base[j] = l;
-		  //		  reg->node[l].state = reg->state[i]
-		  l++;
-		}
-	      psi_sub[j] = reg->amplitude[base[j]];
+		psi_sub[j] = 0;
+	      else
+		psi_sub[j] = reg->amplitude[base[j]];
 	    }
 
 	  for(j=0; j<4; j++)
 	    {
-	      reg->amplitude[base[j]] = 0;
+	      psi = 0;
 	      for(k=0; k<4; k++)
-		reg->amplitude[base[j]] += M(m, k, j) * psi_sub[k];
+		psi += M(m, k, j) * psi_sub[k];
 
-	      done[base[j]] = 1;
-	    }
-
-	}
-    }
-
-  reg->size += addsize;
-
-  free(done);
+	      if(base[j] >= 0)
+		{
+		  reg->amplitude[base[j]] = psi;
+		  done[base[j]] = 1;
+		}
 
-  quantum_memman(-reg->size * sizeof(char));
+	      else if(psi != 0)
+		{
+		  /* the basis state with bits J in the targets */
 
-  /* remove basis states with extremely small amplitude */
+		  a = reg->state[i] & ~((MAX_UNSIGNED) 1 << target1)
+		    & ~((MAX_UNSIGNED) 1 << target2);
+		  if(j & 1)
+		    a |= (MAX_UNSIGNED) 1 << target2;
+		  if(j & 2)
+		    a |= (MAX_UNSIGNED) 1 << target1;
 
-  for(i=0, j=0; i<reg->size; i++)
-    {
-      if(quantum_prob_inline(reg->amplitude[i]) < limit)
-	{
-	  j++;
-	  decsize++;
-	}
-      
-      else if(j)
-	{
-	  reg->state[i-j] = reg->state[i];
-	  reg->amplitude[i-j] = reg->amplitude[i];
+		  quantum_overflow_add(a, psi);
+		}
+	    }
 	}
     }
 
-  if(decsize)
-    {
-      reg->size -= decsize;
-      reg->amplitude = realloc(reg->amplitude, 
-			       reg->size * sizeof(COMPLEX_FLOAT));
-      reg->state = realloc(reg->state, 
-			   reg->size * sizeof(MAX_UNSIGNED));
-	  
-	  
-      if(reg->size && !(reg->state && reg->amplitude)) 
-	quantum_error(QUANTUM_ENOMEM);
+  quantum_memman(-reg->size * sizeof(char));
 
-      quantum_memman(-decsize * (sizeof(MAX_UNSIGNED) 
-				 + sizeof(COMPLEX_FLOAT)));
-      
-    }
+  /* merge the new basis states and remove those with extremely small
+     amplitude */
+
+  quantum_overflow_merge(limit, reg);
 
   quantum_decohere(reg);
 }
@@ -633,7 +819,7 @@ quantum_hadamard(int target, quantum_reg *reg)
 {
   quantum_matrix m;
   
-  if(quantum_objcode_put(HADAMARD, target))
+  if(quantum_objcode_putreg(reg, HADAMARD, target))
     return;
   
   m = quantum_new_matrix(2, 2);
@@ -666,7 +852,7 @@ quantum_r_x(int target, float gamma, quantum_reg *reg)
 {
   quantum_matrix m;
   
-  if(quantum_objcode_put(ROT_X, target, (double) gamma))
+  if(quantum_objcode_putreg(reg, ROT_X, target, (double) gamma))
     return;
 
   m = quantum_new_matrix(2, 2);
@@ -687,7 +873,7 @@ quantum_r_y(int target, float gamma, quantum_reg *reg)
 {
   quantum_matrix m;
 
-  if(quantum_objcode_put(ROT_Y, target, (double) gamma))
+  if(quantum_objcode_putreg(reg, ROT_Y, target, (double) gamma))
     return;
 
   m = quantum_new_matrix(2, 2);
@@ -709,7 +895,7 @@ quantum_r_z(int target, float gamma, quantum_reg *reg)
   int i;
   COMPLEX_FLOAT z;
 
-  if(quantum_objcode_put(ROT_Z, target, (double) gamma))
+  if(quantum_objcode_putreg(reg, ROT_Z, target, (double) gamma))
     return;
 
   z = quantum_cexp(gamma/2);
@@ -733,7 +919,7 @@ quantum_phase_scale(int target, float gamma, quantum_reg *reg)
   int i;
   COMPLEX_FLOAT z;
 
-  if(quantum_objcode_put(PHASE_SCALE, target, (double) gamma))
+  if(quantum_objcode_putreg(reg, PHASE_SCALE, target, (double) gamma))
     return;
 
   z = quantum_cexp(gamma);
@@ -758,7 +944,7 @@ quantum_phase_kick(int target, float gamma, quantum_reg *reg)
   int i;
   COMPLEX_FLOAT z;
 
-  if(quantum_objcode_put(PHASE_KICK, target, (double) gamma))
+  if(quantum_objcode_putreg(reg, PHASE_KICK, target, (double) gamma))
     return;
 
   z = quantum_cexp(gamma);
@@ -783,7 +969,7 @@ quantum_cond_phase(int control, int target, quantum_reg *reg)
   int i;
   COMPLEX_FLOAT z;
 
-  if(quantum_objcode_put(COND_PHASE, control, target))
+  if(quantum_objcode_putreg(reg, COND_PHASE, control, target))
     return;
 
   z = quantum_cexp(pi / ((MAX_UNSIGNED) 1 << (control - target)));
@@ -810,6 +996,12 @@ quantum_cond_phase_inv(int control, int target, quantum_reg *reg)
   int i;
   COMPLEX_FLOAT z;
 
+  /* Recorded as a conditional phase kick by the same angle */
+
+  if(quantum_objcode_putreg(reg, CPHASE_KICK, control, target, 
+			    -pi / ((MAX_UNSIGNED) 1 << (control - target))))
+    return;
+
   z = quantum_cexp(-pi / ((MAX_UNSIGNED) 1 << (control - target)));
 
 #ifdef _OPENMP
@@ -834,7 +1026,8 @@ quantum_cond_phase_kick(int control, int target, float gamma, quantum_reg *reg)
   int i;
   COMPLEX_FLOAT z;
 
-  if(quantum_objcode_put(COND_PHASE, control, target, (double) gamma))
+  if(quantum_objcode_putreg(reg, CPHASE_KICK, control, target, 
+			    (double) gamma))
     return;  
 
   z = quantum_cexp(gamma);
@@ -859,8 +1052,15 @@ quantum_cond_phase_shift(int control, int target, float gamma, quantum_reg *reg)
   int i;
   COMPLEX_FLOAT z;
 
-  if(quantum_objcode_put(COND_PHASE, control, target, (double) gamma))
-    return;  
+  /* There is no opcode for this gate, so it is recorded as a phase
+     kick on CONTROL followed by a conditional phase kick */
+
+  if(quantum_objcode_putreg(reg, PHASE_KICK, control, (double) -gamma / 2))
+    {
+      quantum_objcode_putreg(reg, CPHASE_KICK, control, target, 
+			     (double) gamma);
+      return;
+    }
 
   z = quantum_cexp(gamma/2);
 
@@ -883,6 +1083,118 @@ quantum_cond_phase_shift(int control, int target, float gamma, quantum_reg *reg)
 
 
 
+/* Flip the sign of every basis state for which PREDICATE returns
+   non-zero. The predicate is called from several threads at once, so
+   it has to be thread-safe. As it is an arbitrary function, the
+   oracle cannot be recorded as object code; it is an error to call it
+   while recording. */
+
+void
+quantum_phase_oracle(int predicate(MAX_UNSIGNED), quantum_reg *reg)
+{
+  int i;
+
+  if(quantum_objcode_status())
+    {
+      fprintf(stderr, "quantum_phase_oracle: Object code recording is "
+	      "active!\n");
+      quantum_error(QUANTUM_ERECORD);
+      return;
+    }
+
+  quantum_flush(reg);
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for(i=0; i<reg->size; i++)
+    {
+      if(predicate(reg->state[i]))
+	reg->amplitude[i] = -reg->amplitude[i];
+    }
+
+  quantum_decohere(reg);
+}
+
+/* Apply the diffusion operator 2|s><s| - 1 of Grover's algorithm to
+   the lowest WIDTH qubits, |s> being their uniform superposition.
+   If the register holds all of its basis states, every amplitude is
+   reflected about the mean of the amplitudes sharing its higher
+   qubits, which takes one pass to sum them and one to reflect.
+   Otherwise, and while object code is recorded, the operator is
+   built from elementary gates. */
+
+void
+quantum_grover_diffusion(int width, quantum_reg *reg)
+{
+  int i, n;
+  double *sum;
+  MAX_UNSIGNED g;
+  COMPLEX_FLOAT *mean;
+
+  if(!quantum_objcode_status())
+    quantum_flush(reg);
+
+  if(quantum_objcode_status() || (width < 1) || (width > reg->width)
+     || (reg->width >= sizeof(int) * 8 - 1) 
+     || (reg->size != 1 << reg->width))
+    {
+      quantum_walsh(width, reg);
+
+      for(i=0; i<width; i++)
+	quantum_sigma_x(i, reg);
+
+      /* Flip the sign of |1...1> */
+
+      quantum_hadamard(width-1, reg);
+      quantum_toffoli_controlled(((MAX_UNSIGNED) 1 << (width-1)) - 1, 
+				 width-1, reg);
+      quantum_hadamard(width-1, reg);
+
+      for(i=0; i<width; i++)
+	quantum_sigma_x(i, reg);
+
+      quantum_walsh(width, reg);
+
+      /* So far, we have applied 1 - 2|s><s| */
+
+      quantum_phase_scale(0, pi, reg);
+
+      return;
+    }
+
+  n = reg->size >> width;
+
+  sum = quantum_scratch(2 * n * sizeof(double) + n * sizeof(COMPLEX_FLOAT));
+
+  if(!sum)
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman(2 * n * sizeof(double) + n * sizeof(COMPLEX_FLOAT));
+
+  mean = (COMPLEX_FLOAT *) &sum[2 * n];
+
+  for(i=0; i<reg->size; i++)
+    {
+      g = reg->state[i] >> width;
+      sum[2 * g] += quantum_real(reg->amplitude[i]);
+      sum[2 * g + 1] += quantum_imag(reg->amplitude[i]);
+    }
+
+  for(i=0; i<n; i++)
+    mean[i] = 2 * (sum[2 * i] + IMAGINARY * sum[2 * i + 1]) / (1 << width);
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for(i=0; i<reg->size; i++)
+    reg->amplitude[i] = mean[reg->state[i] >> width] - reg->amplitude[i];
+
+  quantum_memman(-2 * n * sizeof(double) - n * sizeof(COMPLEX_FLOAT));
+
+  quantum_decohere(reg);
+}
+
 /* Increase the gate counter by INC steps or reset it if INC < 0. The
    current value of the counter is returned. */
 
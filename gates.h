@@ -32,16 +32,25 @@ extern void quantum_cnot(int control, int target, quantum_reg *reg);
 extern void quantum_toffoli(int control1, int control2, int target, 
 			    quantum_reg *reg);
 extern void quantum_unbounded_toffoli(int controlling, quantum_reg *reg, ...);
+extern void quantum_toffoli_controlled(MAX_UNSIGNED ctrl, int target, 
+				       quantum_reg *reg);
+extern void quantum_toffoli_array(int controlling, int *controls, int target, 
+				  quantum_reg *reg);
 
 extern void quantum_sigma_x(int target, quantum_reg *reg);
 extern void quantum_sigma_y(int target, quantum_reg *reg);
 extern void quantum_sigma_z(int target, quantum_reg *reg);
 
 extern void quantum_swaptheleads(int width, quantum_reg *reg);
+extern void quantum_swap_bits(int a, int b, quantum_reg *reg);
+extern void quantum_bit_reverse(int width, quantum_reg *reg);
+extern void quantum_permute_bits(int *perm, quantum_reg *reg);
 extern void quantum_swaptheleads_omuln_controlled(int control, int width,
 						  quantum_reg *);
 
 extern void quantum_gate1(int target, quantum_matrix m, quantum_reg *reg);
+extern void quantum_gate1_controlled(MAX_UNSIGNED ctrl, int target, 
+				     quantum_matrix m, quantum_reg *reg);
 extern void quantum_gate2(int target1, int target2, quantum_matrix m, 
 			  quantum_reg *reg);
 
@@ -51,6 +60,9 @@ extern void quantum_r_z(int target, float gamma, quantum_reg *reg);
 
 extern void quantum_hadamard(int target, quantum_reg *reg);
 extern void quantum_walsh(int width, quantum_reg *reg);
+extern void quantum_phase_oracle(int predicate(MAX_UNSIGNED), 
+				 quantum_reg *reg);
+extern void quantum_grover_diffusion(int width, quantum_reg *reg);
 
 extern void quantum_phase_scale(int target, float gamma, quantum_reg *reg);
 extern void quantum_phase_kick(int target, float gamma, quantum_reg *reg);
@@ -33,94 +33,20 @@
 #define pi 3.141592654
 #endif
 
-void oracle(int state, quantum_reg *reg)
-{
-  int i;
-
-  for(i=0;i<reg->width;i++)
-    {
-      if(!(state & (1 << i)))
-	{
-	  quantum_sigma_x(i, reg);
-	}
-    }
-
-  quantum_toffoli(0, 1, reg->width+1, reg);
-
-  for(i=1;i<reg->width;i++)
-    {
-      quantum_toffoli(i, reg->width+i, reg->width+i+1, reg);
-    }
+/* The number to search for */
 
-  quantum_cnot(reg->width+i, reg->width, reg);
-  
-  for(i=reg->width-1;i>0;i--)
-    {
-      quantum_toffoli(i, reg->width+i, reg->width+i+1, reg);
-    }
-  
-  quantum_toffoli(0, 1, reg->width+1, reg);
-
-  for(i=0;i<reg->width;i++)
-    {
-      if(!(state & (1 << i)))
-	quantum_sigma_x(i, reg);
-    }
-
-}
+static int target;
 
-void inversion(quantum_reg *reg)
+int is_target(MAX_UNSIGNED state)
 {
-  int i;
-  
-  for(i=0;i<reg->width;i++)
-    quantum_sigma_x(i, reg);
-
-  quantum_hadamard(reg->width-1, reg);
-
-  if(reg->width==3)
-    quantum_toffoli(0, 1, 2, reg);
-
-  else
-    {
-      quantum_toffoli(0, 1, reg->width+1, reg);
-
-      for(i=1;i<reg->width-1;i++)
-	{
-	  quantum_toffoli(i, reg->width+i, reg->width+i+1, reg);
-	}
-
-      quantum_cnot(reg->width+i, reg->width-1, reg);
-  
-      for(i=reg->width-2;i>0;i--)
-	{
-	  quantum_toffoli(i, reg->width+i, reg->width+i+1, reg);
-	}
-  
-      quantum_toffoli(0, 1, reg->width+1, reg);
-    }
-  
-  quantum_hadamard(reg->width-1, reg);
-
-  for(i=0;i<reg->width;i++)
-    quantum_sigma_x(i, reg);
+  return state == target;
 }
-  
 
-void grover(int target, quantum_reg *reg)
+void grover(quantum_reg *reg)
 {
-  int i;
-
-  oracle(target, reg);
-
-  for(i=0;i<reg->width;i++)
-    quantum_hadamard(i, reg);
-
-  inversion(reg);
-
-  for(i=0;i<reg->width;i++)
-    quantum_hadamard(i, reg);
+  quantum_phase_oracle(is_target, reg);
 
+  quantum_grover_diffusion(reg->width, reg);
 }
 
 int main(int argc, char **argv)
@@ -144,30 +70,20 @@ int main(int argc, char **argv)
   if(width < quantum_getwidth(N+1))
     width = quantum_getwidth(N+1);
 
-  reg = quantum_new_qureg(0, width);
-  //  reg.width--;
-
-  quantum_sigma_x(reg.width, &reg);
+  target = N;
 
-  for(i=0;i<reg.width;i++)
-    quantum_hadamard(i, &reg);
+  reg = quantum_new_qureg(0, width);
 
-  quantum_hadamard(reg.width, &reg);
+  quantum_walsh(reg.width, &reg);
 
   printf("Iterating %i times\n", (int) (pi/4*sqrt(1<<reg.width)));
 
   for(i=1; i<=pi/4*sqrt(1 << reg.width); i++)
     {
       printf("Iteration #%i\n", i);
-      grover(N, &reg);
+      grover(&reg);
     }
 
-  quantum_hadamard(reg.width, &reg);
-
-  reg.width++;
-
-  quantum_bmeasure(reg.width-1, &reg);
-  
   for(i=0; i<reg.size; i++)
     {
       if(reg.state[i] == N)
@@ -29,6 +29,9 @@
 #include "complex.h"
 #include "qureg.h"
 #include "error.h"
+#include "alloc.h"
+#include "defer.h"
+#include "checkpoint.h"
 #include "config.h"
 
 extern void cheev_(char *jobz, char *uplo, int *n, float _Complex *A, int *lda,
@@ -39,6 +42,16 @@ extern void zheev_(char *jobz, char *uplo, int *n, double _Complex *A, int *lda,
 		   double *w, double _Complex *work, int *lwork, double *rwork,
 		   int *info);
 
+extern void cgesvd_(char *jobu, char *jobvt, int *m, int *n, float _Complex *A,
+		    int *lda, float *s, float _Complex *U, int *ldu, 
+		    float _Complex *VT, int *ldvt, float _Complex *work, 
+		    int *lwork, float *rwork, int *info);
+
+extern void zgesvd_(char *jobu, char *jobvt, int *m, int *n, 
+		    double _Complex *A, int *lda, double *s, double _Complex *U,
+		    int *ldu, double _Complex *VT, int *ldvt, 
+		    double _Complex *work, int *lwork, double *rwork, int *info);
+
 void 
 quantum_diag_time(double t, quantum_reg *reg0, quantum_reg *regt, 
 		  quantum_reg *tmp1, quantum_reg *tmp2, quantum_matrix H, 
@@ -55,6 +68,11 @@ quantum_diag_time(double t, quantum_reg *reg0, quantum_reg *regt,
   int i, j;
   void *p;
   
+  quantum_flush(reg0);
+  quantum_copy_mapped(regt);
+  quantum_copy_mapped(tmp1);
+  quantum_copy_mapped(tmp2);
+
   if(tmp2->size != reg0->size)
     {
       /* perform diagonalization */
@@ -71,15 +89,15 @@ quantum_diag_time(double t, quantum_reg *reg0, quantum_reg *regt,
 
       p = regt->amplitude;
       *regt = *reg0;
-      regt->amplitude = realloc(p, regt->size*sizeof(COMPLEX_FLOAT));
+      regt->amplitude = quantum_realloc(p, regt->size*sizeof(COMPLEX_FLOAT));
       
       p = tmp1->amplitude;
       *tmp1 = *reg0;
-      tmp1->amplitude = realloc(p, regt->size*sizeof(COMPLEX_FLOAT));
+      tmp1->amplitude = quantum_realloc(p, regt->size*sizeof(COMPLEX_FLOAT));
 
       p = tmp2->amplitude;
       *tmp2 = *reg0;
-      tmp2->amplitude = realloc(p, regt->size*sizeof(COMPLEX_FLOAT));
+      tmp2->amplitude = quantum_realloc(p, regt->size*sizeof(COMPLEX_FLOAT));
 
       if(!(regt->amplitude && tmp1->amplitude && tmp2->amplitude))
 	quantum_error(QUANTUM_ENOMEM);
@@ -129,11 +147,11 @@ quantum_diag_time(double t, quantum_reg *reg0, quantum_reg *regt,
     {
       p = regt->amplitude;
       *regt = *reg0;
-      regt->amplitude = realloc(p, regt->size*sizeof(COMPLEX_FLOAT));
+      regt->amplitude = quantum_realloc(p, regt->size*sizeof(COMPLEX_FLOAT));
 
       p = tmp1->amplitude;
       *tmp1 = *reg0;
-      tmp1->amplitude = realloc(p, regt->size*sizeof(COMPLEX_FLOAT));
+      tmp1->amplitude = quantum_realloc(p, regt->size*sizeof(COMPLEX_FLOAT));
 
       quantum_adjoint(&H);
       
@@ -154,4 +172,55 @@ quantum_diag_time(double t, quantum_reg *reg0, quantum_reg *regt,
   
 }
 
+/* Compute the singular value decomposition A = U S VT of the ROWS x
+   COLS matrix A, stored in column-major order. With K = min(ROWS,
+   COLS), U has to hold ROWS x K elements, VT K x COLS elements and S
+   the K singular values in descending order. A is destroyed. */
+
+void
+quantum_svd(int rows, int cols, COMPLEX_FLOAT *A, REAL_FLOAT *s, 
+	    COMPLEX_FLOAT *U, COMPLEX_FLOAT *VT)
+{
+#ifdef HAVE_LIBLAPACK
+  char job = 'S';
+  int k = rows < cols ? rows : cols;
+  COMPLEX_FLOAT *work;
+  REAL_FLOAT *rwork;
+  int lwork = -1;
+  int info;
+
+  work = malloc(sizeof(COMPLEX_FLOAT));
+  rwork = malloc(5 * k * sizeof(REAL_FLOAT));
+
+  if(!(work && rwork))
+    quantum_error(QUANTUM_ENOMEM);
+
+  QUANTUM_LAPACK_SVD(&job, &job, &rows, &cols, A, &rows, s, U, &rows, VT, &k,
+		     work, &lwork, rwork, &info);
 
+  if(info < 0)
+    quantum_error(QUANTUM_ELAPACKARG);
+
+  lwork = (int) work[0];
+  work = realloc(work, lwork*sizeof(COMPLEX_FLOAT));
+
+  if(!work)
+    quantum_error(QUANTUM_ENOMEM);
+
+  QUANTUM_LAPACK_SVD(&job, &job, &rows, &cols, A, &rows, s, U, &rows, VT, &k,
+		     work, &lwork, rwork, &info);
+
+  if(info < 0)
+    quantum_error(QUANTUM_ELAPACKARG);
+
+  else if(info > 0)
+    quantum_error(QUANTUM_ELAPACKCONV);
+
+  free(work);
+  free(rwork);
+
+#else
+  quantum_error(QUANTUM_ENOLAPACK);
+
+#endif /* HAVE_LIBLAPACK */
+}
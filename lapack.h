@@ -31,12 +31,16 @@
 
 #ifdef USE_DOUBLE
 #define QUANTUM_LAPACK_SOLVER zheev_
+#define QUANTUM_LAPACK_SVD zgesvd_
 #else
 #define QUANTUM_LAPACK_SOLVER cheev_
+#define QUANTUM_LAPACK_SVD cgesvd_
 #endif
 
 extern void quantum_diag_time(double t, quantum_reg *reg0, quantum_reg *regt, 
 			      quantum_reg *tmp1, quantum_reg *tmp2, 
 			      quantum_matrix H, REAL_FLOAT **w);
+extern void quantum_svd(int rows, int cols, COMPLEX_FLOAT *A, REAL_FLOAT *s, 
+			COMPLEX_FLOAT *U, COMPLEX_FLOAT *VT);
 
 #endif
@@ -33,7 +33,13 @@
 #include "complex.h"
 #include "config.h"
 #include "objcode.h"
+#include "defer.h"
+#include "stabilizer.h"
+#include "dd.h"
+#include "product.h"
+#include "remap.h"
 #include "error.h"
+#include "alloc.h"
 
 /* Generate a uniformly distributed random number between 0 and 1 */
 
@@ -51,6 +57,27 @@ quantum_measure(quantum_reg reg)
   double r;
   int i;
 
+  /* Registers simulated with a stabilizer tableau, represented by a
+     decision diagram or kept as a product are measured without
+     building their state vector. With a qubit map, the result is
+     translated back. */
+
+  quantum_defer_flush(&reg);
+
+  if(quantum_stabilizer_active(&reg) && !quantum_objcode_status())
+    return quantum_stabilizer_measure(&reg);
+
+  if(quantum_dd_active(&reg) && !quantum_objcode_status())
+    return quantum_dd_measure(&reg);
+
+  if(quantum_product_active(&reg) && !quantum_objcode_status())
+    return quantum_product_measure(&reg);
+
+  if(quantum_remap_active(&reg) && !quantum_objcode_status())
+    return quantum_remap_measure(&reg);
+
+  quantum_flush(&reg);
+
   if(quantum_objcode_put(MEASURE))
     return 0;
 
@@ -91,6 +118,22 @@ quantum_bmeasure(int pos, quantum_reg *reg)
   MAX_UNSIGNED pos2;
   quantum_reg out;
   
+  quantum_defer_flush(reg);
+
+  if(quantum_stabilizer_active(reg) && !quantum_objcode_status())
+    return quantum_stabilizer_bmeasure(pos, 0, reg);
+
+  if(quantum_dd_active(reg) && !quantum_objcode_status())
+    return quantum_dd_bmeasure(pos, 0, reg);
+
+  if(quantum_product_active(reg) && !quantum_objcode_status())
+    return quantum_product_bmeasure(pos, 0, reg);
+
+  if(quantum_remap_active(reg) && !quantum_objcode_status())
+    return quantum_remap_bmeasure(pos, 0, reg);
+
+  quantum_flush(reg);
+
   if(quantum_objcode_put(BMEASURE, pos))
      return 0;
 
@@ -132,6 +175,22 @@ quantum_bmeasure_bitpreserve(int pos, quantum_reg *reg)
   MAX_UNSIGNED pos2;
   quantum_reg out;
 
+  quantum_defer_flush(reg);
+
+  if(quantum_stabilizer_active(reg) && !quantum_objcode_status())
+    return quantum_stabilizer_bmeasure(pos, 1, reg);
+
+  if(quantum_dd_active(reg) && !quantum_objcode_status())
+    return quantum_dd_bmeasure(pos, 1, reg);
+
+  if(quantum_product_active(reg) && !quantum_objcode_status())
+    return quantum_product_bmeasure(pos, 1, reg);
+
+  if(quantum_remap_active(reg) && !quantum_objcode_status())
+    return quantum_remap_bmeasure(pos, 1, reg);
+
+  quantum_flush(reg);
+
   if(quantum_objcode_put(BMEASURE_P, pos))
      return 0;
 
@@ -183,8 +242,8 @@ quantum_bmeasure_bitpreserve(int pos, quantum_reg *reg)
   /* Build the new quantum register */
 
   out.size = size;
-  out.state = calloc(size, sizeof(MAX_UNSIGNED));
-  out.amplitude = calloc(size, sizeof(COMPLEX_FLOAT));
+  out.state = quantum_calloc(size, sizeof(MAX_UNSIGNED));
+  out.amplitude = quantum_calloc(size, sizeof(COMPLEX_FLOAT));
 
   if(!(out.state && out.amplitude))
     quantum_error(QUANTUM_ENOMEM);
@@ -0,0 +1,972 @@
+/* mps.c: Matrix product state registers
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mps.h"
+#include "config.h"
+#include "complex.h"
+#include "matrix.h"
+#include "qureg.h"
+#include "measure.h"
+#include "lapack.h"
+#include "error.h"
+#include "alloc.h"
+
+/* Site I holds a tensor A(l, s, r) of BOND[I] x 2 x BOND[I+1]
+   elements in column-major order, so that it can be read as a 2
+   BOND[I] x BOND[I+1] matrix with rows (l, s) or as a BOND[I] x 2
+   BOND[I+1] matrix with columns (s, r) without moving any data. All
+   sites left of the orthogonality center are left-orthonormal, all
+   sites right of it right-orthonormal, so that the norm of the state
+   and all local quantities can be read off at the center. */
+
+#define MPS_SIZE(reg, i) ((long) (reg)->bond[i] * 2 * (reg)->bond[(i)+1])
+#define MPS_AT(A, bl, l, s, r) ((A)[(l) + (bl) * ((s) + 2 * (r))])
+
+/* Replace the tensor of site I, which used to have OLDSIZE elements */
+
+static void
+quantum_mps_set(int i, COMPLEX_FLOAT *A, long oldsize, quantum_mps_reg *reg)
+{
+  quantum_free(reg->site[i]);
+  reg->site[i] = A;
+
+  quantum_memman((MPS_SIZE(reg, i) - oldsize) * (long) sizeof(COMPLEX_FLOAT));
+}
+
+/* Multiply the ROWS x N matrix A with the N x COLS matrix B, both in
+   column-major order */
+
+static COMPLEX_FLOAT *
+quantum_mps_mmult(int rows, int n, int cols, COMPLEX_FLOAT *A, 
+		  COMPLEX_FLOAT *B)
+{
+  COMPLEX_FLOAT *C, b;
+  int i, j, k;
+
+  C = quantum_calloc((size_t) rows * cols, sizeof(COMPLEX_FLOAT));
+
+  if(!C)
+    quantum_error(QUANTUM_ENOMEM);
+
+#ifdef _OPENMP
+#pragma omp parallel for private (i, k, b)
+#endif
+  for(j=0; j<cols; j++)
+    {
+      for(k=0; k<n; k++)
+	{
+	  b = B[k + (long) n * j];
+
+	  if(b == 0)
+	    continue;
+
+	  for(i=0; i<rows; i++)
+	    C[i + (long) rows * j] += A[i + (long) rows * k] * b;
+	}
+    }
+
+  return C;
+}
+
+/* Decompose the ROWS x COLS matrix A into U S VT, keeping at most
+   MAXBOND singular values (if MAXBOND is non-zero) and none below
+   QUANTUM_MPS_CUTOFF times the largest one. The discarded weight is
+   added to the error of REG and the kept singular values are rescaled
+   to preserve the norm. U then holds ROWS x K and VT K x COLS
+   elements, where K is the return value. A is destroyed. */
+
+static int
+quantum_mps_svd(int rows, int cols, COMPLEX_FLOAT *A, int maxbond, 
+		COMPLEX_FLOAT **U, REAL_FLOAT **s, COMPLEX_FLOAT **VT,
+		quantum_mps_reg *reg)
+{
+  int kmin = rows < cols ? rows : cols;
+  COMPLEX_FLOAT *vt;
+  double total = 0, kept = 0, f;
+  int i, j, k;
+
+  *U = quantum_alloc((size_t) rows * kmin * sizeof(COMPLEX_FLOAT));
+  *s = malloc(kmin * sizeof(REAL_FLOAT));
+  vt = quantum_alloc((size_t) kmin * cols * sizeof(COMPLEX_FLOAT));
+
+  if(!(*U && *s && vt))
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_svd(rows, cols, A, *s, *U, vt);
+
+  for(k=kmin; (k > 1) && ((*s)[k-1] < QUANTUM_MPS_CUTOFF * (*s)[0]); k--);
+
+  if((maxbond > 0) && (k > maxbond))
+    k = maxbond;
+
+  for(i=0; i<kmin; i++)
+    {
+      total += (*s)[i] * (*s)[i];
+
+      if(i < k)
+	kept += (*s)[i] * (*s)[i];
+    }
+
+  if((kept > 0) && (kept < total))
+    {
+      reg->error += (total - kept) / total;
+      f = sqrt(total / kept);
+
+      for(i=0; i<k; i++)
+	(*s)[i] *= f;
+    }
+
+  if(k == kmin)
+    {
+      *VT = vt;
+      return k;
+    }
+
+  /* Drop the discarded columns of U and rows of VT */
+
+  *U = quantum_realloc(*U, (size_t) rows * k * sizeof(COMPLEX_FLOAT));
+  *VT = quantum_alloc((size_t) k * cols * sizeof(COMPLEX_FLOAT));
+
+  if(!(*U && *VT))
+    quantum_error(QUANTUM_ENOMEM);
+
+  for(j=0; j<cols; j++)
+    {
+      for(i=0; i<k; i++)
+	(*VT)[i + (long) k * j] = vt[i + (long) kmin * j];
+    }
+
+  quantum_free(vt);
+
+  return k;
+}
+
+/* Move the orthogonality center to site TARGET */
+
+static void
+quantum_mps_move(int target, quantum_mps_reg *reg)
+{
+  COMPLEX_FLOAT *U, *VT, *A;
+  REAL_FLOAT *s;
+  long old0, old1;
+  int c, bl, br, i, j, k;
+
+  while(reg->center < target)
+    {
+      /* Split off a left-orthonormal U and push S VT to the right */
+
+      c = reg->center;
+      bl = reg->bond[c];
+      br = reg->bond[c+1];
+      old0 = MPS_SIZE(reg, c);
+      old1 = MPS_SIZE(reg, c+1);
+
+      k = quantum_mps_svd(2 * bl, br, reg->site[c], 0, &U, &s, &VT, reg);
+
+      for(j=0; j<br; j++)
+	{
+	  for(i=0; i<k; i++)
+	    VT[i + (long) k * j] *= s[i];
+	}
+
+      A = quantum_mps_mmult(k, br, 2 * reg->bond[c+2], VT, reg->site[c+1]);
+
+      reg->bond[c+1] = k;
+      quantum_mps_set(c, U, old0, reg);
+      quantum_mps_set(c+1, A, old1, reg);
+      reg->center++;
+
+      quantum_free(VT);
+      free(s);
+    }
+
+  while(reg->center > target)
+    {
+      /* Split off a right-orthonormal VT and push U S to the left */
+
+      c = reg->center;
+      bl = reg->bond[c];
+      br = reg->bond[c+1];
+      old0 = MPS_SIZE(reg, c-1);
+      old1 = MPS_SIZE(reg, c);
+
+      k = quantum_mps_svd(bl, 2 * br, reg->site[c], 0, &U, &s, &VT, reg);
+
+      for(j=0; j<k; j++)
+	{
+	  for(i=0; i<bl; i++)
+	    U[i + (long) bl * j] *= s[j];
+	}
+
+      A = quantum_mps_mmult(2 * reg->bond[c-1], bl, k, reg->site[c-1], U);
+
+      reg->bond[c] = k;
+      quantum_mps_set(c-1, A, old0, reg);
+      quantum_mps_set(c, VT, old1, reg);
+      reg->center--;
+
+      quantum_free(U);
+      free(s);
+    }
+}
+
+/* Squared norm of the state, read off at the orthogonality center */
+
+static double
+quantum_mps_norm(quantum_mps_reg *reg)
+{
+  COMPLEX_FLOAT *A = reg->site[reg->center];
+  long i, n = MPS_SIZE(reg, reg->center);
+  double norm = 0;
+
+  for(i=0; i<n; i++)
+    norm += quantum_prob_inline(A[i]);
+
+  return norm;
+}
+
+/* Create a new matrix product state in the basis state INITVAL. The
+   bond dimension is limited to MAXBOND, or unlimited if MAXBOND is
+   zero. */
+
+quantum_mps_reg
+quantum_mps_new(MAX_UNSIGNED initval, int width, int maxbond)
+{
+  quantum_mps_reg reg;
+  int i;
+
+  reg.width = width;
+  reg.maxbond = maxbond;
+  reg.center = 0;
+  reg.error = 0;
+
+  reg.bond = malloc((width + 1) * sizeof(int));
+  reg.site = malloc(width * sizeof(COMPLEX_FLOAT *));
+
+  if(!(reg.bond && reg.site))
+    quantum_error(QUANTUM_ENOMEM);
+
+  for(i=0; i<=width; i++)
+    reg.bond[i] = 1;
+
+  /* Start out with a product state of bond dimension one */
+
+  for(i=0; i<width; i++)
+    {
+      reg.site[i] = quantum_calloc(2, sizeof(COMPLEX_FLOAT));
+
+      if(!reg.site[i])
+	quantum_error(QUANTUM_ENOMEM);
+
+      if((i < (int) sizeof(MAX_UNSIGNED) * 8) && (initval >> i) & 1)
+	reg.site[i][1] = 1;
+      else
+	reg.site[i][0] = 1;
+    }
+
+  quantum_memman(2 * width * sizeof(COMPLEX_FLOAT));
+
+  return reg;
+}
+
+/* Delete a matrix product state */
+
+void
+quantum_mps_delete(quantum_mps_reg *reg)
+{
+  int i;
+
+  for(i=0; i<reg->width; i++)
+    {
+      quantum_memman(-MPS_SIZE(reg, i) * (long) sizeof(COMPLEX_FLOAT));
+      quantum_free(reg->site[i]);
+    }
+
+  free(reg->site);
+  free(reg->bond);
+
+  reg->site = 0;
+  reg->bond = 0;
+}
+
+/* Apply a 2x2 matrix to a single qubit. This only touches the local
+   tensor and leaves the canonical form intact for unitary M. */
+
+void
+quantum_mps_gate1(int target, quantum_matrix m, quantum_mps_reg *reg)
+{
+  COMPLEX_FLOAT *A = reg->site[target];
+  COMPLEX_FLOAT a0, a1;
+  int bl = reg->bond[target];
+  int br = reg->bond[target+1];
+  int l, r;
+
+  if((m.cols != 2) || (m.rows != 2))
+    quantum_error(QUANTUM_EMSIZE);
+
+  for(r=0; r<br; r++)
+    {
+      for(l=0; l<bl; l++)
+	{
+	  a0 = MPS_AT(A, bl, l, 0, r);
+	  a1 = MPS_AT(A, bl, l, 1, r);
+
+	  MPS_AT(A, bl, l, 0, r) = m.t[0] * a0 + m.t[1] * a1;
+	  MPS_AT(A, bl, l, 1, r) = m.t[2] * a0 + m.t[3] * a1;
+	}
+    }
+}
+
+/* Apply a 4x4 matrix to the neighbouring sites I and I+1. The matrix
+   index is 2 * s(I) + s(I+1), or 2 * s(I+1) + s(I) if FLIP is set.
+   Afterwards the orthogonality center is at I+1. */
+
+static void
+quantum_mps_apply2(int i, quantum_matrix m, int flip, quantum_mps_reg *reg)
+{
+  COMPLEX_FLOAT *theta, *U, *VT, t[4], *p[4];
+  REAL_FLOAT *s;
+  long old0, old1;
+  int bl, br, a, b, k, l, r;
+
+  quantum_mps_move(i, reg);
+
+  bl = reg->bond[i];
+  br = reg->bond[i+2];
+  old0 = MPS_SIZE(reg, i);
+  old1 = MPS_SIZE(reg, i+1);
+
+  /* Contract both sites into a 2 BL x 2 BR matrix THETA with rows
+     (l, s(I)) and columns (s(I+1), r) */
+
+  theta = quantum_mps_mmult(2 * bl, reg->bond[i+1], 2 * br, reg->site[i], 
+			    reg->site[i+1]);
+
+  for(r=0; r<br; r++)
+    {
+      for(l=0; l<bl; l++)
+	{
+	  for(a=0; a<4; a++)
+	    {
+	      if(flip)
+		p[a] = &theta[l + bl * (a & 1) + 2L * bl * ((a >> 1) + 2 * r)];
+	      else
+		p[a] = &theta[l + bl * (a >> 1) + 2L * bl * ((a & 1) + 2 * r)];
+	    }
+
+	  for(a=0; a<4; a++)
+	    {
+	      t[a] = 0;
+
+	      for(b=0; b<4; b++)
+		t[a] += m.t[a * 4 + b] * *p[b];
+	    }
+
+	  for(a=0; a<4; a++)
+	    *p[a] = t[a];
+	}
+    }
+
+  /* Split THETA again, truncating the bond between the two sites */
+
+  k = quantum_mps_svd(2 * bl, 2 * br, theta, reg->maxbond, &U, &s, &VT, reg);
+
+  for(r=0; r<2*br; r++)
+    {
+      for(a=0; a<k; a++)
+	VT[a + (long) k * r] *= s[a];
+    }
+
+  reg->bond[i+1] = k;
+  quantum_mps_set(i, U, old0, reg);
+  quantum_mps_set(i+1, VT, old1, reg);
+  reg->center = i + 1;
+
+  quantum_free(theta);
+  free(s);
+}
+
+/* Apply a 4x4 matrix to two qubits. The matrix index is 2 *
+   s(TARGET1) + s(TARGET2). Qubits which are not neighbours are
+   brought together by a chain of swaps, which is undone
+   afterwards. */
+
+void
+quantum_mps_gate2(int target1, int target2, quantum_matrix m, 
+		  quantum_mps_reg *reg)
+{
+  quantum_matrix swap;
+  int i, j, k;
+
+  if((m.cols != 4) || (m.rows != 4))
+    quantum_error(QUANTUM_EMSIZE);
+
+  i = target1 < target2 ? target1 : target2;
+  j = target1 < target2 ? target2 : target1;
+
+  if(j == i + 1)
+    {
+      quantum_mps_apply2(i, m, target1 > target2, reg);
+      return;
+    }
+
+  swap = quantum_new_matrix(4, 4);
+
+  swap.t[0] = 1;
+  swap.t[6] = 1;
+  swap.t[9] = 1;
+  swap.t[15] = 1;
+
+  for(k=j-1; k>i; k--)
+    quantum_mps_apply2(k, swap, 0, reg);
+
+  quantum_mps_apply2(i, m, target1 > target2, reg);
+
+  for(k=i+1; k<j; k++)
+    quantum_mps_apply2(k, swap, 0, reg);
+
+  quantum_delete_matrix(&swap);
+}
+
+/* Apply a Hadamard gate */
+
+void
+quantum_mps_hadamard(int target, quantum_mps_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = sqrt(1.0/2);  m.t[1] = sqrt(1.0/2);
+  m.t[2] = sqrt(1.0/2);  m.t[3] = -sqrt(1.0/2);
+
+  quantum_mps_gate1(target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a Pauli X (NOT) gate */
+
+void
+quantum_mps_sigma_x(int target, quantum_mps_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[1] = 1;
+  m.t[2] = 1;
+
+  quantum_mps_gate1(target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a Pauli Y gate */
+
+void
+quantum_mps_sigma_y(int target, quantum_mps_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[1] = -IMAGINARY;
+  m.t[2] = IMAGINARY;
+
+  quantum_mps_gate1(target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a Pauli Z gate */
+
+void
+quantum_mps_sigma_z(int target, quantum_mps_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = 1;
+  m.t[3] = -1;
+
+  quantum_mps_gate1(target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a rotation about the x-axis by the angle GAMMA */
+
+void
+quantum_mps_r_x(int target, float gamma, quantum_mps_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = cos(gamma / 2);              m.t[1] = -IMAGINARY * sin(gamma / 2);
+  m.t[2] = -IMAGINARY * sin(gamma / 2); m.t[3] = cos(gamma / 2);
+
+  quantum_mps_gate1(target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a rotation about the y-axis by the angle GAMMA */
+
+void
+quantum_mps_r_y(int target, float gamma, quantum_mps_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = cos(gamma / 2);  m.t[1] = -sin(gamma / 2);
+  m.t[2] = sin(gamma / 2);  m.t[3] = cos(gamma / 2);
+
+  quantum_mps_gate1(target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a rotation about the z-axis by the angle GAMMA */
+
+void
+quantum_mps_r_z(int target, float gamma, quantum_mps_reg *reg)
+{
+  quantum_matrix m;
+  COMPLEX_FLOAT z;
+
+  z = quantum_cexp(gamma / 2);
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = 1 / z;
+  m.t[3] = z;
+
+  quantum_mps_gate1(target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a phase kick by the angle GAMMA */
+
+void
+quantum_mps_phase_kick(int target, float gamma, quantum_mps_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = 1;
+  m.t[3] = quantum_cexp(gamma);
+
+  quantum_mps_gate1(target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a controlled-NOT gate */
+
+void
+quantum_mps_cnot(int control, int target, quantum_mps_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(4, 4);
+
+  m.t[0] = 1;
+  m.t[5] = 1;
+  m.t[11] = 1;
+  m.t[14] = 1;
+
+  quantum_mps_gate2(control, target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a phase kick by the angle GAMMA if both qubits are set */
+
+void
+quantum_mps_cond_phase_kick(int control, int target, float gamma, 
+			    quantum_mps_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(4, 4);
+
+  m.t[0] = 1;
+  m.t[5] = 1;
+  m.t[10] = 1;
+  m.t[15] = quantum_cexp(gamma);
+
+  quantum_mps_gate2(control, target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Sample a basis state without collapsing the register. Only the
+   first qubits fitting into a MAX_UNSIGNED are sampled. */
+
+MAX_UNSIGNED
+quantum_mps_measure(quantum_mps_reg *reg)
+{
+  COMPLEX_FLOAT *A, *v, *w[2];
+  MAX_UNSIGNED result = 0;
+  double p[2], f;
+  int i, n, bl, br, l, r, s;
+
+  quantum_mps_move(0, reg);
+
+  n = reg->width;
+
+  if(n > (int) sizeof(MAX_UNSIGNED) * 8)
+    n = sizeof(MAX_UNSIGNED) * 8;
+
+  v = malloc(sizeof(COMPLEX_FLOAT));
+
+  if(!v)
+    quantum_error(QUANTUM_ENOMEM);
+
+  v[0] = 1;
+
+  /* Since all sites right of the center are right-orthonormal, the
+     conditional probabilities follow from the left part alone */
+
+  for(i=0; i<n; i++)
+    {
+      A = reg->site[i];
+      bl = reg->bond[i];
+      br = reg->bond[i+1];
+
+      for(s=0; s<2; s++)
+	{
+	  w[s] = calloc(br, sizeof(COMPLEX_FLOAT));
+
+	  if(!w[s])
+	    quantum_error(QUANTUM_ENOMEM);
+
+	  p[s] = 0;
+
+	  for(r=0; r<br; r++)
+	    {
+	      for(l=0; l<bl; l++)
+		w[s][r] += v[l] * MPS_AT(A, bl, l, s, r);
+
+	      p[s] += quantum_prob_inline(w[s][r]);
+	    }
+	}
+
+      s = quantum_frand() > p[0] / (p[0] + p[1]);
+
+      if(s)
+	result |= (MAX_UNSIGNED) 1 << i;
+
+      f = 1 / sqrt(p[s]);
+
+      for(r=0; r<br; r++)
+	w[s][r] *= f;
+
+      free(v);
+      free(w[!s]);
+      v = w[s];
+    }
+
+  free(v);
+
+  return result;
+}
+
+/* Measure a single qubit and collapse the register accordingly */
+
+int
+quantum_mps_bmeasure(int pos, quantum_mps_reg *reg)
+{
+  COMPLEX_FLOAT *A;
+  double pa = 0, norm, f;
+  int bl, br, l, r, result;
+
+  quantum_mps_move(pos, reg);
+
+  A = reg->site[pos];
+  bl = reg->bond[pos];
+  br = reg->bond[pos+1];
+  norm = quantum_mps_norm(reg);
+
+  for(r=0; r<br; r++)
+    {
+      for(l=0; l<bl; l++)
+	pa += quantum_prob_inline(MPS_AT(A, bl, l, 0, r));
+    }
+
+  pa /= norm;
+  result = quantum_frand() > pa;
+
+  /* Remove the other value of the bit and normalize the rest */
+
+  f = 1 / sqrt(norm * (result ? 1 - pa : pa));
+
+  for(r=0; r<br; r++)
+    {
+      for(l=0; l<bl; l++)
+	{
+	  MPS_AT(A, bl, l, !result, r) = 0;
+	  MPS_AT(A, bl, l, result, r) *= f;
+	}
+    }
+
+  return result;
+}
+
+/* Calculate the expectation value of the 2x2 operator OP acting on
+   qubit TARGET */
+
+COMPLEX_FLOAT
+quantum_mps_expect1(int target, quantum_matrix op, quantum_mps_reg *reg)
+{
+  COMPLEX_FLOAT *A, a0, a1, sum = 0;
+  int bl, br, l, r;
+
+  if((op.cols != 2) || (op.rows != 2))
+    quantum_error(QUANTUM_EMSIZE);
+
+  quantum_mps_move(target, reg);
+
+  A = reg->site[target];
+  bl = reg->bond[target];
+  br = reg->bond[target+1];
+
+  for(r=0; r<br; r++)
+    {
+      for(l=0; l<bl; l++)
+	{
+	  a0 = MPS_AT(A, bl, l, 0, r);
+	  a1 = MPS_AT(A, bl, l, 1, r);
+
+	  sum += quantum_conj(a0) * (op.t[0] * a0 + op.t[1] * a1)
+	    + quantum_conj(a1) * (op.t[2] * a0 + op.t[3] * a1);
+	}
+    }
+
+  return sum / quantum_mps_norm(reg);
+}
+
+/* Calculate the expectation value of the product of the 2x2
+   operators OP1 acting on qubit TARGET1 and OP2 acting on qubit
+   TARGET2. The left environment E is carried from the first to the
+   second qubit through the transfer matrices of the sites in
+   between. */
+
+COMPLEX_FLOAT
+quantum_mps_expect2(int target1, quantum_matrix op1, int target2, 
+		    quantum_matrix op2, quantum_mps_reg *reg)
+{
+  quantum_matrix m;
+  COMPLEX_FLOAT *A, *E, *F, *T, a[2], sum = 0;
+  int i, j, k, bl, br, l, r, r2, s;
+  double norm;
+
+  if((op1.cols != 2) || (op1.rows != 2) || (op2.cols != 2) 
+     || (op2.rows != 2))
+    quantum_error(QUANTUM_EMSIZE);
+
+  if(target1 == target2)
+    {
+      m = quantum_mmult(op1, op2);
+      sum = quantum_mps_expect1(target1, m, reg);
+      quantum_delete_matrix(&m);
+
+      return sum;
+    }
+
+  if(target1 > target2)
+    {
+      m = op1;
+      op1 = op2;
+      op2 = m;
+    }
+
+  i = target1 < target2 ? target1 : target2;
+  j = target1 < target2 ? target2 : target1;
+
+  quantum_mps_move(i, reg);
+  norm = quantum_mps_norm(reg);
+
+  /* E(r1, r2) = sum conj(A(l, s, r1)) OP1(s, t) A(l, t, r2) */
+
+  A = reg->site[i];
+  bl = reg->bond[i];
+  br = reg->bond[i+1];
+
+  E = calloc((size_t) br * br, sizeof(COMPLEX_FLOAT));
+
+  if(!E)
+    quantum_error(QUANTUM_ENOMEM);
+
+  for(r2=0; r2<br; r2++)
+    {
+      for(l=0; l<bl; l++)
+	{
+	  a[0] = op1.t[0] * MPS_AT(A, bl, l, 0, r2) 
+	    + op1.t[1] * MPS_AT(A, bl, l, 1, r2);
+	  a[1] = op1.t[2] * MPS_AT(A, bl, l, 0, r2) 
+	    + op1.t[3] * MPS_AT(A, bl, l, 1, r2);
+
+	  for(r=0; r<br; r++)
+	    E[r + (long) br * r2] += quantum_conj(MPS_AT(A, bl, l, 0, r)) * a[0]
+	      + quantum_conj(MPS_AT(A, bl, l, 1, r)) * a[1];
+	}
+    }
+
+  for(k=i+1; k<=j; k++)
+    {
+      A = reg->site[k];
+      bl = reg->bond[k];
+      br = reg->bond[k+1];
+
+      /* T(l1, s, r2) = sum E(l1, l2) A(l2, s, r2) */
+
+      T = quantum_mps_mmult(bl, bl, 2 * br, E, A);
+      free(E);
+
+      if(k == j)
+	{
+	  for(r=0; r<br; r++)
+	    {
+	      for(l=0; l<bl; l++)
+		{
+		  a[0] = op2.t[0] * MPS_AT(T, bl, l, 0, r) 
+		    + op2.t[1] * MPS_AT(T, bl, l, 1, r);
+		  a[1] = op2.t[2] * MPS_AT(T, bl, l, 0, r) 
+		    + op2.t[3] * MPS_AT(T, bl, l, 1, r);
+
+		  sum += quantum_conj(MPS_AT(A, bl, l, 0, r)) * a[0]
+		    + quantum_conj(MPS_AT(A, bl, l, 1, r)) * a[1];
+		}
+	    }
+
+	  quantum_free(T);
+	  break;
+	}
+
+      /* E(r1, r2) = sum conj(A(l1, s, r1)) T(l1, s, r2) */
+
+      F = calloc((size_t) br * br, sizeof(COMPLEX_FLOAT));
+
+      if(!F)
+	quantum_error(QUANTUM_ENOMEM);
+
+      for(r2=0; r2<br; r2++)
+	{
+	  for(r=0; r<br; r++)
+	    {
+	      for(s=0; s<2*bl; s++)
+		F[r + (long) br * r2] += quantum_conj(A[s + 2L * bl * r]) 
+		  * T[s + 2L * bl * r2];
+	    }
+	}
+
+      quantum_free(T);
+      E = F;
+    }
+
+  return sum / norm;
+}
+
+/* Contract a matrix product state into a regular quantum register.
+   Amplitudes with a probability below QUANTUM_MPS_CUTOFF^2 are
+   treated as numerical noise and dropped. */
+
+quantum_reg
+quantum_mps_to_qureg(quantum_mps_reg *reg)
+{
+  quantum_reg out;
+  COMPLEX_FLOAT *V, *W;
+  MAX_UNSIGNED n, x;
+  double norm, bound, f;
+  int i, size = 0;
+
+  if(reg->width + 2 > 30)
+    quantum_error(QUANTUM_EWIDTH);
+
+  norm = quantum_mps_norm(reg);
+
+  V = quantum_alloc(sizeof(COMPLEX_FLOAT));
+
+  if(!V)
+    quantum_error(QUANTUM_ENOMEM);
+
+  V[0] = 1;
+
+  /* V holds the partial amplitudes of the first I qubits, one row
+     for each of their basis states and one column for each value of
+     the open bond */
+
+  for(i=0, n=1; i<reg->width; i++, n*=2)
+    {
+      W = quantum_mps_mmult(n, reg->bond[i], 2 * reg->bond[i+1], V, 
+			    reg->site[i]);
+      quantum_free(V);
+      V = W;
+    }
+
+  bound = QUANTUM_MPS_CUTOFF * QUANTUM_MPS_CUTOFF * norm;
+
+  for(x=0; x<n; x++)
+    {
+      if(quantum_prob_inline(V[x]) >= bound)
+	size++;
+    }
+
+  out = quantum_new_qureg_sparse(size, reg->width);
+
+  /* Allocate the hash table */
+
+  out.hashw = reg->width + 2;
+  out.hash = quantum_calloc(1 << out.hashw, sizeof(int));
+
+  if(!out.hash)
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman((1 << out.hashw) * sizeof(int));
+
+  f = 1 / sqrt(norm);
+
+  for(x=0, size=0; x<n; x++)
+    {
+      if(quantum_prob_inline(V[x]) >= bound)
+	{
+	  out.state[size] = x;
+	  out.amplitude[size] = V[x] * f;
+	  size++;
+	}
+    }
+
+  quantum_free(V);
+
+  return out;
+}
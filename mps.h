@@ -0,0 +1,83 @@
+/* mps.h: Declarations for mps.c
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#ifndef __MPS_H
+
+#define __MPS_H
+
+#include "config.h"
+#include "matrix.h"
+#include "qureg.h"
+
+/* Singular values below this fraction of the largest one are
+   discarded after each two-qubit gate */
+
+#define QUANTUM_MPS_CUTOFF 1e-6
+
+/* A quantum register stored as a matrix product state */
+
+struct quantum_mps_reg_struct
+{
+  int width;    /* number of qubits in the qureg */
+  int maxbond;  /* maximum bond dimension, 0 if unlimited */
+  int center;   /* orthogonality center */
+  int *bond;    /* WIDTH+1 bond dimensions */
+  COMPLEX_FLOAT **site; /* one tensor per qubit */
+  double error; /* accumulated truncation error */
+};
+
+typedef struct quantum_mps_reg_struct quantum_mps_reg;
+
+extern quantum_mps_reg quantum_mps_new(MAX_UNSIGNED initval, int width, 
+				       int maxbond);
+extern void quantum_mps_delete(quantum_mps_reg *reg);
+
+extern void quantum_mps_gate1(int target, quantum_matrix m, 
+			      quantum_mps_reg *reg);
+extern void quantum_mps_gate2(int target1, int target2, quantum_matrix m, 
+			      quantum_mps_reg *reg);
+
+extern void quantum_mps_hadamard(int target, quantum_mps_reg *reg);
+extern void quantum_mps_sigma_x(int target, quantum_mps_reg *reg);
+extern void quantum_mps_sigma_y(int target, quantum_mps_reg *reg);
+extern void quantum_mps_sigma_z(int target, quantum_mps_reg *reg);
+extern void quantum_mps_r_x(int target, float gamma, quantum_mps_reg *reg);
+extern void quantum_mps_r_y(int target, float gamma, quantum_mps_reg *reg);
+extern void quantum_mps_r_z(int target, float gamma, quantum_mps_reg *reg);
+extern void quantum_mps_phase_kick(int target, float gamma, 
+				   quantum_mps_reg *reg);
+extern void quantum_mps_cnot(int control, int target, quantum_mps_reg *reg);
+extern void quantum_mps_cond_phase_kick(int control, int target, float gamma,
+					quantum_mps_reg *reg);
+
+extern MAX_UNSIGNED quantum_mps_measure(quantum_mps_reg *reg);
+extern int quantum_mps_bmeasure(int pos, quantum_mps_reg *reg);
+extern COMPLEX_FLOAT quantum_mps_expect1(int target, quantum_matrix op, 
+					 quantum_mps_reg *reg);
+extern COMPLEX_FLOAT quantum_mps_expect2(int target1, quantum_matrix op1, 
+					 int target2, quantum_matrix op2, 
+					 quantum_mps_reg *reg);
+
+extern quantum_reg quantum_mps_to_qureg(quantum_mps_reg *reg);
+
+#endif
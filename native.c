@@ -0,0 +1,750 @@
+/* native.c: Compile object code to native code
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "config.h"
+
+#ifdef HAVE_DLFCN_H
+#include <dlfcn.h>
+#endif
+
+#include "native.h"
+#include "circuit.h"
+#include "objcode.h"
+#include "matrix.h"
+#include "complex.h"
+#include "qureg.h"
+#include "gates.h"
+#include "decoherence.h"
+#include "qec.h"
+#include "checkpoint.h"
+#include "defer.h"
+#include "defs.h"
+#include "error.h"
+
+#define QUANTUM_STRING(x) #x
+#define QUANTUM_XSTRING(x) QUANTUM_STRING(x)
+
+/* Version of the generated code. It is part of the cache key, so it
+   has to be increased whenever the generator changes. */
+
+#define QUANTUM_NATIVE_VERSION 2
+
+#ifdef _OPENMP
+#define QUANTUM_NATIVE_CFLAGS "-O2 -shared -fPIC -fopenmp"
+#else
+#define QUANTUM_NATIVE_CFLAGS "-O2 -shared -fPIC"
+#endif
+
+typedef void (*quantum_native_function)(quantum_native_api *api, 
+					quantum_reg *reg);
+
+/* Callbacks for the generated code */
+
+static void
+quantum_native_exec(int op, int a0, int a1, int a2, double d, 
+		    MAX_UNSIGNED mu, quantum_reg *reg)
+{
+  quantum_objcode_insn insn;
+
+  insn.op = op;
+  insn.arg[0] = a0;
+  insn.arg[1] = a1;
+  insn.arg[2] = a2;
+  insn.d = d;
+  insn.mu = mu;
+
+  quantum_objcode_exec(&insn, reg);
+}
+
+static void
+quantum_native_regptr(quantum_reg *reg, int *size, COMPLEX_FLOAT **amplitude,
+		      MAX_UNSIGNED **state)
+{
+  *size = reg->size;
+  *amplitude = reg->amplitude;
+  *state = reg->state;
+}
+
+static quantum_native_api quantum_native_functions = {
+  quantum_native_exec,
+  quantum_native_regptr,
+  quantum_gate_counter
+};
+
+/* Gates which map each basis state to a single basis state, possibly
+   changing its phase. A run of these gates becomes one loop over the
+   register. */
+
+static int
+quantum_native_fusable(unsigned char op)
+{
+  switch(op)
+    {
+    case CNOT:
+    case TOFFOLI:
+    case MCTOFFOLI:
+    case SWAPBITS:
+    case BITREVERSE:
+    case SIGMA_X:
+    case SIGMA_Y:
+    case SIGMA_Z:
+    case ROT_Z:
+    case PHASE_KICK:
+    case PHASE_SCALE:
+    case COND_PHASE:
+    case CPHASE_KICK:
+      return 1;
+    default:
+      return 0;
+    }
+}
+
+/* Phase factor of a fusable gate, computed in the same way as by the
+   gate itself */
+
+static COMPLEX_FLOAT
+quantum_native_phase(quantum_objcode_insn *insn)
+{
+  switch(insn->op)
+    {
+    case ROT_Z:
+      return quantum_cexp((float) insn->d / 2);
+    case COND_PHASE:
+      return quantum_cexp(pi / ((MAX_UNSIGNED) 1 
+				<< (insn->arg[0] - insn->arg[1])));
+    default:
+      return quantum_cexp((float) insn->d);
+    }
+}
+
+/* Emit the function for the fusable gates INSN[0..N-1] */
+
+static void
+quantum_native_run(FILE *out, unsigned long k, quantum_objcode_insn *insn, 
+		   int n)
+{
+  int i, j, perm = 0, diag = 0;
+  MAX_UNSIGNED t;
+  COMPLEX_FLOAT z;
+
+  fprintf(out, "static void\nrun%lu(struct quantum_native_api_struct *api, "
+	  "quantum_reg *reg)\n{\n", k);
+  fprintf(out, "  int i, size;\n  COMPLEX_FLOAT *amplitude;\n"
+	  "  MAX_UNSIGNED *state;\n");
+
+  for(i=0; i<n; i++)
+    {
+      switch(insn[i].op)
+	{
+	case ROT_Z:
+	case PHASE_SCALE:
+	  z = quantum_native_phase(&insn[i]);
+	  fprintf(out, "  const COMPLEX_FLOAT z%i = %a + %a * IMAGINARY;\n", i,
+		  quantum_real(z), quantum_imag(z));
+	  break;
+
+	  /* Conditional phases are looked up by the condition, which
+	     avoids unpredictable branches */
+
+	case PHASE_KICK:
+	case COND_PHASE:
+	case CPHASE_KICK:
+	  z = quantum_native_phase(&insn[i]);
+	  fprintf(out, "  const COMPLEX_FLOAT z%i[2] = {1, %a + %a * IMAGINARY};"
+		  "\n", i, quantum_real(z), quantum_imag(z));
+	  break;
+	}
+    }
+
+  fprintf(out, "\n  api->regptr(reg, &size, &amplitude, &state);\n\n");
+  fprintf(out, "#ifdef _OPENMP\n#pragma omp parallel for\n#endif\n");
+  fprintf(out, "  for(i=0; i<size; i++)\n    {\n");
+  fprintf(out, "      MAX_UNSIGNED s = state[i], t;\n");
+  fprintf(out, "      COMPLEX_FLOAT a = amplitude[i];\n\n");
+
+  for(i=0; i<n; i++)
+    {
+      t = (MAX_UNSIGNED) 1 << insn[i].arg[0];
+
+      switch(insn[i].op)
+	{
+	case CNOT:
+	  fprintf(out, "      s ^= ((s >> %i) & 1) << %i;\n", insn[i].arg[0],
+		  insn[i].arg[1]);
+	  perm = 1;
+	  break;
+	case TOFFOLI:
+	  fprintf(out, "      s ^= ((s >> %i) & (s >> %i) & 1) << %i;\n", 
+		  insn[i].arg[0], insn[i].arg[1], insn[i].arg[2]);
+	  perm = 1;
+	  break;
+	case MCTOFFOLI:
+	  fprintf(out, "      s ^= (MAX_UNSIGNED) ((s & %#llxULL) == %#llxULL)"
+		  " << %i;\n", (unsigned long long) insn[i].mu, 
+		  (unsigned long long) insn[i].mu, insn[i].arg[0]);
+	  perm = 1;
+	  break;
+	case SWAPBITS:
+	  fprintf(out, "      t = ((s >> %i) ^ (s >> %i)) & 1;\n"
+		  "      s ^= (t << %i) | (t << %i);\n", insn[i].arg[0], 
+		  insn[i].arg[1], insn[i].arg[0], insn[i].arg[1]);
+	  perm = 1;
+	  break;
+	case BITREVERSE:
+	  fprintf(out, "      t = s & %#llxULL;\n", 
+		  (unsigned long long) ~(((MAX_UNSIGNED) 1 << insn[i].arg[0]) 
+					 - 1));
+	  for(j=0; j<insn[i].arg[0]; j++)
+	    fprintf(out, "      t |= ((s >> %i) & 1) << %i;\n", j, 
+		    insn[i].arg[0] - j - 1);
+	  fprintf(out, "      s = t;\n");
+	  perm = 1;
+	  break;
+	case SIGMA_X:
+	  fprintf(out, "      s ^= %#llxULL;\n", (unsigned long long) t);
+	  perm = 1;
+	  break;
+	case SIGMA_Y:
+	  fprintf(out, "      s ^= %#llxULL;\n      if(s & %#llxULL)\n"
+		  "\ta *= IMAGINARY;\n      else\n\ta *= -IMAGINARY;\n",
+		  (unsigned long long) t, (unsigned long long) t);
+	  perm = diag = 1;
+	  break;
+	case SIGMA_Z:
+	  fprintf(out, "      a *= 1 - 2 * (int) ((s >> %i) & 1);\n", 
+		  insn[i].arg[0]);
+	  diag = 1;
+	  break;
+	case ROT_Z:
+	  fprintf(out, "      if(s & %#llxULL)\n\ta *= z%i;\n      else\n"
+		  "\ta /= z%i;\n", (unsigned long long) t, i, i);
+	  diag = 1;
+	  break;
+	case PHASE_KICK:
+	  fprintf(out, "      a *= z%i[(s >> %i) & 1];\n", i, insn[i].arg[0]);
+	  diag = 1;
+	  break;
+	case PHASE_SCALE:
+	  fprintf(out, "      a *= z%i;\n", i);
+	  diag = 1;
+	  break;
+	case COND_PHASE:
+	case CPHASE_KICK:
+	  fprintf(out, "      a *= z%i[(s >> %i) & (s >> %i) & 1];\n", i, 
+		  insn[i].arg[0], insn[i].arg[1]);
+	  diag = 1;
+	  break;
+	}
+    }
+
+  fprintf(out, "\n");
+
+  if(perm)
+    fprintf(out, "      state[i] = s;\n");
+  if(diag)
+    fprintf(out, "      amplitude[i] = a;\n");
+
+  fprintf(out, "    }\n\n  api->gate_counter(%i);\n}\n\n", n);
+}
+
+/* Generate the C source of a circuit. Runs of fusable gates become
+   specialized loops with constant bit masks and phases, all other
+   instructions call back into the library. */
+
+static void
+quantum_native_generate(FILE *out, char *file, quantum_circuit *circ)
+{
+  unsigned long i, j, k;
+
+  fprintf(out, "/* Generated by libquantum from %s. Do not edit. */\n\n", 
+	  file);
+  fprintf(out, "#include <complex.h>\n\n");
+  fprintf(out, "#define COMPLEX_FLOAT %s\n", QUANTUM_XSTRING(COMPLEX_FLOAT));
+  fprintf(out, "#define MAX_UNSIGNED %s\n", QUANTUM_XSTRING(MAX_UNSIGNED));
+  fprintf(out, "#define IMAGINARY %s\n\n", QUANTUM_XSTRING(IMAGINARY));
+  fprintf(out, "typedef struct quantum_reg_struct quantum_reg;\n\n");
+  fprintf(out, "struct quantum_native_api_struct\n{\n"
+	  "  void (*exec)(int op, int a0, int a1, int a2, double d, "
+	  "MAX_UNSIGNED mu,\n\t       quantum_reg *reg);\n"
+	  "  void (*regptr)(quantum_reg *reg, int *size, "
+	  "COMPLEX_FLOAT **amplitude,\n\t\t MAX_UNSIGNED **state);\n"
+	  "  int (*gate_counter)(int inc);\n};\n\n");
+
+  for(i=0, k=0; i<circ->num; i=j)
+    {
+      for(j=i; j<circ->num && j-i < QUANTUM_NATIVE_RUN 
+	    && quantum_native_fusable(circ->insn[j].op); j++);
+
+      if(j > i)
+	quantum_native_run(out, k++, &circ->insn[i], j - i);
+      else
+	j++;
+    }
+
+  fprintf(out, "void\nquantum_native_run(struct quantum_native_api_struct "
+	  "*api, quantum_reg *reg)\n{\n");
+
+  for(i=0, k=0; i<circ->num; i=j)
+    {
+      for(j=i; j<circ->num && j-i < QUANTUM_NATIVE_RUN 
+	    && quantum_native_fusable(circ->insn[j].op); j++);
+
+      if(j > i)
+	fprintf(out, "  run%lu(api, reg);\n", k++);
+      else
+	{
+	  fprintf(out, "  api->exec(%i, %i, %i, %i, %a, %lluULL, reg);\n",
+		  circ->insn[i].op, circ->insn[i].arg[0], circ->insn[i].arg[1],
+		  circ->insn[i].arg[2], circ->insn[i].d, 
+		  (unsigned long long) circ->insn[i].mu);
+	  j++;
+	}
+    }
+
+  fprintf(out, "}\n");
+}
+
+/* Return the compiler given by the environment variable CC and the
+   flags given by QUOBCFLAGS */
+
+static char *
+quantum_native_cc()
+{
+  char *cc = getenv("CC");
+
+  return (cc && *cc) ? cc : "cc";
+}
+
+static char *
+quantum_native_cflags()
+{
+  char *cflags = getenv("QUOBCFLAGS");
+
+  return cflags ? cflags : QUANTUM_NATIVE_CFLAGS;
+}
+
+/* Run the compiler on SRC, writing the shared library LIB. The
+   command line is split into words at blanks and passed to the
+   compiler directly, without a shell. Returns 0 on success. */
+
+static int
+quantum_native_cc_run(char *src, char *lib)
+{
+  char *cc, *cflags, **argv, *p;
+  int i, status;
+  pid_t pid;
+
+  cc = strdup(quantum_native_cc());
+  cflags = strdup(quantum_native_cflags());
+
+  if(!(cc && cflags))
+    quantum_error(QUANTUM_ENOMEM);
+
+  argv = malloc((strlen(cc) + strlen(cflags) + 6) * sizeof(char *));
+
+  if(!argv)
+    quantum_error(QUANTUM_ENOMEM);
+
+  i = 0;
+
+  for(p=strtok(cc, " \t"); p; p=strtok(0, " \t"))
+    argv[i++] = p;
+
+  if(!i)
+    argv[i++] = "cc";
+
+  for(p=strtok(cflags, " \t"); p; p=strtok(0, " \t"))
+    argv[i++] = p;
+
+  argv[i++] = "-o";
+  argv[i++] = lib;
+  argv[i++] = src;
+  argv[i] = 0;
+
+  pid = fork();
+
+  if(!pid)
+    {
+      execvp(argv[0], argv);
+      _exit(127);
+    }
+
+  if((pid < 0) || (waitpid(pid, &status, 0) != pid))
+    status = -1;
+
+  free(cc);
+  free(cflags);
+  free(argv);
+
+  return (status >= 0 && WIFEXITED(status) && !WEXITSTATUS(status)) ? 0 : -1;
+}
+
+/* Compile the object code file FILE into the shared library LIB, using
+   the compiler given by the environment variable CC and the flags
+   given by QUOBCFLAGS. The generated source is written to a new file
+   next to LIB, which is removed afterwards. Returns 0 on success. */
+
+int
+quantum_objcode_compile(char *file, char *lib)
+{
+  quantum_circuit circ;
+  FILE *out;
+  char *src;
+  int fd, ret;
+
+  circ = quantum_new_circuit();
+
+  if(quantum_circuit_load(file, &circ))
+    return -1;
+
+  src = malloc(strlen(lib) + 10);
+
+  if(!src)
+    quantum_error(QUANTUM_ENOMEM);
+
+  sprintf(src, "%s-XXXXXX.c", lib);
+
+  fd = mkstemps(src, 2);
+  out = (fd < 0) ? 0 : fdopen(fd, "w");
+
+  if(!out)
+    {
+      fprintf(stderr, "quantum_objcode_compile: Could not write %s\n", src);
+
+      if(fd >= 0)
+	{
+	  close(fd);
+	  unlink(src);
+	}
+
+      free(src);
+      quantum_delete_circuit(&circ);
+      return -1;
+    }
+
+  quantum_native_generate(out, file, &circ);
+
+  ret = fclose(out);
+  quantum_delete_circuit(&circ);
+
+  if(!ret)
+    ret = quantum_native_cc_run(src, lib);
+
+  unlink(src);
+  free(src);
+
+  return ret ? -1 : 0;
+}
+
+/* Add the string S, including its terminating null byte, to the FNV-1a
+   hash H */
+
+static unsigned long long
+quantum_native_hash_string(unsigned long long h, char *s)
+{
+  do
+    {
+      h ^= (unsigned char) *s;
+      h *= 1099511628211ULL;
+    }
+  while(*s++);
+
+  return h;
+}
+
+/* 64 bit FNV-1a hash of a file, which is used as the cache key */
+
+static int
+quantum_native_hash(char *file, unsigned long long *hash)
+{
+  FILE *fhd;
+  int c;
+  unsigned long long h = 14695981039346656037ULL;
+  char key[64];
+
+  fhd = fopen(file, "r");
+
+  if(!fhd)
+    return -1;
+
+  while((c = fgetc(fhd)) != EOF)
+    {
+      h ^= c;
+      h *= 1099511628211ULL;
+    }
+
+  fclose(fhd);
+
+  /* Include everything the generated code depends on */
+
+  sprintf(key, "%i %i %i", QUANTUM_NATIVE_VERSION, 
+	  (int) sizeof(COMPLEX_FLOAT), (int) sizeof(MAX_UNSIGNED));
+
+  h = quantum_native_hash_string(h, key);
+  h = quantum_native_hash_string(h, quantum_native_cc());
+  h = quantum_native_hash_string(h, quantum_native_cflags());
+
+  *hash = h;
+
+  return 0;
+}
+
+#ifdef HAVE_DLFCN_H
+
+/* The most recently loaded circuit, so that repeated runs of the same
+   file neither hash nor load it again */
+
+static char *native_file = 0;
+static struct stat native_stat;
+static void *native_handle = 0;
+static quantum_native_function native_run = 0;
+
+/* Check whether PATH is a directory (if DIR is set) or a regular file
+   owned by the current user, which no one else may write to. Only
+   such files are loaded, as anyone who can change them can run code
+   in this process. */
+
+static int
+quantum_native_private(char *path, int dir)
+{
+  struct stat st;
+
+  if(dir ? stat(path, &st) : lstat(path, &st))
+    return 0;
+
+  if(dir ? !S_ISDIR(st.st_mode) : !S_ISREG(st.st_mode))
+    return 0;
+
+  return (st.st_uid == getuid()) && !(st.st_mode & (S_IWGRP | S_IWOTH));
+}
+
+/* Return the cache directory for compiled circuits, which is given by
+   QUOBCACHE and defaults to libquantum in the cache directory of the
+   user. Missing directories are created, accessible to the user
+   only. Returns 0 if there is no usable cache directory. */
+
+static char *
+quantum_native_cachedir()
+{
+  char *dir, *base, *p;
+
+  base = getenv("QUOBCACHE");
+
+  if(base && *base)
+    dir = strdup(base);
+  else if((base = getenv("XDG_CACHE_HOME")) && *base)
+    {
+      dir = malloc(strlen(base) + 12);
+
+      if(dir)
+	sprintf(dir, "%s/libquantum", base);
+    }
+  else if((base = getenv("HOME")) && *base)
+    {
+      dir = malloc(strlen(base) + 19);
+
+      if(dir)
+	sprintf(dir, "%s/.cache/libquantum", base);
+    }
+  else
+    return 0;
+
+  if(!dir)
+    quantum_error(QUANTUM_ENOMEM);
+
+  for(p=dir+1; *p; p++)
+    {
+      if(*p == '/')
+	{
+	  *p = 0;
+	  mkdir(dir, 0700);
+	  *p = '/';
+	}
+    }
+
+  mkdir(dir, 0700);
+
+  if(!quantum_native_private(dir, 1))
+    {
+      fprintf(stderr, "quantum_objcode_run_native: Cache directory %s is "
+	      "not private\n", dir);
+      free(dir);
+      return 0;
+    }
+
+  return dir;
+}
+
+/* Load the compiled version of FILE, compiling it if it is not in the
+   cache directory (see quantum_native_cachedir) */
+
+static quantum_native_function
+quantum_native_load(char *file)
+{
+  struct stat st, libst;
+  unsigned long long hash;
+  char *dir, *lib, *tmp;
+  void *handle;
+  quantum_native_function run;
+  int fd;
+
+  if(stat(file, &st))
+    return 0;
+
+  if(native_run && !strcmp(file, native_file) 
+     && st.st_ino == native_stat.st_ino && st.st_size == native_stat.st_size
+     && st.st_mtime == native_stat.st_mtime)
+    return native_run;
+
+  if(quantum_native_hash(file, &hash))
+    return 0;
+
+  dir = quantum_native_cachedir();
+
+  if(!dir)
+    return 0;
+
+  lib = malloc(strlen(dir) + 64);
+  tmp = malloc(strlen(dir) + 64);
+
+  if(!(lib && tmp))
+    quantum_error(QUANTUM_ENOMEM);
+
+  sprintf(lib, "%s/libquob-%016llx.so", dir, hash);
+  free(dir);
+
+  /* Compile to a temporary name first, as other processes may use the
+     same cache */
+
+  if(lstat(lib, &libst))
+    {
+      sprintf(tmp, "%s-XXXXXX", lib);
+
+      fd = mkstemp(tmp);
+
+      if((fd < 0) || close(fd) || quantum_objcode_compile(file, tmp) 
+	 || rename(tmp, lib))
+	{
+	  if(fd >= 0)
+	    unlink(tmp);
+
+	  free(lib);
+	  free(tmp);
+	  return 0;
+	}
+    }
+
+  if(!quantum_native_private(lib, 0))
+    {
+      fprintf(stderr, "quantum_objcode_run_native: Not loading %s, which "
+	      "is not private\n", lib);
+      free(lib);
+      free(tmp);
+      return 0;
+    }
+
+  handle = dlopen(lib, RTLD_NOW | RTLD_LOCAL);
+
+  free(lib);
+  free(tmp);
+
+  if(!handle)
+    {
+      fprintf(stderr, "quantum_objcode_run_native: %s\n", dlerror());
+      return 0;
+    }
+
+  *(void **) (&run) = dlsym(handle, "quantum_native_run");
+
+  if(!run)
+    {
+      dlclose(handle);
+      return 0;
+    }
+
+  if(native_handle)
+    dlclose(native_handle);
+
+  free(native_file);
+  native_file = strdup(file);
+  native_stat = st;
+  native_handle = handle;
+  native_run = run;
+
+  return run;
+}
+
+#endif /* HAVE_DLFCN_H */
+
+/* Execute the contents of an object code file as native code. The
+   file is compiled on first use and cached, see quantum_native_load.
+   The interpreter is used instead if the circuit cannot be compiled,
+   or if decoherence, quantum error correction, object code recording
+   or automatic checkpointing is active, as these act on every single
+   gate, or if the gates of the register are queued or do not act on
+   its state vector (see quantum_flush_pending). */
+
+void
+quantum_objcode_run_native(char *file, quantum_reg *reg)
+{
+  quantum_native_function run = 0;
+  struct timeval start, end;
+  int qec;
+  double t;
+
+  quantum_qec_get_status(&qec, NULL);
+
+#ifdef HAVE_DLFCN_H
+  if(!qec && !quantum_status && !quantum_objcode_status()
+     && !quantum_checkpoint_active() && !quantum_flush_pending(reg))
+    run = quantum_native_load(file);
+#endif
+
+  if(!run)
+    {
+      quantum_objcode_resume(file, 0, reg);
+      return;
+    }
+
+  gettimeofday(&start, 0);
+
+  run(&quantum_native_functions, reg);
+
+  gettimeofday(&end, 0);
+
+  if(getenv("QUOBSTATS"))
+    {
+      t = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+      fprintf(stderr, "quantum_objcode_run_native: %.3f s\n", t);
+    }
+}
@@ -0,0 +1,55 @@
+/* native.h: Declarations for native.c
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#ifndef __NATIVE_H
+
+#define __NATIVE_H
+
+#include "config.h"
+#include "qureg.h"
+
+/* Maximum number of gates fused into a single loop over the basis
+   states */
+
+#define QUANTUM_NATIVE_RUN 256
+
+/* Functions of the library which are used by compiled circuits. The
+   register is opaque to the generated code; it has to fetch the
+   current arrays through REGPTR after each call to EXEC. The layout
+   of this structure is repeated in the generated code. */
+
+struct quantum_native_api_struct
+{
+  void (*exec)(int op, int a0, int a1, int a2, double d, MAX_UNSIGNED mu, 
+	       quantum_reg *reg);
+  void (*regptr)(quantum_reg *reg, int *size, COMPLEX_FLOAT **amplitude, 
+		 MAX_UNSIGNED **state);
+  int (*gate_counter)(int inc);
+};
+
+typedef struct quantum_native_api_struct quantum_native_api;
+
+extern int quantum_objcode_compile(char *file, char *lib);
+extern void quantum_objcode_run_native(char *file, quantum_reg *reg);
+
+#endif
@@ -25,6 +25,14 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#ifdef _POSIX_MAPPED_FILES
+#include <sys/mman.h>
+#endif
 
 #include "objcode.h"
 #include "config.h"
@@ -33,6 +41,13 @@
 #include "gates.h"
 #include "measure.h"
 #include "error.h"
+#include "compress.h"
+#include "native.h"
+#include "defer.h"
+#include "stabilizer.h"
+#include "dd.h"
+#include "product.h"
+#include "remap.h"
 
 /* status of the objcode functionality (0 = disabled) */
 
@@ -54,6 +69,20 @@ unsigned long allocated = 0;
 
 char *globalfile;
 
+/* Number of instructions recorded so far */
+
+static unsigned long objcount = 0;
+
+/* Width of the quantum register of the first INIT instruction */
+
+static int objwidth = 0;
+
+/* Offsets and first instructions of the recorded blocks */
+
+static unsigned long *blockpos = 0;
+static unsigned long *blockinsn = 0;
+static unsigned long blocks = 0;
+
 /* Convert a big integer to a byte array */
 
 void
@@ -132,6 +161,157 @@ double quantum_char2double(unsigned char *buf)
 }
 
 
+/* Operand layout of each opcode: the file format versions in which
+   the opcode is valid, the number of integer arguments, and whether an
+   angle or a MAX_UNSIGNED follows. Opcodes which are not listed here
+   are invalid. */
+
+#define V1 (1 << 1)
+#define V2 (1 << 2)
+
+static const struct
+{
+  char valid;
+  char ints;
+  char dbl;
+  char mu;
+} quantum_objcode_format[256] = {
+  [INIT]        = {V1|V2, 0, 0, 1},
+  [CNOT]        = {V1|V2, 2, 0, 0},
+  [TOFFOLI]     = {V1|V2, 3, 0, 0},
+  [SIGMA_X]     = {V1|V2, 1, 0, 0},
+  [SIGMA_Y]     = {V1|V2, 1, 0, 0},
+  [SIGMA_Z]     = {V1|V2, 1, 0, 0},
+  [HADAMARD]    = {V1|V2, 1, 0, 0},
+  [ROT_X]       = {V1|V2, 1, 1, 0},
+  [ROT_Y]       = {V1|V2, 1, 1, 0},
+  [ROT_Z]       = {V1|V2, 1, 1, 0},
+  [PHASE_KICK]  = {V1|V2, 1, 1, 0},
+  [PHASE_SCALE] = {V1|V2, 1, 1, 0},
+  [COND_PHASE]  = {V1|V2, 2, 0, 0},
+  [CPHASE_KICK] = {V1|V2, 2, 1, 0},
+  [SWAPLEADS]   = {V1|V2, 1, 0, 0},
+  [ADDSCRATCH]  = {V2, 1, 0, 0},
+  [MCTOFFOLI]   = {V2, 1, 0, 1},
+  [SWAPBITS]    = {V2, 2, 0, 0},
+  [BITREVERSE]  = {V2, 1, 0, 0},
+  [MEASURE]     = {V1|V2, 0, 0, 0},
+  [BMEASURE]    = {V1|V2, 1, 0, 0},
+  [BMEASURE_P]  = {V1|V2, 1, 0, 0},
+  [NOP]         = {V1|V2, 0, 0, 0}
+};
+
+/* Big-endian fixed size fields of the file header and block index */
+
+static void
+quantum_objcode_put32(unsigned long l, unsigned char *buf)
+{
+  int i;
+
+  for(i=0; i<4; i++)
+    buf[i] = (l >> (8 * (3 - i))) & 0xFF;
+}
+
+static void
+quantum_objcode_put64(unsigned long long l, unsigned char *buf)
+{
+  int i;
+
+  for(i=0; i<8; i++)
+    buf[i] = (l >> (8 * (7 - i))) & 0xFF;
+}
+
+static unsigned long
+quantum_objcode_get32(unsigned char *buf)
+{
+  int i;
+  unsigned long l = 0;
+
+  for(i=0; i<4; i++)
+    l = (l << 8) | buf[i];
+
+  return l;
+}
+
+static unsigned long long
+quantum_objcode_get64(unsigned char *buf)
+{
+  int i;
+  unsigned long long l = 0;
+
+  for(i=0; i<8; i++)
+    l = (l << 8) | buf[i];
+
+  return l;
+}
+
+/* Store an unsigned integer as a varint (7 bits per byte, least
+   significant group first, high bit set on all but the last byte) */
+
+static int
+quantum_objcode_putvarint(MAX_UNSIGNED mu, unsigned char *buf)
+{
+  int i = 0;
+
+  while(mu >= 0x80)
+    {
+      buf[i++] = (mu & 0x7F) | 0x80;
+      mu >>= 7;
+    }
+
+  buf[i++] = mu;
+
+  return i;
+}
+
+static inline MAX_UNSIGNED
+quantum_objcode_getvarint(unsigned char **buf)
+{
+  int shift = 0;
+  MAX_UNSIGNED mu = 0;
+  unsigned char *p = *buf;
+
+  do
+    {
+      mu |= (MAX_UNSIGNED) (*p & 0x7F) << shift;
+      shift += 7;
+    } while(*p++ & 0x80);
+
+  *buf = p;
+
+  return mu;
+}
+
+/* Angles are passed to the gates as floats, so they are stored as
+   little-endian IEEE single precision numbers without loss */
+
+static int
+quantum_objcode_putfloat(double d, unsigned char *buf)
+{
+  int i;
+  float f = d;
+  unsigned int u;
+
+  memcpy(&u, &f, sizeof(float));
+
+  for(i=0; i<4; i++)
+    buf[i] = (u >> (8 * i)) & 0xFF;
+
+  return 4;
+}
+
+static inline double
+quantum_objcode_getfloat(unsigned char *buf)
+{
+  float f;
+  unsigned int u;
+
+  u = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((unsigned int) buf[3] << 24);
+  memcpy(&f, &u, sizeof(float));
+
+  return f;
+}
+
 /* Start object code recording */
 
 void
@@ -139,6 +319,10 @@ quantum_objcode_start()
 {
   opstatus = 1;
   allocated = 1;
+  position = 0;
+  objcount = 0;
+  objwidth = 0;
+  blocks = 0;
   objcode = malloc(OBJCODE_PAGE * sizeof(char));
 
   if(!objcode)
@@ -157,87 +341,68 @@ quantum_objcode_stop()
   objcode = 0;
   quantum_memman(- allocated * OBJCODE_PAGE * sizeof(char));
   allocated = 0;
+
+  free(blockpos);
+  free(blockinsn);
+  quantum_memman(- blocks * 2 * sizeof(unsigned long));
+  blockpos = 0;
+  blockinsn = 0;
+  blocks = 0;
 }
 
-/* Store an operation with its arguments in the object code data */
+/* Store a decoded instruction in the object code data. The data is
+   kept in the version 2 encoding and split into blocks of about
+   OBJCODE_BLOCK bytes, which start at instruction boundaries. */
 
 int
-quantum_objcode_put(unsigned char operation, ...)
+quantum_objcode_put_insn(quantum_objcode_insn *insn)
 {
   int i, size = 0;
-  va_list args;
-  unsigned char buf[80];
-  double d;
-  MAX_UNSIGNED mu;
+  unsigned char buf[OBJBUF_SIZE];
 
   if(!opstatus)
     return 0;
 
-  va_start(args, operation);
-  
-  buf[0] = operation;
-  
-  switch(operation)
+  if(!(quantum_objcode_format[insn->op].valid & V2))
+    quantum_error(QUANTUM_EOPCODE);
+
+  buf[size++] = insn->op;
+
+  for(i=0; i<quantum_objcode_format[insn->op].ints; i++)
+    size += quantum_objcode_putvarint((unsigned int) insn->arg[i], 
+				      &buf[size]);
+
+  if(quantum_objcode_format[insn->op].dbl)
+    size += quantum_objcode_putfloat(insn->d, &buf[size]);
+
+  if(quantum_objcode_format[insn->op].mu)
+    size += quantum_objcode_putvarint(insn->mu, &buf[size]);
+
+  /* INIT is followed by the width of the new register */
+
+  if(insn->op == INIT)
+    {
+      size += quantum_objcode_putvarint(insn->arg[0], &buf[size]);
+
+      if(!objcount)
+	objwidth = insn->arg[0];
+    }
+
+  /* Start a new block if necessary */
+
+  if(!blocks || position + size - blockpos[blocks-1] > OBJCODE_BLOCK)
     {
-    case INIT:
-      mu = va_arg(args, MAX_UNSIGNED);
-      quantum_mu2char(mu, &buf[1]);
-      size = sizeof(MAX_UNSIGNED) + 1;
-      break;
-    case CNOT:
-    case COND_PHASE:
-      i = va_arg(args, int);
-      quantum_int2char(i, &buf[1]);
-      i = va_arg(args, int);
-      quantum_int2char(i, &buf[sizeof(int)+1]);
-      size = 2 * sizeof(int) + 1;
-      break;
-    case TOFFOLI:
-      i = va_arg(args, int);
-      quantum_int2char(i, &buf[1]);
-      i = va_arg(args, int);
-      quantum_int2char(i, &buf[sizeof(int)+1]);
-      i = va_arg(args, int);
-      quantum_int2char(i, &buf[2*sizeof(int)+1]);
-      size = 3 * sizeof(int) + 1;
-      break;
-    case SIGMA_X:
-    case SIGMA_Y:
-    case SIGMA_Z:
-    case HADAMARD:
-    case BMEASURE:
-    case BMEASURE_P:
-    case SWAPLEADS:
-      i = va_arg(args, int);
-      quantum_int2char(i, &buf[1]);
-      size = sizeof(int) + 1;
-      break;
-    case ROT_X:
-    case ROT_Y:
-    case ROT_Z:
-    case PHASE_KICK:
-    case PHASE_SCALE:
-      i = va_arg(args, int);
-      d = va_arg(args, double);
-      quantum_int2char(i, &buf[1]);
-      quantum_double2char(d, &buf[sizeof(int)+1]);
-      size = sizeof(int) + sizeof(double) + 1;
-      break;
-    case CPHASE_KICK:
-      i = va_arg(args, int);
-      quantum_int2char(i, &buf[1]);
-      i = va_arg(args, int);
-      quantum_int2char(i, &buf[sizeof(int)+1]);
-      d = va_arg(args, double);
-      quantum_double2char(d, &buf[2*sizeof(int)+1]);
-      size = 2 * sizeof(int) + sizeof(double) + 1;
-      break;
-    case MEASURE:
-    case NOP:
-      size = 1;
-      break;
-    default:
-      quantum_error(QUANTUM_EOPCODE);
+      blockpos = realloc(blockpos, (blocks + 1) * sizeof(unsigned long));
+      blockinsn = realloc(blockinsn, (blocks + 1) * sizeof(unsigned long));
+
+      if(!(blockpos && blockinsn))
+	quantum_error(QUANTUM_ENOMEM);
+
+      quantum_memman(2 * sizeof(unsigned long));
+
+      blockpos[blocks] = position;
+      blockinsn[blocks] = objcount;
+      blocks++;
     }
   
   if((position+size) / OBJCODE_PAGE > position / OBJCODE_PAGE)
@@ -251,21 +416,137 @@ quantum_objcode_put(unsigned char operation, ...)
       quantum_memman(OBJCODE_PAGE * sizeof(char));
     }
 
-  for(i=0; i<size; i++)
-    {
-      objcode[position] = buf[i];
-      position++;
-    }
+  memcpy(&objcode[position], buf, size);
+  position += size;
+  objcount++;
 
   return 1;
 }
 
-/* Save the recorded object code data to a file */
+/* Fetch the arguments of an operation from ARGS. For INIT, the width
+   of the new register follows the initial value. */
+
+static void
+quantum_objcode_args(unsigned char operation, va_list args, 
+		     quantum_objcode_insn *insn)
+{
+  int i;
+
+  if(!(quantum_objcode_format[operation].valid & V2))
+    quantum_error(QUANTUM_EOPCODE);
+
+  insn->op = operation;
+
+  for(i=0; i<quantum_objcode_format[operation].ints; i++)
+    insn->arg[i] = va_arg(args, int);
+
+  if(quantum_objcode_format[operation].dbl)
+    insn->d = va_arg(args, double);
+
+  if(quantum_objcode_format[operation].mu)
+    insn->mu = va_arg(args, MAX_UNSIGNED);
+
+  if(operation == INIT)
+    insn->arg[0] = va_arg(args, int);
+}
+
+/* Store an operation with its arguments in the object code data */
+
+int
+quantum_objcode_put(unsigned char operation, ...)
+{
+  va_list args;
+  quantum_objcode_insn insn;
+
+  if(!opstatus)
+    return 0;
+
+  va_start(args, operation);
+  quantum_objcode_args(operation, args, &insn);
+  va_end(args);
+
+  return quantum_objcode_put_insn(&insn);
+}
+
+/* Same as above, for a gate acting on REG. If the gates of REG are
+   deferred (see defer.c), the gate is queued instead. If REG is
+   simulated with a stabilizer tableau (see stabilizer.c), represented
+   by a decision diagram (see dd.c), kept as a product (see product.c)
+   or has a qubit map (see remap.c), the gate is applied to the
+   tableau, the diagram, the factors or the mapped bits if possible. In all these cases, 1 is returned and
+   the caller must not execute the gate. */
+
+int
+quantum_objcode_putreg(quantum_reg *reg, unsigned char operation, ...)
+{
+  va_list args;
+  quantum_objcode_insn insn;
+
+  if(!opstatus && !quantum_defer_active(reg) 
+     && !quantum_stabilizer_active(reg) && !quantum_dd_active(reg)
+     && !quantum_product_active(reg) && !quantum_remap_active(reg))
+    return 0;
+
+  va_start(args, operation);
+  quantum_objcode_args(operation, args, &insn);
+  va_end(args);
+
+  if(opstatus)
+    return quantum_objcode_put_insn(&insn);
+
+  if(quantum_defer_put(reg, &insn))
+    return 1;
+
+  if(quantum_stabilizer_put(reg, &insn))
+    return 1;
+
+  if(quantum_dd_put(reg, &insn))
+    return 1;
+
+  if(quantum_product_put(reg, &insn))
+    return 1;
+
+  return quantum_remap_put(reg, &insn);
+}
+
+/* Return non-zero if object code recording is active */
+
+int
+quantum_objcode_status()
+{
+  return opstatus;
+}
+
+/* Save the recorded object code data to a file. The file starts with
+   a header of QUOB_HEADER bytes:
+
+     0  "QUOB"
+     4  format version (2)
+     5  flags (QUOB_COMPRESSED)
+     6  reserved
+     8  width of the quantum register (32 bit)
+    12  number of blocks (32 bit)
+    16  offset of the block index (64 bit)
+
+   It is followed by the blocks and the index, which contains an entry
+   of QUOB_ENTRY bytes for each block:
+
+     0  number of the first instruction in the block (64 bit)
+     8  offset of the block in the file (64 bit)
+    16  size of the block in the file (32 bit)
+    20  size of the uncompressed block (32 bit)
+
+   All fields are big-endian. If the environment variable QUOBCOMPRESS
+   is set, blocks are compressed whenever this saves space. */
 
 int
 quantum_objcode_write(char *file)
 {
   FILE *fhd;
+  unsigned char header[QUOB_HEADER];
+  unsigned char *index, *buf = 0, *data;
+  unsigned long i, raw, len, offset;
+  int compress;
 
   if(!opstatus)
     {
@@ -281,10 +562,66 @@ quantum_objcode_write(char *file)
   if (fhd == 0)
     return -1;
 
-  fwrite(objcode, position, 1, fhd);
+  compress = getenv("QUOBCOMPRESS") != 0;
+
+  index = calloc(blocks + 1, QUOB_ENTRY);
+
+  if(compress)
+    buf = malloc(QUANTUM_COMPRESS_BOUND(OBJCODE_BLOCK + OBJBUF_SIZE));
+
+  if(!index || (compress && !buf))
+    quantum_error(QUANTUM_ENOMEM);
+
+  memset(header, 0, QUOB_HEADER);
+  fwrite(header, QUOB_HEADER, 1, fhd);
+
+  offset = QUOB_HEADER;
+
+  for(i=0; i<blocks; i++)
+    {
+      raw = (i+1 < blocks ? blockpos[i+1] : position) - blockpos[i];
+      data = &objcode[blockpos[i]];
+      len = raw;
+
+      /* Blocks which do not shrink are stored uncompressed */
+
+      if(compress)
+	{
+	  len = quantum_compress(data, raw, buf);
+
+	  if(len < raw)
+	    data = buf;
+	  else
+	    len = raw;
+	}
+
+      fwrite(data, len, 1, fhd);
+
+      quantum_objcode_put64(blockinsn[i], &index[i*QUOB_ENTRY]);
+      quantum_objcode_put64(offset, &index[i*QUOB_ENTRY+8]);
+      quantum_objcode_put32(len, &index[i*QUOB_ENTRY+16]);
+      quantum_objcode_put32(raw, &index[i*QUOB_ENTRY+20]);
+
+      offset += len;
+    }
+
+  fwrite(index, QUOB_ENTRY, blocks, fhd);
+
+  memcpy(header, "QUOB", 4);
+  header[4] = 2;
+  header[5] = compress ? QUOB_COMPRESSED : 0;
+  quantum_objcode_put32(objwidth, &header[8]);
+  quantum_objcode_put32(blocks, &header[12]);
+  quantum_objcode_put64(offset, &header[16]);
+
+  fseek(fhd, 0, SEEK_SET);
+  fwrite(header, QUOB_HEADER, 1, fhd);
 
   fclose(fhd);
 
+  free(index);
+  free(buf);
+
   return 0;
 }
 
@@ -306,191 +643,656 @@ quantum_objcode_exit(char *file)
   quantum_objcode_stop();
 }
 
-/* Execute the contents of an object code file */
+/* Number of bytes occupied by a version 1 instruction, including the
+   opcode */
 
-void
-quantum_objcode_run(char *file, quantum_reg *reg)
+static inline int
+quantum_objcode_length1(unsigned char operation)
 {
-  int i, j, k, l;
-  FILE *fhd;
-  unsigned char operation;
-  unsigned char buf[OBJBUF_SIZE];
+  return 1 + quantum_objcode_format[operation].ints * sizeof(int)
+    + quantum_objcode_format[operation].dbl * sizeof(double)
+    + quantum_objcode_format[operation].mu * sizeof(MAX_UNSIGNED);
+}
+
+/* Number of bytes occupied by the version 2 instruction at BUF, or -1
+   if it is not a valid instruction within the LEN bytes available */
+
+static int
+quantum_objcode_length2(unsigned char *buf, unsigned long len)
+{
+  int i, j, n;
+  unsigned long p = 1;
+
+  if(!(quantum_objcode_format[buf[0]].valid & V2))
+    return -1;
+
+  n = quantum_objcode_format[buf[0]].ints + quantum_objcode_format[buf[0]].mu;
+
+  if(buf[0] == INIT)
+    n++;
+
+  for(i=0; i<n; i++)
+    {
+      for(j=0; ; j++)
+	{
+	  if(p >= len || j >= (sizeof(MAX_UNSIGNED) * 8 + 6) / 7)
+	    return -1;
+	  if(!(buf[p++] & 0x80))
+	    break;
+	}
+    }
+
+  if(quantum_objcode_format[buf[0]].dbl)
+    p += 4;
+
+  if(p > len)
+    return -1;
+
+  return p;
+}
+
+/* Decode the version 1 instruction at BUF in place. Returns the number
+   of bytes consumed. The instruction must have been validated
+   before. */
+
+int
+quantum_objcode_decode(unsigned char *buf, quantum_objcode_insn *insn)
+{
+  int i, k;
+  unsigned int j;
   MAX_UNSIGNED mu;
-  double d;
+  unsigned char *p = buf;
+
+  insn->op = *p++;
+
+  for(i=0; i<quantum_objcode_format[insn->op].ints; i++)
+    {
+      for(k=0, j=0; k<sizeof(int); k++)
+	j = (j << 8) | *p++;
+      insn->arg[i] = j;
+    }
+
+  if(quantum_objcode_format[insn->op].dbl)
+    {
+      memcpy(&insn->d, p, sizeof(double));
+      p += sizeof(double);
+    }
+
+  if(quantum_objcode_format[insn->op].mu)
+    {
+      for(k=0, mu=0; k<sizeof(MAX_UNSIGNED); k++)
+	mu = (mu << 8) | *p++;
+      insn->mu = mu;
+    }
+
+  /* Version 1 files do not record the register width */
+
+  if(insn->op == INIT)
+    insn->arg[0] = 12;
+
+  return p - buf;
+}
+
+/* Same as above, for version 2 instructions */
+
+static inline int
+quantum_objcode_decode2(unsigned char *buf, quantum_objcode_insn *insn)
+{
+  int i;
+  unsigned char *p = buf;
+
+  insn->op = *p++;
+
+  for(i=0; i<quantum_objcode_format[insn->op].ints; i++)
+    insn->arg[i] = quantum_objcode_getvarint(&p);
+
+  if(quantum_objcode_format[insn->op].dbl)
+    {
+      insn->d = quantum_objcode_getfloat(p);
+      p += 4;
+    }
+
+  if(quantum_objcode_format[insn->op].mu)
+    insn->mu = quantum_objcode_getvarint(&p);
+
+  if(insn->op == INIT)
+    insn->arg[0] = quantum_objcode_getvarint(&p);
+
+  return p - buf;
+}
+
+/* Make block B of a mapped file the current one. Compressed blocks are
+   decompressed into the buffer of the map. Returns 0 on success. */
+
+static int
+quantum_objcode_load(quantum_objcode_map *map, unsigned long b)
+{
+  unsigned char *entry;
+  unsigned long offset, len, raw;
 
-  fhd = fopen(file, "r");
+  map->block = b;
+  map->pos = 0;
 
-  if(!fhd)
+  if(map->version == 1)
     {
-      fprintf(stderr, "quantum_objcode_run: Could not open %s: ", file);
+      map->code = map->data;
+      map->len = map->size;
+      return 0;
+    }
+
+  entry = &map->data[map->index + b * QUOB_ENTRY];
+  offset = quantum_objcode_get64(&entry[8]);
+  len = quantum_objcode_get32(&entry[16]);
+  raw = quantum_objcode_get32(&entry[20]);
+
+  map->len = raw;
+
+  if(len == raw)
+    map->code = &map->data[offset];
+  else
+    {
+      map->code = map->buf;
+      if(quantum_decompress(&map->data[offset], len, map->buf, raw) 
+	 != raw)
+	return -1;
+    }
+
+  return 0;
+}
+
+/* Map an object code file into memory and check that it consists of
+   complete instructions with valid opcodes. Both the original format
+   (version 1) and the current format (version 2) are supported. 
+   Returns 0 on success. */
+
+int
+quantum_objcode_open(char *file, quantum_objcode_map *map)
+{
+  int fd, l;
+  struct stat st;
+  unsigned long pos, b, offset, len, raw, max = 0;
+  unsigned char *entry;
+
+  map->data = 0;
+  map->size = 0;
+  map->num = 0;
+  map->mapped = 0;
+  map->version = 1;
+  map->width = 0;
+  map->blocks = 1;
+  map->index = 0;
+  map->buf = 0;
+
+  fd = open(file, O_RDONLY);
+
+  if(fd < 0 || fstat(fd, &st))
+    {
+      fprintf(stderr, "quantum_objcode_open: Could not open %s: ", file);
       perror(0);
-      return;
+      if(fd >= 0)
+	close(fd);
+      return -1;
     }
 
-  for(i=0; !feof(fhd); i++)
+  map->size = st.st_size;
+
+  if(map->size)
     {
-      for(j=0; j<OBJBUF_SIZE; j++)
-	buf[j] = 0;
-      
-      operation = fgetc(fhd);
-      switch(operation)
+#ifdef _POSIX_MAPPED_FILES
+      map->data = mmap(0, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+      if(map->data == MAP_FAILED)
+	map->data = 0;
+      else
 	{
-	case INIT:
-	  if(!fread(buf, sizeof(MAX_UNSIGNED), 1, fhd))
-	    {
-	      quantum_error(QUANTUM_FAILURE);
-	      break;
-	    }
-	  mu = quantum_char2mu(buf);
-	  *reg = quantum_new_qureg(mu, 12);
+	  map->mapped = 1;
+#ifdef MADV_SEQUENTIAL
+	  madvise(map->data, map->size, MADV_SEQUENTIAL);
+#endif
+	}
+#endif
 
-	  break;
+      /* Fall back to reading the whole file */
 
-	case CNOT:
-	case COND_PHASE:
-	  if(!fread(buf, sizeof(int), 1, fhd))
-	    {
-	      quantum_error(QUANTUM_FAILURE);
-	      break;
-	    }
-	  j = quantum_char2int(buf);
-	  if(!fread(buf, sizeof(int), 1, fhd))
-	    {
-	      quantum_error(QUANTUM_FAILURE);
-	      break;
-	    }
-	  
-	  k = quantum_char2int(buf);
-	  switch(operation)
-	    {
-	    case CNOT: quantum_cnot(j, k, reg);
-	      break;
-	    case COND_PHASE: quantum_cond_phase(j, k, reg);
-	      break;
-	    }
-	  break;
+      if(!map->data)
+	{
+	  map->data = malloc(map->size);
 
-	case TOFFOLI:
-	  if(!fread(buf, sizeof(int), 1, fhd))
-	    {
-	      quantum_error(QUANTUM_FAILURE);
-	      break;
-	    }
-	  j = quantum_char2int(buf);
-	  if(!fread(buf, sizeof(int), 1, fhd))
-	    {
-	      quantum_error(QUANTUM_FAILURE);
-	      break;
-	    }
-	  k = quantum_char2int(buf);
-	  if(!fread(buf, sizeof(int), 1, fhd))
-	    {
-	      quantum_error(QUANTUM_FAILURE);
-	      break;
-	    }
-	  l = quantum_char2int(buf);
-	  quantum_toffoli(j, k, l, reg);
-	  break;
-
-	case SIGMA_X:
-	case SIGMA_Y:
-	case SIGMA_Z:
-	case HADAMARD:
-	case BMEASURE:
-	case BMEASURE_P:
-	case SWAPLEADS:
-	  if(!fread(buf, sizeof(int), 1, fhd))
-	    {
-	      quantum_error(QUANTUM_FAILURE);
-	      break;
-	    }
-	  j = quantum_char2int(buf);
-	  switch(operation)
-	    {
-	    case SIGMA_X: quantum_sigma_x(j, reg);
-	      break;
-	    case SIGMA_Y: quantum_sigma_y(j, reg);
-	      break;
-	    case SIGMA_Z: quantum_sigma_z(j, reg);
-	      break;
-	    case HADAMARD: quantum_hadamard(j, reg);
-	      break;
-	    case BMEASURE: quantum_bmeasure(j, reg);
-	      break;
-	    case BMEASURE_P: quantum_bmeasure_bitpreserve(j, reg);
-	      break;
-	    case SWAPLEADS: quantum_swaptheleads(j, reg);
-	      break;
-	    }
-	  break;
-
-	case ROT_X:
-	case ROT_Y:
-	case ROT_Z:
-	case PHASE_KICK:
-	case PHASE_SCALE:
-	  if(!fread(buf, sizeof(int), 1, fhd))
-	    {
-	      quantum_error(QUANTUM_FAILURE);
-	      break;
-	    }
-	  j = quantum_char2int(buf);
-	  if(!fread(buf, sizeof(double), 1, fhd))
-	    {
-	      quantum_error(QUANTUM_FAILURE);
-	      break;
-	    }
-	  d = quantum_char2double(buf);
-	  switch(operation)
+	  if(!map->data)
+	    quantum_error(QUANTUM_ENOMEM);
+
+	  quantum_memman(map->size);
+
+	  for(pos=0; pos<map->size; )
 	    {
-	    case ROT_X: quantum_r_x(j, d, reg);
-	      break;
-	    case ROT_Y: quantum_r_y(j, d, reg);
-	      break;
-	    case ROT_Z: quantum_r_z(j, d, reg);
-	      break;
-	    case PHASE_KICK: quantum_phase_kick(j, d, reg);
-	      break;
-	    case PHASE_SCALE: quantum_phase_scale(j, d, reg);
-	      break;
+	      ssize_t n = read(fd, map->data + pos, map->size - pos);
+
+	      if(n <= 0)
+		{
+		  fprintf(stderr, "quantum_objcode_open: Could not read %s: ",
+			  file);
+		  perror(0);
+		  close(fd);
+		  quantum_objcode_close(map);
+		  return -1;
+		}
+	      pos += n;
 	    }
-	  break;
+	}
+    }
+
+  close(fd);
+
+  /* Parse the header and the block index of version 2 files */
+
+  if(map->size >= 4 && !memcmp(map->data, "QUOB", 4))
+    {
+      if(map->size < QUOB_HEADER || map->data[4] != 2)
+	{
+	  fprintf(stderr, "%s: Unsupported object code version!\n", file);
+	  quantum_objcode_close(map);
+	  return -1;
+	}
+
+      map->version = 2;
+      map->width = quantum_objcode_get32(&map->data[8]);
+      map->blocks = quantum_objcode_get32(&map->data[12]);
+      map->index = quantum_objcode_get64(&map->data[16]);
+
+      if(map->index < QUOB_HEADER || map->index > map->size
+	 || (map->size - map->index) / QUOB_ENTRY < map->blocks)
+	{
+	  fprintf(stderr, "%s: Corrupted block index!\n", file);
+	  quantum_objcode_close(map);
+	  return -1;
+	}
+
+      for(b=0; b<map->blocks; b++)
+	{
+	  entry = &map->data[map->index + b * QUOB_ENTRY];
+	  offset = quantum_objcode_get64(&entry[8]);
+	  len = quantum_objcode_get32(&entry[16]);
+	  raw = quantum_objcode_get32(&entry[20]);
 
-	case CPHASE_KICK:
-	  if(!fread(buf, sizeof(int), 1, fhd))	
+	  if(offset < QUOB_HEADER || offset > map->index 
+	     || len > map->index - offset || len > raw)
 	    {
-	      quantum_error(QUANTUM_FAILURE);
-	      break;
+	      fprintf(stderr, "%s: Corrupted block index!\n", file);
+	      quantum_objcode_close(map);
+	      return -1;
 	    }
-	  j = quantum_char2int(buf);
-	  if(!fread(buf, sizeof(int), 1, fhd))
+
+	  if(len < raw && raw > max)
+	    max = raw;
+	}
+
+      if(max)
+	{
+	  map->buf = malloc(max);
+
+	  if(!map->buf)
+	    quantum_error(QUANTUM_ENOMEM);
+
+	  quantum_memman(max);
+	  map->buflen = max;
+	}
+    }
+
+  /* Validate the whole file once, so that the replay loop does not
+     need any checks */
+
+  for(b=0; b<map->blocks; b++)
+    {
+      if(quantum_objcode_load(map, b))
+	{
+	  fprintf(stderr, "%s: Corrupted block %lu!\n", file, b);
+	  quantum_objcode_close(map);
+	  return -1;
+	}
+
+      if(map->version == 2 
+	 && quantum_objcode_get64(&map->data[map->index + b * QUOB_ENTRY])
+	 != map->num)
+	{
+	  fprintf(stderr, "%s: Corrupted block index!\n", file);
+	  quantum_objcode_close(map);
+	  return -1;
+	}
+
+      for(pos=0; pos<map->len; map->num++)
+	{
+	  if(!(quantum_objcode_format[map->code[pos]].valid 
+	       & (1 << map->version)))
 	    {
-	      quantum_error(QUANTUM_FAILURE);
-	      break;
+	      fprintf(stderr, "%lu: Unknown opcode 0x(%X)!\n", map->num, 
+		      map->code[pos]);
+	      quantum_objcode_close(map);
+	      return -1;
 	    }
-	  k = quantum_char2int(buf);
-	  if(!fread(buf, sizeof(double), 1, fhd))
+
+	  if(map->version == 1)
+	    l = quantum_objcode_length1(map->code[pos]);
+	  else
+	    l = quantum_objcode_length2(&map->code[pos], map->len - pos);
+
+	  pos += l;
+
+	  if(l < 0 || pos > map->len)
 	    {
-	      quantum_error(QUANTUM_FAILURE);
-	      break;
+	      fprintf(stderr, "%lu: Truncated instruction in %s!\n", map->num,
+		      file);
+	      quantum_objcode_close(map);
+	      return -1;
 	    }
-	  d = quantum_char2double(buf);
-	  quantum_cond_phase_kick(j, k, d, reg);
-	  break;
-	  
-	case MEASURE: quantum_measure(*reg);
-	  break;
-
-	case NOP:
-	  break;
-
-	default:
-	  fprintf(stderr, "%i: Unknown opcode 0x(%X)!\n", i, operation);
-	  return;
 	}
+    }
+
+  if(quantum_objcode_load(map, 0))
+    {
+      quantum_objcode_close(map);
+      return -1;
+    }
+
+  return 0;
+}
+
+/* Release an object code file mapped by quantum_objcode_open */
+
+void
+quantum_objcode_close(quantum_objcode_map *map)
+{
+  if(map->data)
+    {
+#ifdef _POSIX_MAPPED_FILES
+      if(map->mapped)
+	munmap(map->data, map->size);
+      else
+#endif
+	{
+	  free(map->data);
+	  quantum_memman(-map->size);
+	}
+    }
 
+  if(map->buf)
+    {
+      free(map->buf);
+      quantum_memman(-map->buflen);
     }
 
-  fclose(fhd);
+  map->data = 0;
+  map->size = 0;
+  map->buf = 0;
+  map->code = 0;
+  map->len = 0;
+  map->pos = 0;
+}
+
+/* Continue with block B of a mapped file. Returns 0 on success. */
+
+int
+quantum_objcode_seek(quantum_objcode_map *map, unsigned long b)
+{
+  if(b >= map->blocks)
+    return -1;
 
-}  
+  return quantum_objcode_load(map, b);
+}
+
+/* Fetch the next instruction of a mapped object code file. Returns 0
+   if the end of the file has been reached. */
+
+int
+quantum_objcode_next(quantum_objcode_map *map, quantum_objcode_insn *insn)
+{
+  while(map->pos >= map->len)
+    {
+      if(map->block + 1 >= map->blocks)
+	return 0;
+
+      quantum_objcode_load(map, map->block + 1);
+    }
+
+  if(map->version == 1)
+    map->pos += quantum_objcode_decode(&map->code[map->pos], insn);
+  else
+    map->pos += quantum_objcode_decode2(&map->code[map->pos], insn);
+
+  return 1;
+}
+
+/* Handlers for the individual opcodes */
+
+static void
+quantum_objcode_init(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  *reg = quantum_new_qureg(insn->mu, insn->arg[0]);
+}
+
+static void
+quantum_objcode_cnot(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_cnot(insn->arg[0], insn->arg[1], reg);
+}
+
+static void
+quantum_objcode_toffoli(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_toffoli(insn->arg[0], insn->arg[1], insn->arg[2], reg);
+}
+
+static void
+quantum_objcode_sigma_x(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_sigma_x(insn->arg[0], reg);
+}
+
+static void
+quantum_objcode_sigma_y(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_sigma_y(insn->arg[0], reg);
+}
+
+static void
+quantum_objcode_sigma_z(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_sigma_z(insn->arg[0], reg);
+}
+
+static void
+quantum_objcode_hadamard(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_hadamard(insn->arg[0], reg);
+}
+
+static void
+quantum_objcode_r_x(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_r_x(insn->arg[0], insn->d, reg);
+}
+
+static void
+quantum_objcode_r_y(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_r_y(insn->arg[0], insn->d, reg);
+}
+
+static void
+quantum_objcode_r_z(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_r_z(insn->arg[0], insn->d, reg);
+}
+
+static void
+quantum_objcode_phase_kick(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_phase_kick(insn->arg[0], insn->d, reg);
+}
+
+static void
+quantum_objcode_phase_scale(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_phase_scale(insn->arg[0], insn->d, reg);
+}
+
+static void
+quantum_objcode_cond_phase(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_cond_phase(insn->arg[0], insn->arg[1], reg);
+}
+
+static void
+quantum_objcode_cphase_kick(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_cond_phase_kick(insn->arg[0], insn->arg[1], insn->d, reg);
+}
+
+static void
+quantum_objcode_swapleads(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_swaptheleads(insn->arg[0], reg);
+}
+
+static void
+quantum_objcode_addscratch(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_addscratch(insn->arg[0], reg);
+}
+
+static void
+quantum_objcode_mctoffoli(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_toffoli_controlled(insn->mu, insn->arg[0], reg);
+}
+
+static void
+quantum_objcode_swapbits(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_swap_bits(insn->arg[0], insn->arg[1], reg);
+}
+
+static void
+quantum_objcode_bitreverse(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_bit_reverse(insn->arg[0], reg);
+}
+
+static void
+quantum_objcode_measure(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_measure(*reg);
+}
+
+static void
+quantum_objcode_bmeasure(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_bmeasure(insn->arg[0], reg);
+}
+
+static void
+quantum_objcode_bmeasure_p(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_bmeasure_bitpreserve(insn->arg[0], reg);
+}
+
+static void
+quantum_objcode_nop(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+}
+
+/* Dispatch table, indexed by opcode */
+
+static void (*const quantum_objcode_handler[256])(quantum_objcode_insn *, 
+						  quantum_reg *) = {
+  [INIT]        = quantum_objcode_init,
+  [CNOT]        = quantum_objcode_cnot,
+  [TOFFOLI]     = quantum_objcode_toffoli,
+  [SIGMA_X]     = quantum_objcode_sigma_x,
+  [SIGMA_Y]     = quantum_objcode_sigma_y,
+  [SIGMA_Z]     = quantum_objcode_sigma_z,
+  [HADAMARD]    = quantum_objcode_hadamard,
+  [ROT_X]       = quantum_objcode_r_x,
+  [ROT_Y]       = quantum_objcode_r_y,
+  [ROT_Z]       = quantum_objcode_r_z,
+  [PHASE_KICK]  = quantum_objcode_phase_kick,
+  [PHASE_SCALE] = quantum_objcode_phase_scale,
+  [COND_PHASE]  = quantum_objcode_cond_phase,
+  [CPHASE_KICK] = quantum_objcode_cphase_kick,
+  [SWAPLEADS]   = quantum_objcode_swapleads,
+  [ADDSCRATCH]  = quantum_objcode_addscratch,
+  [MCTOFFOLI]   = quantum_objcode_mctoffoli,
+  [SWAPBITS]    = quantum_objcode_swapbits,
+  [BITREVERSE]  = quantum_objcode_bitreverse,
+  [MEASURE]     = quantum_objcode_measure,
+  [BMEASURE]    = quantum_objcode_bmeasure,
+  [BMEASURE_P]  = quantum_objcode_bmeasure_p,
+  [NOP]         = quantum_objcode_nop
+};
+
+/* Execute a single decoded instruction */
+
+void
+quantum_objcode_exec(quantum_objcode_insn *insn, quantum_reg *reg)
+{
+  quantum_objcode_handler[insn->op](insn, reg);
+}
+
+/* Execute the contents of an object code file, starting with block
+   BLOCK. Unless the replay starts at the beginning of the file, REG
+   must already hold the state of the quantum register at the start of
+   the block. The file is mapped into memory and validated once before
+   the first instruction is executed. If the environment variable
+   QUOBSTATS is set, the replay throughput is printed to stderr. */
+
+void
+quantum_objcode_resume(char *file, unsigned long block, quantum_reg *reg)
+{
+  quantum_objcode_map map;
+  quantum_objcode_insn insn;
+  struct timeval start, end;
+  unsigned long gates = 0;
+  double t;
+
+  if(quantum_objcode_open(file, &map))
+    return;
+
+  if(quantum_objcode_seek(&map, block))
+    {
+      fprintf(stderr, "%s: No block %lu!\n", file, block);
+      quantum_objcode_close(&map);
+      return;
+    }
+
+  gettimeofday(&start, 0);
+
+  while(quantum_objcode_next(&map, &insn))
+    {
+      quantum_objcode_handler[insn.op](&insn, reg);
+
+      if(insn.op != NOP)
+	gates++;
+    }
+
+  gettimeofday(&end, 0);
+
+  quantum_objcode_close(&map);
+
+  if(getenv("QUOBSTATS"))
+    {
+      t = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+      fprintf(stderr, "quantum_objcode_run: %lu gates in %.3f s "
+	      "(%.0f gates/s)\n", gates, t, t > 0 ? gates / t : 0);
+    }
+}
+
+/* Execute the contents of an object code file. If the environment
+   variable QUOBNATIVE is set, the file is compiled to native code. */
+
+void
+quantum_objcode_run(char *file, quantum_reg *reg)
+{
+  if(getenv("QUOBNATIVE"))
+    quantum_objcode_run_native(file, reg);
+  else
+    quantum_objcode_resume(file, 0, reg);
+}
@@ -29,8 +29,15 @@
 #include "qureg.h"
 
 #define OBJCODE_PAGE 65536
+#define OBJCODE_BLOCK 65536
 #define OBJBUF_SIZE 80
 
+/* Layout of version 2 object code files, see quantum_objcode_write */
+
+#define QUOB_HEADER 24
+#define QUOB_ENTRY 24
+#define QUOB_COMPRESSED 1
+
 enum {
   INIT        = 0x00,
   CNOT        = 0x01,
@@ -47,6 +54,10 @@ enum {
   COND_PHASE  = 0x0C,
   CPHASE_KICK = 0x0D,
   SWAPLEADS   = 0x0E,
+  ADDSCRATCH  = 0x0F,
+  MCTOFFOLI   = 0x10,
+  SWAPBITS    = 0x11,
+  BITREVERSE  = 0x12,
   
   MEASURE     = 0x80,
   BMEASURE    = 0x81,
@@ -55,15 +66,65 @@ enum {
   NOP         = 0xFF
 };
 
+/* A decoded object code instruction */
+
+struct quantum_objcode_insn_struct
+{
+  unsigned char op;  /* opcode */
+  int arg[3];        /* integer arguments (qubits) */
+  double d;          /* angle, if any */
+  MAX_UNSIGNED mu;   /* initial value of INIT, controls of MCTOFFOLI */
+};
+
+typedef struct quantum_objcode_insn_struct quantum_objcode_insn;
+
+/* An object code file mapped into memory */
+
+struct quantum_objcode_map_struct
+{
+  unsigned char *data;  /* contents of the file */
+  unsigned long size;   /* size of the file in bytes */
+  unsigned long num;    /* number of instructions in the file */
+  int mapped;           /* non-zero if DATA is an mmap(2) region */
+  int version;          /* format version of the file */
+  int width;            /* width of the quantum register, if known */
+  unsigned long blocks; /* number of blocks */
+  unsigned long index;  /* offset of the block index */
+  unsigned long block;  /* current block */
+  unsigned char *code;  /* instructions of the current block */
+  unsigned long len;    /* length of the current block */
+  unsigned long pos;    /* offset of the next instruction in CODE */
+  unsigned char *buf;   /* buffer for decompressed blocks */
+  unsigned long buflen; /* size of BUF */
+};
+
+typedef struct quantum_objcode_map_struct quantum_objcode_map;
+
 extern MAX_UNSIGNED quantum_char2mu(unsigned char *buf);
 extern int quantum_char2int(unsigned char *buf);
 extern double quantum_char2double(unsigned char *buf);
 extern void quantum_objcode_start();
 extern void quantum_objcode_stop();
 extern int quantum_objcode_put(unsigned char operation, ...);
+extern int quantum_objcode_putreg(quantum_reg *reg, unsigned char operation, 
+				  ...);
+extern int quantum_objcode_put_insn(quantum_objcode_insn *insn);
+extern int quantum_objcode_status();
 extern int quantum_objcode_write(char *file);
 extern void quantum_objcode_file(char *file);
 extern void quantum_objcode_exit(char *file);
 extern void quantum_objcode_run(char *file, quantum_reg *reg);
+extern void quantum_objcode_resume(char *file, unsigned long block, 
+				   quantum_reg *reg);
+
+extern int quantum_objcode_decode(unsigned char *buf, 
+				  quantum_objcode_insn *insn);
+extern int quantum_objcode_open(char *file, quantum_objcode_map *map);
+extern void quantum_objcode_close(quantum_objcode_map *map);
+extern int quantum_objcode_seek(quantum_objcode_map *map, unsigned long b);
+extern int quantum_objcode_next(quantum_objcode_map *map, 
+				quantum_objcode_insn *insn);
+extern void quantum_objcode_exec(quantum_objcode_insn *insn, 
+				 quantum_reg *reg);
 
 #endif
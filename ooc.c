@@ -0,0 +1,718 @@
+/* ooc.c: Out-of-core quantum registers
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <math.h>
+
+#include "ooc.h"
+#include "config.h"
+#include "matrix.h"
+#include "complex.h"
+#include "qureg.h"
+#include "gates.h"
+#include "measure.h"
+#include "defs.h"
+#include "error.h"
+#include "alloc.h"
+
+/* An out-of-core register holds all 2^WIDTH amplitudes as a dense
+   array in a file, which is processed in chunks of 2^CHUNKW
+   amplitudes. A gate acting on a bit inside a chunk works on one
+   chunk at a time, a gate acting on a higher bit on the pair of
+   chunks whose indices differ in that bit. While one chunk (pair) is
+   being processed, the next one is read from disk. */
+
+enum {
+  OOC_GATE1,      /* controlled 2x2 matrix */
+  OOC_DIAG,       /* diagonal gate */
+  OOC_PROB,       /* probability of a bit being zero */
+  OOC_MEASURE,    /* sample a basis state */
+  OOC_COUNT,      /* count non-zero amplitudes */
+  OOC_COPY        /* copy non-zero amplitudes to a quantum_reg */
+};
+
+/* A single pass over the register */
+
+struct quantum_ooc_op_struct
+{
+  int type;
+  int target;
+  MAX_UNSIGNED mask;      /* control bits, or bits selecting Z1 */
+  COMPLEX_FLOAT m[4];     /* matrix of OOC_GATE1 */
+  COMPLEX_FLOAT z0, z1;   /* factors of OOC_DIAG */
+  double sum;
+  double r;
+  MAX_UNSIGNED result;
+  int done;
+  quantum_reg *out;
+};
+
+typedef struct quantum_ooc_op_struct quantum_ooc_op;
+
+/* Read or write a whole chunk */
+
+static void
+quantum_ooc_io(int store, MAX_UNSIGNED chunk, COMPLEX_FLOAT *buf, 
+	       quantum_ooc_reg *reg)
+{
+  size_t n = sizeof(COMPLEX_FLOAT) << reg->chunkw;
+  off_t off = (off_t) chunk * n;
+  char *p = (char *) buf;
+  ssize_t i;
+
+  while(n > 0)
+    {
+      if(store)
+	i = pwrite(reg->fd, p, n, off);
+      else
+	i = pread(reg->fd, p, n, off);
+
+      if(i <= 0)
+	quantum_error(QUANTUM_EIO);
+
+      p += i;
+      n -= i;
+      off += i;
+    }
+}
+
+/* Map unit K of a pass to the lower chunk it works on. PAIRBIT is the
+   chunk-level bit distinguishing the chunks of a pair, or -1 if each
+   unit consists of a single chunk. */
+
+static MAX_UNSIGNED
+quantum_ooc_chunk(MAX_UNSIGNED k, int pairbit)
+{
+  if(pairbit < 0)
+    return k;
+
+  return ((k >> pairbit) << (pairbit + 1)) 
+    | (k & (((MAX_UNSIGNED) 1 << pairbit) - 1));
+}
+
+/* Transfer unit K between disk and buffer set SET */
+
+static void
+quantum_ooc_unit(int store, MAX_UNSIGNED k, int set, int pairbit, 
+		 quantum_ooc_reg *reg)
+{
+  MAX_UNSIGNED c = quantum_ooc_chunk(k, pairbit);
+
+  quantum_ooc_io(store, c, reg->buf[2*set], reg);
+
+  if(pairbit >= 0)
+    quantum_ooc_io(store, c | ((MAX_UNSIGNED) 1 << pairbit), 
+		   reg->buf[2*set+1], reg);
+}
+
+/* Let the kernel start reading unit K in the background */
+
+static void
+quantum_ooc_prefetch(MAX_UNSIGNED k, int pairbit, quantum_ooc_reg *reg)
+{
+#ifdef POSIX_FADV_WILLNEED
+  off_t n = sizeof(COMPLEX_FLOAT) << reg->chunkw;
+  MAX_UNSIGNED c = quantum_ooc_chunk(k, pairbit);
+
+  posix_fadvise(reg->fd, (off_t) c * n, n, POSIX_FADV_WILLNEED);
+
+  if(pairbit >= 0)
+    posix_fadvise(reg->fd, (off_t) (c | ((MAX_UNSIGNED) 1 << pairbit)) * n, n, 
+		  POSIX_FADV_WILLNEED);
+#endif
+}
+
+/* Apply OP to the unit in buffer set SET, whose lower chunk starts
+   at amplitude BASE. This is called by every thread of the team of
+   quantum_ooc_pass, which share the loops over the amplitudes. The
+   thread doing the transfers joins them once it is done, hence the
+   dynamic schedule. Sampling and copying depend on the order of the
+   amplitudes and are done by a single thread. */
+
+static void
+quantum_ooc_kernel(quantum_ooc_op *op, MAX_UNSIGNED base, int set, 
+		   int pairbit, quantum_ooc_reg *reg)
+{
+  COMPLEX_FLOAT *lo = reg->buf[2*set];
+  COMPLEX_FLOAT *hi = reg->buf[2*set+1];
+  MAX_UNSIGNED n = (MAX_UNSIGNED) 1 << reg->chunkw;
+  MAX_UNSIGNED i, j, bit, count;
+  COMPLEX_FLOAT a, b;
+  double sum;
+
+  switch(op->type)
+    {
+    case OOC_GATE1:
+
+      /* If both amplitudes of a pair lie in the same chunk, the upper
+	 one is found at an offset of BIT */
+
+      bit = 0;
+
+      if(pairbit < 0)
+	{
+	  bit = (MAX_UNSIGNED) 1 << op->target;
+	  hi = lo;
+	}
+
+#ifdef _OPENMP
+#pragma omp for schedule (dynamic, 4096) nowait
+#endif
+      for(i=0; i<n; i++)
+	{
+	  if((i & bit) || ((base | i) & op->mask) != op->mask)
+	    continue;
+
+	  j = i | bit;
+	  a = lo[i];
+	  b = hi[j];
+	  lo[i] = op->m[0] * a + op->m[1] * b;
+	  hi[j] = op->m[2] * a + op->m[3] * b;
+	}
+      break;
+
+    case OOC_DIAG:
+#ifdef _OPENMP
+#pragma omp for schedule (dynamic, 4096) nowait
+#endif
+      for(i=0; i<n; i++)
+	{
+	  if(((base | i) & op->mask) == op->mask)
+	    lo[i] *= op->z1;
+	  else
+	    lo[i] *= op->z0;
+	}
+      break;
+
+    case OOC_PROB:
+      sum = 0;
+
+#ifdef _OPENMP
+#pragma omp for schedule (dynamic, 4096) nowait
+#endif
+      for(i=0; i<n; i++)
+	{
+	  if(!((base | i) & op->mask))
+	    sum += quantum_prob_inline(lo[i]);
+	}
+
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+      op->sum += sum;
+      break;
+
+    case OOC_MEASURE:
+#ifdef _OPENMP
+#pragma omp single nowait
+#endif
+      for(i=0; i<n; i++)
+	{
+	  op->sum += quantum_prob_inline(lo[i]);
+
+	  if(op->sum >= op->r)
+	    {
+	      op->result = base | i;
+	      op->done = 1;
+	      break;
+	    }
+	}
+      break;
+
+    case OOC_COUNT:
+      count = 0;
+
+#ifdef _OPENMP
+#pragma omp for schedule (dynamic, 4096) nowait
+#endif
+      for(i=0; i<n; i++)
+	{
+	  if(lo[i] != 0)
+	    count++;
+	}
+
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+      op->result += count;
+      break;
+
+    case OOC_COPY:
+#ifdef _OPENMP
+#pragma omp single nowait
+#endif
+      for(i=0; i<n; i++)
+	{
+	  if(lo[i] != 0)
+	    {
+	      op->out->state[op->result] = base | i;
+	      op->out->amplitude[op->result] = lo[i];
+	      op->result++;
+	    }
+	}
+      break;
+    }
+}
+
+/* Stream the whole register through OP. A single team of threads
+   works on the whole pass. While the team processes one unit, one of
+   its threads writes back the previous unit and reads the next one
+   into the same buffer set, and then joins the others. */
+
+static void
+quantum_ooc_pass(quantum_ooc_op *op, int pairbit, int readonly, 
+		 quantum_ooc_reg *reg)
+{
+  MAX_UNSIGNED k, units;
+  int cur, done;
+
+  units = (MAX_UNSIGNED) 1 << (reg->width - reg->chunkw - (pairbit >= 0));
+
+  quantum_ooc_unit(0, 0, 0, pairbit, reg);
+
+#ifdef _OPENMP
+#pragma omp parallel private (k, cur, done)
+#endif
+  {
+    for(k=0, cur=0, done=0; k<units && !done; k++, cur^=1)
+      {
+#ifdef _OPENMP
+#pragma omp single nowait
+#endif
+	{
+	  if(k + 2 < units)
+	    quantum_ooc_prefetch(k + 2, pairbit, reg);
+
+	  if(k && !readonly)
+	    quantum_ooc_unit(1, k - 1, cur ^ 1, pairbit, reg);
+
+	  if(k + 1 < units)
+	    quantum_ooc_unit(0, k + 1, cur ^ 1, pairbit, reg);
+	}
+
+	quantum_ooc_kernel(op, quantum_ooc_chunk(k, pairbit) << reg->chunkw,
+			   cur, pairbit, reg);
+
+	/* All threads have to agree on stopping before the next unit
+	   may change OP->DONE */
+
+#ifdef _OPENMP
+#pragma omp barrier
+#endif
+	done = op->done;
+#ifdef _OPENMP
+#pragma omp barrier
+#endif
+      }
+
+#ifdef _OPENMP
+#pragma omp single
+#endif
+    {
+      if(!readonly)
+	quantum_ooc_unit(1, k - 1, cur ^ 1, pairbit, reg);
+    }
+  }
+}
+
+/* Create an out-of-core register of WIDTH qubits in the basis state
+   INITVAL. The amplitudes are stored in FILE, or in an anonymous
+   temporary file in $QUOOCDIR (default: /tmp) if FILE is 0. The
+   chunk size can be set through $QUOOCCHUNK. */
+
+quantum_ooc_reg
+quantum_ooc_new(MAX_UNSIGNED initval, int width, char *file)
+{
+  quantum_ooc_reg reg;
+  COMPLEX_FLOAT one = 1;
+  char *dir, *c, *tmp = 0;
+  size_t n;
+  int i;
+
+  reg.width = width;
+  reg.chunkw = QUANTUM_OOC_CHUNK;
+
+  c = getenv("QUOOCCHUNK");
+
+  if(c)
+    reg.chunkw = atoi(c);
+
+  if(reg.chunkw > width)
+    reg.chunkw = width;
+
+  if(reg.chunkw < 0)
+    reg.chunkw = 0;
+
+  if(file)
+    reg.fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  else
+    {
+      dir = getenv("QUOOCDIR");
+
+      if(!dir)
+	dir = "/tmp";
+
+      tmp = malloc(strlen(dir) + 20);
+
+      if(!tmp)
+	quantum_error(QUANTUM_ENOMEM);
+
+      sprintf(tmp, "%s/quooc-XXXXXX", dir);
+      reg.fd = mkstemp(tmp);
+    }
+
+  if(reg.fd < 0)
+    quantum_error(QUANTUM_EIO);
+
+  if(tmp)
+    {
+      unlink(tmp);
+      free(tmp);
+    }
+
+  /* The file is created sparse, unwritten chunks read as zero */
+
+  if(ftruncate(reg.fd, (off_t) sizeof(COMPLEX_FLOAT) << width)
+     || pwrite(reg.fd, &one, sizeof(one), 
+	       (off_t) initval * sizeof(COMPLEX_FLOAT)) != sizeof(one))
+    quantum_error(QUANTUM_EIO);
+
+  n = sizeof(COMPLEX_FLOAT) << reg.chunkw;
+
+  for(i=0; i<4; i++)
+    {
+      reg.buf[i] = quantum_alloc(n);
+
+      if(!reg.buf[i])
+	quantum_error(QUANTUM_ENOMEM);
+    }
+
+  quantum_memman(4 * n);
+
+  return reg;
+}
+
+/* Delete an out-of-core register. A named backing file is kept. */
+
+void
+quantum_ooc_delete(quantum_ooc_reg *reg)
+{
+  int i;
+
+  for(i=0; i<4; i++)
+    {
+      quantum_free(reg->buf[i]);
+      reg->buf[i] = 0;
+    }
+
+  quantum_memman(-4 * (sizeof(COMPLEX_FLOAT) << reg->chunkw));
+
+  close(reg->fd);
+  reg->fd = -1;
+}
+
+/* Apply the 2x2 matrix M to TARGET in all basis states where the bits
+   in CTRL are set */
+
+static void
+quantum_ooc_apply(MAX_UNSIGNED ctrl, int target, quantum_matrix m, 
+		  quantum_ooc_reg *reg)
+{
+  quantum_ooc_op op;
+  int i;
+
+  if((m.cols != 2) || (m.rows != 2))
+    quantum_error(QUANTUM_EMSIZE);
+
+  memset(&op, 0, sizeof(op));
+  op.type = OOC_GATE1;
+  op.target = target;
+  op.mask = ctrl;
+
+  for(i=0; i<4; i++)
+    op.m[i] = m.t[i];
+
+  if(target < reg->chunkw)
+    quantum_ooc_pass(&op, -1, 0, reg);
+  else
+    quantum_ooc_pass(&op, target - reg->chunkw, 0, reg);
+
+  quantum_gate_counter(1);
+}
+
+/* Multiply all amplitudes where the bits in MASK are set with Z1, all
+   others with Z0 */
+
+static void
+quantum_ooc_diag(MAX_UNSIGNED mask, COMPLEX_FLOAT z0, COMPLEX_FLOAT z1, 
+		 quantum_ooc_reg *reg)
+{
+  quantum_ooc_op op;
+
+  memset(&op, 0, sizeof(op));
+  op.type = OOC_DIAG;
+  op.mask = mask;
+  op.z0 = z0;
+  op.z1 = z1;
+
+  quantum_ooc_pass(&op, -1, 0, reg);
+
+  quantum_gate_counter(1);
+}
+
+/* Apply the 2x2 matrix M to the target bit. M should be unitary. */
+
+void
+quantum_ooc_gate1(int target, quantum_matrix m, quantum_ooc_reg *reg)
+{
+  quantum_ooc_apply(0, target, m, reg);
+}
+
+/* Apply the 2x2 matrix M to the target bit in all basis states where
+   the bits in CTRL are set */
+
+void
+quantum_ooc_gate1_controlled(MAX_UNSIGNED ctrl, int target, quantum_matrix m,
+			     quantum_ooc_reg *reg)
+{
+  quantum_ooc_apply(ctrl, target, m, reg);
+}
+
+/* Apply a hadamard gate */
+
+void
+quantum_ooc_hadamard(int target, quantum_ooc_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = sqrt(1.0/2);  m.t[1] = sqrt(1.0/2);
+  m.t[2] = sqrt(1.0/2);  m.t[3] = -sqrt(1.0/2);
+
+  quantum_ooc_apply(0, target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a controlled-controlled-not gate */
+
+void
+quantum_ooc_toffoli(int control1, int control2, int target, 
+		    quantum_ooc_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = 0;  m.t[1] = 1;
+  m.t[2] = 1;  m.t[3] = 0;
+
+  quantum_ooc_apply(((MAX_UNSIGNED) 1 << control1) 
+		    | ((MAX_UNSIGNED) 1 << control2), target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a controlled-not gate */
+
+void
+quantum_ooc_cnot(int control, int target, quantum_ooc_reg *reg)
+{
+  quantum_ooc_toffoli(control, control, target, reg);
+}
+
+/* Apply a pauli x spin operator */
+
+void
+quantum_ooc_sigma_x(int target, quantum_ooc_reg *reg)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = 0;  m.t[1] = 1;
+  m.t[2] = 1;  m.t[3] = 0;
+
+  quantum_ooc_apply(0, target, m, reg);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a pauli z spin operator */
+
+void
+quantum_ooc_sigma_z(int target, quantum_ooc_reg *reg)
+{
+  quantum_ooc_diag((MAX_UNSIGNED) 1 << target, 1, -1, reg);
+}
+
+/* Apply a rotation about the z-axis by the angle GAMMA */
+
+void
+quantum_ooc_r_z(int target, float gamma, quantum_ooc_reg *reg)
+{
+  COMPLEX_FLOAT z = quantum_cexp(gamma/2);
+
+  quantum_ooc_diag((MAX_UNSIGNED) 1 << target, 1 / z, z, reg);
+}
+
+/* Scale the phase of the qubit */
+
+void
+quantum_ooc_phase_scale(int target, float gamma, quantum_ooc_reg *reg)
+{
+  COMPLEX_FLOAT z = quantum_cexp(gamma);
+
+  quantum_ooc_diag(0, z, z, reg);
+}
+
+/* Phase shift a qubit by GAMMA */
+
+void
+quantum_ooc_phase_kick(int target, float gamma, quantum_ooc_reg *reg)
+{
+  quantum_ooc_diag((MAX_UNSIGNED) 1 << target, 1, quantum_cexp(gamma), 
+		   reg);
+}
+
+/* Apply a conditional phase shift by PI / 2^(CONTROL - TARGET) */
+
+void
+quantum_ooc_cond_phase(int control, int target, quantum_ooc_reg *reg)
+{
+  quantum_ooc_diag(((MAX_UNSIGNED) 1 << control) 
+		   | ((MAX_UNSIGNED) 1 << target), 1, 
+		   quantum_cexp(pi / ((MAX_UNSIGNED) 1 << (control - target))),
+		   reg);
+}
+
+/* Apply a conditional phase shift by GAMMA */
+
+void
+quantum_ooc_cond_phase_kick(int control, int target, float gamma, 
+			    quantum_ooc_reg *reg)
+{
+  quantum_ooc_diag(((MAX_UNSIGNED) 1 << control) 
+		   | ((MAX_UNSIGNED) 1 << target), 1, quantum_cexp(gamma), 
+		   reg);
+}
+
+/* Measure the contents of an out-of-core register without changing
+   it. Returns -1 if no basis state could be selected. */
+
+MAX_UNSIGNED
+quantum_ooc_measure(quantum_ooc_reg *reg)
+{
+  quantum_ooc_op op;
+
+  memset(&op, 0, sizeof(op));
+  op.type = OOC_MEASURE;
+  op.r = quantum_frand();
+  op.result = (MAX_UNSIGNED) -1;
+
+  quantum_ooc_pass(&op, -1, 1, reg);
+
+  return op.result;
+}
+
+/* Measure a single bit and collapse the register accordingly */
+
+int
+quantum_ooc_bmeasure(int pos, quantum_ooc_reg *reg)
+{
+  quantum_ooc_op op;
+  MAX_UNSIGNED bit = (MAX_UNSIGNED) 1 << pos;
+  double pa;
+  int result;
+
+  memset(&op, 0, sizeof(op));
+  op.type = OOC_PROB;
+  op.mask = bit;
+
+  quantum_ooc_pass(&op, -1, 1, reg);
+
+  pa = op.sum;
+  result = quantum_frand() > pa;
+
+  /* Remove all basis states with the other value of the bit and
+     normalize the rest */
+
+  op.type = OOC_DIAG;
+
+  if(result)
+    {
+      op.z0 = 0;
+      op.z1 = 1 / sqrt(1 - pa);
+    }
+  else
+    {
+      op.z0 = 1 / sqrt(pa);
+      op.z1 = 0;
+    }
+
+  quantum_ooc_pass(&op, -1, 0, reg);
+
+  return result;
+}
+
+/* Copy the non-zero amplitudes of an out-of-core register into a
+   regular quantum register, e.g. after most of the basis states have
+   been removed by measurements */
+
+quantum_reg
+quantum_ooc_to_qureg(quantum_ooc_reg *reg)
+{
+  quantum_reg out;
+  quantum_ooc_op op;
+
+  memset(&op, 0, sizeof(op));
+  op.type = OOC_COUNT;
+
+  quantum_ooc_pass(&op, -1, 1, reg);
+
+  out = quantum_new_qureg_sparse((int) op.result, reg->width);
+
+  /* Allocate the hash table */
+
+  out.hashw = reg->width + 2;
+  out.hash = quantum_calloc(1 << out.hashw, sizeof(int));
+
+  if(!out.hash)
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman((1 << out.hashw) * sizeof(int));
+
+  op.type = OOC_COPY;
+  op.result = 0;
+  op.out = &out;
+
+  quantum_ooc_pass(&op, -1, 1, reg);
+
+  return out;
+}
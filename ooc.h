@@ -0,0 +1,79 @@
+/* ooc.h: Declarations for ooc.c
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#ifndef __OOC_H
+
+#define __OOC_H
+
+#include "config.h"
+#include "matrix.h"
+#include "qureg.h"
+
+/* Default log2 of the number of amplitudes per chunk */
+
+#define QUANTUM_OOC_CHUNK 20
+
+/* A quantum register whose amplitudes are kept in a file */
+
+struct quantum_ooc_reg_struct
+{
+  int width;    /* number of qubits in the qureg */
+  int chunkw;   /* log2 of the number of amplitudes per chunk */
+  int fd;       /* backing file */
+  COMPLEX_FLOAT *buf[4]; /* two chunk pairs for double buffering */
+};
+
+typedef struct quantum_ooc_reg_struct quantum_ooc_reg;
+
+extern quantum_ooc_reg quantum_ooc_new(MAX_UNSIGNED initval, int width, 
+				       char *file);
+extern void quantum_ooc_delete(quantum_ooc_reg *reg);
+
+extern void quantum_ooc_gate1(int target, quantum_matrix m, 
+			      quantum_ooc_reg *reg);
+extern void quantum_ooc_gate1_controlled(MAX_UNSIGNED ctrl, int target, 
+					 quantum_matrix m, 
+					 quantum_ooc_reg *reg);
+extern void quantum_ooc_hadamard(int target, quantum_ooc_reg *reg);
+extern void quantum_ooc_sigma_x(int target, quantum_ooc_reg *reg);
+extern void quantum_ooc_cnot(int control, int target, quantum_ooc_reg *reg);
+extern void quantum_ooc_toffoli(int control1, int control2, int target, 
+				quantum_ooc_reg *reg);
+
+extern void quantum_ooc_sigma_z(int target, quantum_ooc_reg *reg);
+extern void quantum_ooc_r_z(int target, float gamma, quantum_ooc_reg *reg);
+extern void quantum_ooc_phase_scale(int target, float gamma, 
+				    quantum_ooc_reg *reg);
+extern void quantum_ooc_phase_kick(int target, float gamma, 
+				   quantum_ooc_reg *reg);
+extern void quantum_ooc_cond_phase(int control, int target, 
+				   quantum_ooc_reg *reg);
+extern void quantum_ooc_cond_phase_kick(int control, int target, float gamma,
+					quantum_ooc_reg *reg);
+
+extern MAX_UNSIGNED quantum_ooc_measure(quantum_ooc_reg *reg);
+extern int quantum_ooc_bmeasure(int pos, quantum_ooc_reg *reg);
+
+extern quantum_reg quantum_ooc_to_qureg(quantum_ooc_reg *reg);
+
+#endif
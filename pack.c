@@ -0,0 +1,938 @@
+/* pack.c: Compressed storage of amplitudes
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "pack.h"
+#include "config.h"
+#include "complex.h"
+#include "matrix.h"
+#include "qureg.h"
+#include "gates.h"
+#include "defs.h"
+#include "defer.h"
+#include "checkpoint.h"
+#include "error.h"
+#include "alloc.h"
+
+/* The amplitudes of a packed register are split into blocks of
+   QUANTUM_PACK_BLOCK entries, each of which is stored in the
+   smallest of the following encodings:
+
+   PACK_RAW:   the amplitudes as they are
+   PACK_DICT:  a table of up to 255 distinct values and a bit-packed
+               index into it for each amplitude; lossless, and very
+               effective for registers where many amplitudes share
+               magnitude and phase, e.g. after quantum_exp_mod_n
+   PACK_QUANT: real and imaginary parts as integer multiples of a
+               shared power of two step, bit-packed with as many bits
+               as the block needs; only used if an error bound is
+               given, the error of each component stays below it
+
+   The basis states are kept uncompressed, so that gates which only
+   permute them work directly on a packed register. */
+
+enum {
+  PACK_RAW,
+  PACK_DICT,
+  PACK_QUANT
+};
+
+#define PACK_DICT_MAX 255
+#define PACK_QUANT_BITS 32
+
+/* Number of decompressed blocks kept while applying a gate */
+
+#define PACK_CACHE 16
+
+/* Largest encoded size of a block */
+
+#define PACK_BOUND (1 + QUANTUM_PACK_BLOCK * sizeof(COMPLEX_FLOAT))
+
+/* Append the lowest BITS bits of V to the zeroed bit stream P */
+
+static void
+quantum_put_bits(unsigned char *p, unsigned long pos, unsigned long v, 
+		 int bits)
+{
+  int i;
+
+  for(i=0; i<bits; i++)
+    {
+      if((v >> i) & 1)
+	p[(pos + i) >> 3] |= 1 << ((pos + i) & 7);
+    }
+}
+
+/* Read BITS bits from the bit stream P */
+
+static unsigned long
+quantum_get_bits(const unsigned char *p, unsigned long pos, int bits)
+{
+  unsigned long v = 0;
+  int i;
+
+  for(i=0; i<bits; i++)
+    {
+      if((p[(pos + i) >> 3] >> ((pos + i) & 7)) & 1)
+	v |= 1UL << i;
+    }
+
+  return v;
+}
+
+/* Number of bits needed to represent V */
+
+static int
+quantum_bit_width(unsigned long v)
+{
+  int bits = 0;
+
+  while(bits < 8 * sizeof(v) && v >> bits)
+    bits++;
+
+  return bits;
+}
+
+/* Map a signed integer to an unsigned one, small magnitudes first */
+
+static unsigned long
+quantum_zigzag(long q)
+{
+  return q < 0 ? 2 * (unsigned long) -q - 1 : 2 * (unsigned long) q;
+}
+
+static long
+quantum_unzigzag(unsigned long z)
+{
+  return z & 1 ? -(long) ((z + 1) / 2) : (long) (z / 2);
+}
+
+/* Encode the N amplitudes in A to OUT, which has to hold at least
+   PACK_BOUND bytes. Returns the number of bytes written. */
+
+static unsigned long
+quantum_pack_block(COMPLEX_FLOAT *a, int n, double bound, unsigned char *out)
+{
+  COMPLEX_FLOAT dict[PACK_DICT_MAX];
+  unsigned char idx[QUANTUM_PACK_BLOCK];
+  unsigned long raw, dsize = 0, qsize = 0, zmax = 0;
+  double step = 0;
+  int i, j, nd = 0, dbits = 0, qbits = 0, e = 0;
+
+  raw = 1 + n * sizeof(COMPLEX_FLOAT);
+
+  /* Try to build a dictionary */
+
+  for(i=0; i<n && nd>=0; i++)
+    {
+      for(j=0; j<nd; j++)
+	{
+	  if(dict[j] == a[i])
+	    break;
+	}
+
+      if(j == nd)
+	{
+	  if(nd == PACK_DICT_MAX)
+	    nd = -1;
+	  else
+	    dict[nd++] = a[i];
+	}
+
+      idx[i] = j;
+    }
+
+  if(nd > 0)
+    {
+      dbits = quantum_bit_width(nd - 1);
+      dsize = 2 + nd * sizeof(COMPLEX_FLOAT) + (n * dbits + 7) / 8;
+    }
+
+  /* Try to quantize with a step of at most twice the error bound */
+
+  if(bound > 0)
+    {
+      e = (int) floor(log2(2 * bound));
+      step = ldexp(1, e);
+
+      for(i=0; i<n; i++)
+	{
+	  if(!(fabs(quantum_real(a[i])) / step < 1e9)
+	     || !(fabs(quantum_imag(a[i])) / step < 1e9))
+	    break;
+
+	  zmax |= quantum_zigzag(lrint(quantum_real(a[i]) / step));
+	  zmax |= quantum_zigzag(lrint(quantum_imag(a[i]) / step));
+	}
+
+      qbits = quantum_bit_width(zmax);
+
+      if(i == n && qbits <= PACK_QUANT_BITS && e > -32768 && e < 32768)
+	qsize = 4 + (2 * n * qbits + 7) / 8;
+    }
+
+  if(qsize && qsize < raw && (!dsize || qsize < dsize))
+    {
+      memset(out, 0, qsize);
+      out[0] = PACK_QUANT;
+      out[1] = e & 0xff;
+      out[2] = (e >> 8) & 0xff;
+      out[3] = qbits;
+
+      for(i=0; i<n; i++)
+	{
+	  quantum_put_bits(out + 4, 2 * i * qbits, 
+			   quantum_zigzag(lrint(quantum_real(a[i]) / step)), 
+			   qbits);
+	  quantum_put_bits(out + 4, (2 * i + 1) * qbits, 
+			   quantum_zigzag(lrint(quantum_imag(a[i]) / step)), 
+			   qbits);
+	}
+
+      return qsize;
+    }
+
+  if(dsize && dsize < raw)
+    {
+      memset(out, 0, dsize);
+      out[0] = PACK_DICT;
+      out[1] = nd;
+      memcpy(out + 2, dict, nd * sizeof(COMPLEX_FLOAT));
+
+      for(i=0; i<n; i++)
+	quantum_put_bits(out + 2 + nd * sizeof(COMPLEX_FLOAT), i * dbits, 
+			 idx[i], dbits);
+
+      return dsize;
+    }
+
+  out[0] = PACK_RAW;
+  memcpy(out + 1, a, n * sizeof(COMPLEX_FLOAT));
+
+  return raw;
+}
+
+/* Decode a block of N amplitudes */
+
+static void
+quantum_unpack_block(const unsigned char *in, int n, COMPLEX_FLOAT *a)
+{
+  COMPLEX_FLOAT dict[PACK_DICT_MAX];
+  double step;
+  int i, nd, bits, e;
+  long re, im;
+
+  switch(in[0])
+    {
+    case PACK_RAW:
+      memcpy(a, in + 1, n * sizeof(COMPLEX_FLOAT));
+      break;
+
+    case PACK_DICT:
+      nd = in[1];
+      memcpy(dict, in + 2, nd * sizeof(COMPLEX_FLOAT));
+      bits = quantum_bit_width(nd - 1);
+
+      for(i=0; i<n; i++)
+	a[i] = dict[quantum_get_bits(in + 2 + nd * sizeof(COMPLEX_FLOAT), 
+				     i * bits, bits)];
+      break;
+
+    case PACK_QUANT:
+      e = (short) (in[1] | (in[2] << 8));
+      bits = in[3];
+      step = ldexp(1, e);
+
+      for(i=0; i<n; i++)
+	{
+	  re = quantum_unzigzag(quantum_get_bits(in + 4, 2 * i * bits, bits));
+	  im = quantum_unzigzag(quantum_get_bits(in + 4, (2 * i + 1) * bits, 
+						 bits));
+	  a[i] = re * step + IMAGINARY * (im * step);
+	}
+      break;
+
+    default:
+      quantum_error(QUANTUM_FAILURE);
+    }
+}
+
+/* Accumulate the overlap of the N amplitudes in A and B and their
+   norms, in double precision */
+
+static void
+quantum_pack_overlap(COMPLEX_FLOAT *a, COMPLEX_FLOAT *b, int n, double *ore, 
+		     double *oim, double *na, double *nb)
+{
+  double ar, ai, br, bi;
+  int i;
+
+  for(i=0; i<n; i++)
+    {
+      ar = quantum_real(a[i]);
+      ai = quantum_imag(a[i]);
+      br = quantum_real(b[i]);
+      bi = quantum_imag(b[i]);
+
+      *ore += ar * br + ai * bi;
+      *oim += ar * bi - ai * br;
+      *na += ar * ar + ai * ai;
+      *nb += br * br + bi * bi;
+    }
+}
+
+/* Encode the amplitudes A of a register with SIZE entries. The
+   fidelity of the encoded state with respect to A is returned in
+   FIDELITY. */
+
+static unsigned char *
+quantum_pack_data(COMPLEX_FLOAT *a, int size, double bound, 
+		  unsigned long *offset, double *fidelity)
+{
+  COMPLEX_FLOAT tmp[QUANTUM_PACK_BLOCK];
+  unsigned char *data;
+  unsigned long len = 0;
+  double ore = 0, oim = 0, na = 0, nb = 0;
+  int b, n, blocks;
+
+  blocks = (size + QUANTUM_PACK_BLOCK - 1) / QUANTUM_PACK_BLOCK;
+
+  data = malloc(blocks * PACK_BOUND + 1);
+
+  if(!data)
+    quantum_error(QUANTUM_ENOMEM);
+
+  for(b=0; b<blocks; b++)
+    {
+      n = size - b * QUANTUM_PACK_BLOCK;
+
+      if(n > QUANTUM_PACK_BLOCK)
+	n = QUANTUM_PACK_BLOCK;
+
+      offset[b] = len;
+      len += quantum_pack_block(a + b * QUANTUM_PACK_BLOCK, n, bound, 
+				data + len);
+
+      /* Compare with the exact amplitudes */
+
+      if(bound > 0)
+	{
+	  quantum_unpack_block(data + offset[b], n, tmp);
+	  quantum_pack_overlap(a + b * QUANTUM_PACK_BLOCK, tmp, n, 
+			       &ore, &oim, &na, &nb);
+	}
+    }
+
+  offset[blocks] = len;
+
+  *fidelity = 1;
+
+  if(na > 0 && nb > 0)
+    *fidelity = (ore * ore + oim * oim) / (na * nb);
+
+  return realloc(data, len + 1);
+}
+
+/* Compress the amplitudes of REG. For BOUND > 0, real and imaginary
+   part of each amplitude may be off by up to BOUND, otherwise the
+   compression is lossless. REG is emptied, its hash table is freed as
+   well. */
+
+quantum_packed_reg
+quantum_pack_qureg(double bound, quantum_reg *reg)
+{
+  quantum_packed_reg p;
+  int blocks;
+
+  quantum_flush(reg);
+  quantum_copy_mapped(reg);
+
+  p.width = reg->width;
+  p.size = reg->size;
+  p.hashw = reg->hashw;
+  p.state = reg->state;
+  p.bound = bound > 0 ? bound : 0;
+
+  blocks = (p.size + QUANTUM_PACK_BLOCK - 1) / QUANTUM_PACK_BLOCK;
+
+  p.offset = malloc((blocks + 1) * sizeof(unsigned long));
+
+  if(!p.offset)
+    quantum_error(QUANTUM_ENOMEM);
+
+  p.data = quantum_pack_data(reg->amplitude, p.size, p.bound, p.offset, 
+			     &p.fidelity);
+
+  if(!p.data)
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman(p.offset[blocks] + (blocks + 1) * sizeof(unsigned long));
+
+  if(reg->hashw && reg->hash)
+    quantum_destroy_hash(reg);
+
+  quantum_free(reg->amplitude);
+  quantum_memman(-reg->size * sizeof(COMPLEX_FLOAT));
+
+  reg->amplitude = 0;
+  reg->state = 0;
+  reg->size = 0;
+
+  return p;
+}
+
+/* Decompress a packed register. P is emptied. */
+
+quantum_reg
+quantum_unpack_qureg(quantum_packed_reg *p)
+{
+  quantum_reg reg;
+  int b, n, blocks;
+
+  blocks = (p->size + QUANTUM_PACK_BLOCK - 1) / QUANTUM_PACK_BLOCK;
+
+  reg.width = p->width;
+  reg.size = p->size;
+  reg.hashw = p->hashw;
+  reg.state = p->state;
+  reg.hash = 0;
+
+  reg.amplitude = quantum_alloc(reg.size * sizeof(COMPLEX_FLOAT));
+
+  if(!reg.amplitude)
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman(reg.size * sizeof(COMPLEX_FLOAT));
+
+  for(b=0; b<blocks; b++)
+    {
+      n = p->size - b * QUANTUM_PACK_BLOCK;
+
+      if(n > QUANTUM_PACK_BLOCK)
+	n = QUANTUM_PACK_BLOCK;
+
+      quantum_unpack_block(p->data + p->offset[b], n, 
+			   reg.amplitude + b * QUANTUM_PACK_BLOCK);
+    }
+
+  if(reg.hashw)
+    {
+      reg.hash = quantum_calloc(1 << reg.hashw, sizeof(int));
+
+      if(!reg.hash)
+	quantum_error(QUANTUM_ENOMEM);
+
+      quantum_memman((1 << reg.hashw) * sizeof(int));
+    }
+
+  p->state = 0;
+  quantum_delete_packed_qureg(p);
+
+  return reg;
+}
+
+/* Delete a packed register */
+
+void
+quantum_delete_packed_qureg(quantum_packed_reg *p)
+{
+  int blocks;
+
+  blocks = (p->size + QUANTUM_PACK_BLOCK - 1) / QUANTUM_PACK_BLOCK;
+
+  if(p->offset)
+    quantum_memman(-(p->offset[blocks] 
+		     + (blocks + 1) * sizeof(unsigned long)));
+
+  if(p->state)
+    {
+      quantum_free(p->state);
+      quantum_memman(-p->size * sizeof(MAX_UNSIGNED));
+    }
+
+  free(p->data);
+  free(p->offset);
+
+  p->data = 0;
+  p->offset = 0;
+  p->state = 0;
+  p->size = 0;
+}
+
+/* Return the compression ratio of the amplitudes and the loss of
+   fidelity caused by lossy compression */
+
+void
+quantum_packed_info(quantum_packed_reg *p, double *ratio, double *loss)
+{
+  int blocks;
+
+  blocks = (p->size + QUANTUM_PACK_BLOCK - 1) / QUANTUM_PACK_BLOCK;
+
+  if(ratio)
+    *ratio = (double) p->size * sizeof(COMPLEX_FLOAT) 
+      / (p->offset[blocks] + (blocks + 1) * sizeof(unsigned long));
+
+  if(loss)
+    *loss = 1 - p->fidelity;
+}
+
+/* Multiply the amplitudes of all basis states where the bits in MASK
+   are set with Z. Each block is decompressed, updated and compressed
+   again. */
+
+static void
+quantum_packed_diag(MAX_UNSIGNED mask, COMPLEX_FLOAT z, 
+		    quantum_packed_reg *p)
+{
+  COMPLEX_FLOAT tmp[QUANTUM_PACK_BLOCK], a[QUANTUM_PACK_BLOCK];
+  unsigned char *data;
+  unsigned long len = 0, old;
+  double ore = 0, oim = 0, na = 0, nb = 0;
+  int b, i, n, blocks;
+
+  blocks = (p->size + QUANTUM_PACK_BLOCK - 1) / QUANTUM_PACK_BLOCK;
+  old = p->offset[blocks];
+
+  data = malloc(blocks * PACK_BOUND + 1);
+
+  if(!data)
+    quantum_error(QUANTUM_ENOMEM);
+
+  for(b=0; b<blocks; b++)
+    {
+      n = p->size - b * QUANTUM_PACK_BLOCK;
+
+      if(n > QUANTUM_PACK_BLOCK)
+	n = QUANTUM_PACK_BLOCK;
+
+      quantum_unpack_block(p->data + p->offset[b], n, tmp);
+
+      for(i=0; i<n; i++)
+	{
+	  if((p->state[b * QUANTUM_PACK_BLOCK + i] & mask) == mask)
+	    tmp[i] *= z;
+	}
+
+      p->offset[b] = len;
+      len += quantum_pack_block(tmp, n, p->bound, data + len);
+
+      if(p->bound > 0)
+	{
+	  quantum_unpack_block(data + p->offset[b], n, a);
+	  quantum_pack_overlap(tmp, a, n, &ore, &oim, &na, &nb);
+	}
+    }
+
+  p->offset[blocks] = len;
+
+  /* Errors introduced by recompression accumulate */
+
+  if(na > 0 && nb > 0)
+    p->fidelity *= (ore * ore + oim * oim) / (na * nb);
+
+  free(p->data);
+  p->data = realloc(data, len + 1);
+
+  quantum_memman((long) len - (long) old);
+
+  quantum_gate_counter(1);
+}
+
+/* Apply a toffoli gate to a packed register. As only the basis states
+   change, no decompression is needed. */
+
+void
+quantum_packed_toffoli(int control1, int control2, int target, 
+		       quantum_packed_reg *p)
+{
+  MAX_UNSIGNED c = ((MAX_UNSIGNED) 1 << control1) 
+    | ((MAX_UNSIGNED) 1 << control2);
+  int i;
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for(i=0; i<p->size; i++)
+    {
+      if((p->state[i] & c) == c)
+	p->state[i] ^= ((MAX_UNSIGNED) 1 << target);
+    }
+
+  quantum_gate_counter(1);
+}
+
+/* Apply a controlled-not gate to a packed register */
+
+void
+quantum_packed_cnot(int control, int target, quantum_packed_reg *p)
+{
+  quantum_packed_toffoli(control, control, target, p);
+}
+
+/* Apply a pauli x spin operator to a packed register */
+
+void
+quantum_packed_sigma_x(int target, quantum_packed_reg *p)
+{
+  int i;
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for(i=0; i<p->size; i++)
+    p->state[i] ^= ((MAX_UNSIGNED) 1 << target);
+
+  quantum_gate_counter(1);
+}
+
+/* Apply a pauli z spin operator to a packed register */
+
+void
+quantum_packed_sigma_z(int target, quantum_packed_reg *p)
+{
+  quantum_packed_diag((MAX_UNSIGNED) 1 << target, -1, p);
+}
+
+/* Phase shift a qubit of a packed register by GAMMA */
+
+void
+quantum_packed_phase_kick(int target, float gamma, quantum_packed_reg *p)
+{
+  quantum_packed_diag((MAX_UNSIGNED) 1 << target, quantum_cexp(gamma), p);
+}
+
+/* Apply a conditional phase shift by PI / 2^(CONTROL - TARGET) to a
+   packed register */
+
+void
+quantum_packed_cond_phase(int control, int target, quantum_packed_reg *p)
+{
+  quantum_packed_diag(((MAX_UNSIGNED) 1 << control) 
+		      | ((MAX_UNSIGNED) 1 << target), 
+		      quantum_cexp(pi / ((MAX_UNSIGNED) 1 
+					 << (control - target))), p);
+}
+
+/* Apply a conditional phase shift by GAMMA to a packed register */
+
+void
+quantum_packed_cond_phase_kick(int control, int target, float gamma, 
+			       quantum_packed_reg *p)
+{
+  quantum_packed_diag(((MAX_UNSIGNED) 1 << control) 
+		      | ((MAX_UNSIGNED) 1 << target), quantum_cexp(gamma), p);
+}
+
+/* Blocks written while a packed register is rebuilt. The fidelity of
+   the compressed blocks with respect to the exact amplitudes is
+   accumulated as in quantum_packed_diag. */
+
+struct quantum_pack_writer_struct
+{
+  unsigned char *data;
+  unsigned long *offset;
+  unsigned long len;
+  int blocks;
+  int fill;
+  double bound;
+  double ore, oim, na, nb;
+  COMPLEX_FLOAT buf[QUANTUM_PACK_BLOCK];
+};
+
+typedef struct quantum_pack_writer_struct quantum_pack_writer;
+
+/* Compress the amplitudes collected by W into a new block */
+
+static void
+quantum_pack_writer_flush(quantum_pack_writer *w)
+{
+  COMPLEX_FLOAT a[QUANTUM_PACK_BLOCK];
+
+  if(!w->fill)
+    return;
+
+  w->offset[w->blocks] = w->len;
+  w->len += quantum_pack_block(w->buf, w->fill, w->bound, w->data + w->len);
+
+  if(w->bound > 0)
+    {
+      quantum_unpack_block(w->data + w->offset[w->blocks], w->fill, a);
+      quantum_pack_overlap(w->buf, a, w->fill, &w->ore, &w->oim, 
+			   &w->na, &w->nb);
+    }
+
+  w->blocks++;
+  w->fill = 0;
+}
+
+/* Append the amplitude A to the blocks written by W */
+
+static void
+quantum_pack_writer_put(quantum_pack_writer *w, COMPLEX_FLOAT a)
+{
+  w->buf[w->fill++] = a;
+
+  if(w->fill == QUANTUM_PACK_BLOCK)
+    quantum_pack_writer_flush(w);
+}
+
+/* Return amplitude I of a packed register. Decompressed blocks are
+   kept in CACHE, which holds PACK_CACHE blocks tagged by TAG. */
+
+static COMPLEX_FLOAT
+quantum_packed_get(quantum_packed_reg *p, int i, COMPLEX_FLOAT *cache, 
+		   int *tag)
+{
+  int b, n, slot;
+
+  b = i / QUANTUM_PACK_BLOCK;
+  slot = b % PACK_CACHE;
+
+  if(tag[slot] != b)
+    {
+      n = p->size - b * QUANTUM_PACK_BLOCK;
+
+      if(n > QUANTUM_PACK_BLOCK)
+	n = QUANTUM_PACK_BLOCK;
+
+      quantum_unpack_block(p->data + p->offset[b], n, 
+			   cache + slot * QUANTUM_PACK_BLOCK);
+      tag[slot] = b;
+    }
+
+  return cache[slot * QUANTUM_PACK_BLOCK + i % QUANTUM_PACK_BLOCK];
+}
+
+/* Order basis states by their value without the target bit, so that
+   partner states become neighbours. qsort() has no argument for
+   this, hence the static variables. */
+
+static MAX_UNSIGNED *pack_sort_state;
+static MAX_UNSIGNED pack_sort_bit;
+
+static int
+quantum_packed_compare(const void *a, const void *b)
+{
+  MAX_UNSIGNED x = pack_sort_state[*(int *) a];
+  MAX_UNSIGNED y = pack_sort_state[*(int *) b];
+
+  if((x & ~pack_sort_bit) != (y & ~pack_sort_bit))
+    return ((x & ~pack_sort_bit) > (y & ~pack_sort_bit)) ? 1 : -1;
+
+  return (x > y) - (x < y);
+}
+
+/* Apply the 2x2 matrix M to the target bit of a packed register. M
+   should be unitary. The basis states are visited pairwise in the
+   order of their value without the target bit. The amplitudes are
+   decompressed block by block as they are needed and the results are
+   compressed into new blocks in the same order, so that only a few
+   blocks are uncompressed at any time. Partner states are created
+   and states with extremely small amplitude are dropped as in
+   quantum_gate1. */
+
+void
+quantum_packed_gate1(int target, quantum_matrix m, quantum_packed_reg *p)
+{
+  quantum_pack_writer w;
+  MAX_UNSIGNED bit = (MAX_UNSIGNED) 1 << target, s, *state;
+  COMPLEX_FLOAT *cache, a0, a1, b0, b1;
+  unsigned long old;
+  int tag[PACK_CACHE];
+  int *order;
+  int i, k, e0, e1, size, blocks;
+  float limit;
+
+  if((m.cols != 2) || (m.rows != 2))
+    quantum_error(QUANTUM_EMSIZE);
+
+  blocks = (p->size + QUANTUM_PACK_BLOCK - 1) / QUANTUM_PACK_BLOCK;
+  old = p->offset[blocks] + (blocks + 1) * sizeof(unsigned long);
+
+  /* The register grows by at most a factor of two */
+
+  order = malloc((p->size + 1) * sizeof(int));
+  cache = malloc(PACK_CACHE * QUANTUM_PACK_BLOCK * sizeof(COMPLEX_FLOAT));
+  state = quantum_alloc(2 * p->size * sizeof(MAX_UNSIGNED));
+  w.offset = malloc((2 * blocks + 1) * sizeof(unsigned long));
+  w.data = malloc(2 * blocks * PACK_BOUND + 1);
+
+  if(!(order && cache && state && w.offset && w.data))
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman(2 * p->size * sizeof(MAX_UNSIGNED));
+
+  for(i=0; i<p->size; i++)
+    order[i] = i;
+
+  pack_sort_state = p->state;
+  pack_sort_bit = bit;
+
+  qsort(order, p->size, sizeof(int), quantum_packed_compare);
+
+  for(i=0; i<PACK_CACHE; i++)
+    tag[i] = -1;
+
+  w.len = 0;
+  w.blocks = 0;
+  w.fill = 0;
+  w.bound = p->bound;
+  w.ore = w.oim = w.na = w.nb = 0;
+
+  limit = (1.0 / ((MAX_UNSIGNED) 1 << p->width)) * epsilon;
+
+  for(k=0, size=0; k<p->size; k++)
+    {
+      s = p->state[order[k]] & ~bit;
+      a0 = 0;
+      a1 = 0;
+      e0 = 0;
+      e1 = 0;
+
+      if(p->state[order[k]] & bit)
+	{
+	  e1 = 1;
+	  a1 = quantum_packed_get(p, order[k], cache, tag);
+	}
+      else
+	{
+	  e0 = 1;
+	  a0 = quantum_packed_get(p, order[k], cache, tag);
+
+	  if((k + 1 < p->size) && (p->state[order[k+1]] == (s | bit)))
+	    {
+	      e1 = 1;
+	      a1 = quantum_packed_get(p, order[++k], cache, tag);
+	    }
+	}
+
+      b0 = m.t[0] * a0 + m.t[1] * a1;
+      b1 = m.t[2] * a0 + m.t[3] * a1;
+
+      /* A missing partner only appears if M mixes it in */
+
+      if((e0 || (m.t[1] != 0)) 
+	 && (!p->hashw || (quantum_prob_inline(b0) >= limit)))
+	{
+	  state[size++] = s;
+	  quantum_pack_writer_put(&w, b0);
+	}
+
+      if((e1 || (m.t[2] != 0)) 
+	 && (!p->hashw || (quantum_prob_inline(b1) >= limit)))
+	{
+	  state[size++] = s | bit;
+	  quantum_pack_writer_put(&w, b1);
+	}
+    }
+
+  quantum_pack_writer_flush(&w);
+  w.offset[w.blocks] = w.len;
+
+  free(order);
+  free(cache);
+
+  quantum_free(p->state);
+  quantum_memman(-p->size * sizeof(MAX_UNSIGNED));
+
+  p->state = quantum_realloc(state, size * sizeof(MAX_UNSIGNED));
+
+  if(size && !p->state)
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman((size - 2 * (long) p->size) * sizeof(MAX_UNSIGNED));
+
+  free(p->data);
+  free(p->offset);
+
+  p->data = realloc(w.data, w.len + 1);
+  p->offset = realloc(w.offset, (w.blocks + 1) * sizeof(unsigned long));
+  p->size = size;
+
+  quantum_memman((long) (w.len + (w.blocks + 1) * sizeof(unsigned long))
+		 - (long) old);
+
+  /* Errors introduced by recompression accumulate */
+
+  if(w.na > 0 && w.nb > 0)
+    p->fidelity *= (w.ore * w.ore + w.oim * w.oim) / (w.na * w.nb);
+
+  quantum_gate_counter(1);
+}
+
+/* Apply a hadamard gate to a packed register */
+
+void
+quantum_packed_hadamard(int target, quantum_packed_reg *p)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = sqrt(1.0/2);  m.t[1] = sqrt(1.0/2);
+  m.t[2] = sqrt(1.0/2);  m.t[3] = -sqrt(1.0/2);
+
+  quantum_packed_gate1(target, m, p);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a rotation about the x-axis by the angle GAMMA to a packed
+   register */
+
+void
+quantum_packed_r_x(int target, float gamma, quantum_packed_reg *p)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = cos(gamma / 2);              m.t[1] = -IMAGINARY * sin(gamma / 2);
+  m.t[2] = -IMAGINARY * sin(gamma / 2); m.t[3] = cos(gamma / 2);
+
+  quantum_packed_gate1(target, m, p);
+
+  quantum_delete_matrix(&m);
+}
+
+/* Apply a rotation about the y-axis by the angle GAMMA to a packed
+   register */
+
+void
+quantum_packed_r_y(int target, float gamma, quantum_packed_reg *p)
+{
+  quantum_matrix m;
+
+  m = quantum_new_matrix(2, 2);
+
+  m.t[0] = cos(gamma / 2);  m.t[1] = -sin(gamma / 2);
+  m.t[2] = sin(gamma / 2);  m.t[3] = cos(gamma / 2);
+
+  quantum_packed_gate1(target, m, p);
+
+  quantum_delete_matrix(&m);
+}
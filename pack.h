@@ -0,0 +1,78 @@
+/* pack.h: Declarations for pack.c
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#ifndef __PACK_H
+
+#define __PACK_H
+
+#include "config.h"
+#include "qureg.h"
+#include "matrix.h"
+
+/* Number of amplitudes per compressed block */
+
+#define QUANTUM_PACK_BLOCK 256
+
+/* A quantum register with compressed amplitudes */
+
+struct quantum_packed_reg_struct
+{
+  int width;              /* number of qubits in the qureg */
+  int size;               /* number of non-zero vectors */
+  int hashw;              /* width of the hash array */
+  MAX_UNSIGNED *state;    /* basis states, uncompressed */
+  unsigned long *offset;  /* start of each block in DATA */
+  unsigned char *data;    /* compressed amplitudes */
+  double bound;           /* maximum error per component, 0 if lossless */
+  double fidelity;        /* fidelity with respect to the exact state */
+};
+
+typedef struct quantum_packed_reg_struct quantum_packed_reg;
+
+extern quantum_packed_reg quantum_pack_qureg(double bound, quantum_reg *reg);
+extern quantum_reg quantum_unpack_qureg(quantum_packed_reg *p);
+extern void quantum_delete_packed_qureg(quantum_packed_reg *p);
+extern void quantum_packed_info(quantum_packed_reg *p, double *ratio, 
+				double *loss);
+
+extern void quantum_packed_cnot(int control, int target, 
+				quantum_packed_reg *p);
+extern void quantum_packed_toffoli(int control1, int control2, int target, 
+				   quantum_packed_reg *p);
+extern void quantum_packed_sigma_x(int target, quantum_packed_reg *p);
+extern void quantum_packed_sigma_z(int target, quantum_packed_reg *p);
+extern void quantum_packed_phase_kick(int target, float gamma, 
+				      quantum_packed_reg *p);
+extern void quantum_packed_cond_phase(int control, int target, 
+				      quantum_packed_reg *p);
+extern void quantum_packed_cond_phase_kick(int control, int target, 
+					   float gamma, quantum_packed_reg *p);
+extern void quantum_packed_gate1(int target, quantum_matrix m, 
+				 quantum_packed_reg *p);
+extern void quantum_packed_hadamard(int target, quantum_packed_reg *p);
+extern void quantum_packed_r_x(int target, float gamma, 
+			       quantum_packed_reg *p);
+extern void quantum_packed_r_y(int target, float gamma, 
+			       quantum_packed_reg *p);
+
+#endif
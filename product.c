@@ -0,0 +1,509 @@
+/* product.c: Quantum registers kept as products of unentangled factors
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "product.h"
+#include "config.h"
+#include "complex.h"
+#include "matrix.h"
+#include "qureg.h"
+#include "objcode.h"
+#include "measure.h"
+#include "decoherence.h"
+#include "defer.h"
+#include "error.h"
+#include "alloc.h"
+
+/* A register in a product state needs only the sum of the sizes of
+   its factors instead of their product. While a register is kept
+   this way, a gate acting on the qubits of a single factor is applied
+   to that factor alone. A gate coupling several factors first merges
+   them, along with any factors in between, into one. Scratch qubits
+   and Kronecker products are added as new factors. Any other
+   operation builds the state vector. As in deferred mode, only one
+   register can be kept this way at a time. */
+
+/* The register kept as a product, or 0 */
+
+static quantum_reg *prod_reg = 0;
+
+/* Its factors, starting with the least significant qubits */
+
+static quantum_reg *prod_factor = 0;
+static int prod_num = 0;
+
+/* Return the first qubit of factor I */
+
+static int
+quantum_product_offset(int i)
+{
+  int k, offset = 0;
+
+  for(k=0; k<i; k++)
+    offset += prod_factor[k].width;
+
+  return offset;
+}
+
+/* Return the factor holding qubit A */
+
+static int
+quantum_product_find(int a)
+{
+  int k;
+
+  for(k=0; k<prod_num-1; k++)
+    {
+      if(a < prod_factor[k].width)
+	break;
+
+      a -= prod_factor[k].width;
+    }
+
+  return k;
+}
+
+/* Allocate and fill the hash table of a factor. As for the register
+   itself, the width of the table is WIDTH+2, but no more than that of
+   the register, and large enough for SIZE basis states. */
+
+static void
+quantum_product_hash(quantum_reg *reg)
+{
+  int hashw;
+
+  hashw = reg->width + 2;
+
+  if(prod_reg->hashw && (hashw > prod_reg->hashw))
+    hashw = prod_reg->hashw;
+
+  while((1 << (hashw - 1)) < reg->size)
+    hashw++;
+
+  if(reg->hash)
+    quantum_destroy_hash(reg);
+
+  reg->hashw = hashw;
+  reg->hash = quantum_calloc(1 << hashw, sizeof(int));
+
+  if(!reg->hash)
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman((1 << hashw) * sizeof(int));
+
+  quantum_reconstruct_hash(reg);
+}
+
+/* Insert REG as factor I */
+
+static void
+quantum_product_insert(int i, quantum_reg *reg)
+{
+  prod_factor = realloc(prod_factor, (prod_num + 1) * sizeof(quantum_reg));
+
+  if(!prod_factor)
+    quantum_error(QUANTUM_ENOMEM);
+
+  memmove(&prod_factor[i+1], &prod_factor[i], 
+	  (prod_num - i) * sizeof(quantum_reg));
+
+  prod_factor[i] = *reg;
+  prod_num++;
+}
+
+/* Remove factor I from the list */
+
+static void
+quantum_product_remove(int i)
+{
+  memmove(&prod_factor[i], &prod_factor[i+1], 
+	  (prod_num - i - 1) * sizeof(quantum_reg));
+  prod_num--;
+}
+
+/* Merge the factors I to J into one */
+
+static void
+quantum_product_merge(int i, int j)
+{
+  quantum_reg hi, lo, reg;
+  int k, m, n;
+
+  for(k=j; k>i; k--)
+    {
+      hi = prod_factor[k];
+      lo = prod_factor[k-1];
+
+      reg.width = hi.width + lo.width;
+      reg.size = hi.size * lo.size;
+      reg.hashw = 0;
+      reg.hash = 0;
+
+      reg.amplitude = quantum_alloc(reg.size * sizeof(COMPLEX_FLOAT));
+      reg.state = quantum_alloc(reg.size * sizeof(MAX_UNSIGNED));
+
+      if(!(reg.state && reg.amplitude))
+	quantum_error(QUANTUM_ENOMEM);
+
+      quantum_memman(reg.size * (sizeof(COMPLEX_FLOAT) + sizeof(MAX_UNSIGNED)));
+
+      for(m=0; m<hi.size; m++)
+	{
+	  for(n=0; n<lo.size; n++)
+	    {
+	      reg.state[m*lo.size+n] = (hi.state[m] << lo.width) | lo.state[n];
+	      reg.amplitude[m*lo.size+n] = hi.amplitude[m] * lo.amplitude[n];
+	    }
+	}
+
+      quantum_product_hash(&reg);
+
+      quantum_delete_qureg(&hi);
+      quantum_delete_qureg(&lo);
+
+      prod_factor[k-1] = reg;
+      quantum_product_remove(k);
+    }
+}
+
+/* Start keeping REG as a product. REG becomes the only factor, further
+   ones are added by quantum_addscratch and quantum_product_kronecker. */
+
+void
+quantum_product_start(quantum_reg *reg)
+{
+  quantum_reg f;
+
+  if(quantum_product_active(reg))
+    return;
+
+  quantum_flush(reg);
+
+  if(prod_reg)
+    quantum_product_stop(prod_reg);
+
+  if(!reg->state)
+    return;
+
+  prod_reg = reg;
+
+  f = *reg;
+
+  if(!f.hash)
+    quantum_product_hash(&f);
+
+  quantum_product_insert(0, &f);
+
+  /* REG itself only keeps a placeholder */
+
+  reg->size = 1;
+  reg->hash = 0;
+  reg->state = quantum_calloc(1, sizeof(MAX_UNSIGNED));
+  reg->amplitude = quantum_calloc(1, sizeof(COMPLEX_FLOAT));
+
+  if(!(reg->state && reg->amplitude))
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman(sizeof(MAX_UNSIGNED) + sizeof(COMPLEX_FLOAT));
+}
+
+/* Build the state vector of REG from its factors and stop keeping it
+   as a product. REG may also be a copy of the register, as passed by
+   value to quantum_print_qureg, in which case it is updated
+   afterwards. */
+
+void
+quantum_product_stop(quantum_reg *reg)
+{
+  quantum_reg *out;
+
+  if(!quantum_product_active(reg))
+    return;
+
+  out = prod_reg;
+
+  quantum_product_merge(0, prod_num - 1);
+
+  quantum_free(out->state);
+  quantum_free(out->amplitude);
+  quantum_memman(-out->size * (sizeof(MAX_UNSIGNED) + sizeof(COMPLEX_FLOAT)));
+
+  *out = prod_factor[0];
+
+  free(prod_factor);
+  prod_factor = 0;
+  prod_num = 0;
+  prod_reg = 0;
+
+  if(reg != out)
+    *reg = *out;
+}
+
+/* Stop keeping a register as a product which is about to be deleted */
+
+void
+quantum_product_drop(quantum_reg *reg)
+{
+  int i;
+
+  if(!quantum_product_active(reg))
+    return;
+
+  for(i=0; i<prod_num; i++)
+    quantum_delete_qureg(&prod_factor[i]);
+
+  free(prod_factor);
+  prod_factor = 0;
+  prod_num = 0;
+  prod_reg = 0;
+}
+
+/* Check whether REG is kept as a product */
+
+int
+quantum_product_active(quantum_reg *reg)
+{
+  return prod_reg && ((reg == prod_reg) || (reg->state == prod_reg->state));
+}
+
+/* Return the number of factors of REG */
+
+int
+quantum_product_factors(quantum_reg *reg)
+{
+  if(!quantum_product_active(reg))
+    return 0;
+
+  return prod_num;
+}
+
+/* Replace REG1 by its Kronecker product with REG2, keeping a copy of
+   REG2 as a separate factor below the qubits of REG1 */
+
+void
+quantum_product_kronecker(quantum_reg *reg1, quantum_reg *reg2)
+{
+  quantum_reg f;
+
+  quantum_flush(reg2);
+  quantum_product_start(reg1);
+
+  if(!quantum_product_active(reg1))
+    return;
+
+  quantum_copy_qureg(reg2, &f);
+  quantum_product_insert(0, &f);
+
+  prod_reg->width += reg2->width;
+  prod_reg->hashw = prod_reg->width + 2;
+
+  quantum_product_hash(&prod_factor[0]);
+
+  reg1->width = prod_reg->width;
+  reg1->hashw = prod_reg->hashw;
+}
+
+/* Apply the gate INSN to REG if it is kept as a product. The gate is
+   executed on the factor holding its qubits, after merging factors
+   if needed. Returns 1 if the gate has been applied and must not be
+   executed. Otherwise, the state vector is built for the gate to act
+   on. Decoherence is only simulated on the state vector. */
+
+int
+quantum_product_put(quantum_reg *reg, quantum_objcode_insn *insn)
+{
+  quantum_objcode_insn t;
+  int i, j, k, n, lo, hi, offset;
+  int *a = insn->arg;
+
+  if(!quantum_product_active(reg))
+    return 0;
+
+  switch(insn->op)
+    {
+    case SIGMA_X:
+    case SIGMA_Y:
+    case SIGMA_Z:
+    case HADAMARD:
+    case ROT_X:
+    case ROT_Y:
+    case ROT_Z:
+    case PHASE_KICK:
+      n = 1;
+      break;
+
+    case CNOT:
+    case COND_PHASE:
+    case CPHASE_KICK:
+    case SWAPBITS:
+      n = 2;
+      break;
+
+    case TOFFOLI:
+      n = 3;
+      break;
+
+    case PHASE_SCALE:
+    case SWAPLEADS:
+    case BITREVERSE:
+      n = 0;
+      break;
+
+    default:
+      n = -1;
+    }
+
+  lo = 0;
+  hi = 0;
+
+  if(n > 0)
+    {
+      lo = a[0];
+      hi = a[0];
+
+      for(k=1; k<n; k++)
+	{
+	  if(a[k] < lo)
+	    lo = a[k];
+
+	  if(a[k] > hi)
+	    hi = a[k];
+	}
+    }
+
+  /* SWAPLEADS acts on the lowest 2 * A[0] qubits */
+
+  else if((insn->op == SWAPLEADS) && (a[0] > 0))
+    hi = 2 * a[0] - 1;
+
+  /* BITREVERSE acts on the lowest A[0] qubits */
+
+  else if((insn->op == BITREVERSE) && (a[0] > 0))
+    hi = a[0] - 1;
+
+  if(quantum_status || (n < 0) || (lo < 0) || (hi >= prod_reg->width))
+    {
+      quantum_product_stop(reg);
+      return 0;
+    }
+
+  i = quantum_product_find(lo);
+  j = quantum_product_find(hi);
+
+  if(i != j)
+    quantum_product_merge(i, j);
+
+  offset = quantum_product_offset(i);
+
+  t = *insn;
+
+  for(k=0; k<n; k++)
+    t.arg[k] -= offset;
+
+  quantum_objcode_exec(&t, &prod_factor[i]);
+
+  return 1;
+}
+
+/* Measure all qubits of REG without changing it, see
+   quantum_measure. Each factor is measured on its own. For registers
+   wider than MAX_UNSIGNED, only the lower bits are returned. */
+
+MAX_UNSIGNED
+quantum_product_measure(quantum_reg *reg)
+{
+  MAX_UNSIGNED result = 0, m;
+  int i, offset = 0;
+
+  for(i=0; i<prod_num; i++)
+    {
+      m = quantum_measure(prod_factor[i]);
+
+      if(m == (MAX_UNSIGNED) -1)
+	return -1;
+
+      if(offset < 8 * (int) sizeof(MAX_UNSIGNED))
+	result |= m << offset;
+
+      offset += prod_factor[i].width;
+    }
+
+  return result;
+}
+
+/* Measure qubit POS of REG, see quantum_bmeasure and
+   quantum_bmeasure_bitpreserve. Unless PRESERVE is set, the qubit is
+   removed from the register afterwards. */
+
+int
+quantum_product_bmeasure(int pos, int preserve, quantum_reg *reg)
+{
+  quantum_reg *f;
+  int i, result;
+
+  if((pos < 0) || (pos >= prod_reg->width))
+    return 0;
+
+  i = quantum_product_find(pos);
+  f = &prod_factor[i];
+  pos -= quantum_product_offset(i);
+
+  if(preserve)
+    return quantum_bmeasure_bitpreserve(pos, f);
+
+  result = quantum_bmeasure(pos, f);
+
+  prod_reg->width--;
+  reg->width = prod_reg->width;
+
+  /* A factor without qubits only contributes a phase */
+
+  if(!f->width && (prod_num > 1))
+    {
+      quantum_scalar_qureg(f->amplitude[0], &prod_factor[i ? 0 : 1]);
+      quantum_delete_qureg(f);
+      quantum_product_remove(i);
+    }
+
+  return result;
+}
+
+/* Add BITS scratch qubits as a new factor below the qubits of REG,
+   see quantum_addscratch */
+
+void
+quantum_product_addscratch(int bits, quantum_reg *reg)
+{
+  quantum_reg f;
+
+  f = quantum_new_qureg_sparse(1, bits);
+  f.amplitude[0] = 1;
+
+  quantum_product_hash(&f);
+  quantum_product_insert(0, &f);
+
+  prod_reg->width += bits;
+  reg->width = prod_reg->width;
+}
@@ -21,39 +21,312 @@
 
 */
 
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+
+#include "config.h"
+#include "defs.h"
+#include "complex.h"
 #include "gates.h"
 #include "qureg.h"
+#include "decoherence.h"
+#include "qec.h"
+#include "objcode.h"
+#include "defer.h"
+#include "checkpoint.h"
+#include "error.h"
+#include "alloc.h"
 
-/* Perform a QFT on a quantum register. This is done by application of
-   conditional phase shifts and hadamard gates. At the end, the
-   position of the bits is reversed. */
+/* Compare two basis states for qsort() */
 
-void quantum_qft(int width, quantum_reg *reg)
+static int
+quantum_qft_compare(const void *a, const void *b)
+{
+  MAX_UNSIGNED x = *(MAX_UNSIGNED *) a;
+  MAX_UNSIGNED y = *(MAX_UNSIGNED *) b;
+
+  return (x > y) - (x < y);
+}
+
+/* Return the index of HIGH in the sorted array GROUP of length N */
+
+static int
+quantum_qft_group(MAX_UNSIGNED high, MAX_UNSIGNED *group, int n)
+{
+  int lo = 0, hi = n - 1, mid;
+
+  while(lo < hi)
+    {
+      mid = (lo + hi) / 2;
+
+      if(group[mid] < high)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  return lo;
+}
+
+/* Compute the QFT (SIGN = 1) or its inverse (SIGN = -1) of the lowest
+   WIDTH qubits as a batch of radix-2 FFTs, one for each value of the
+   higher qubits that occurs in the register. The amplitudes are
+   scattered into a dense array of 2^WIDTH entries per such value
+   first, so this is only done if that array is at most four times
+   the size of the register. The QFT leaves its output in bit-reversed
+   order, which is what a decimation-in-frequency FFT produces; its
+   inverse expects such an input and is done by decimation in time.
+   Returns 0 if the gates have to be applied instead, as the FFT does
+   not act on single gates (see quantum_objcode_run_native). */
+
+static int
+quantum_qft_fft(int width, int sign, quantum_reg *reg)
+{
+  int i, j, k, h, l, n, r, qec, size, groups;
+  MAX_UNSIGNED *group = 0, mask;
+  COMPLEX_FLOAT *a, *w, t;
+  float limit, norm;
+
+  quantum_qec_get_status(&qec, NULL);
+
+  if(qec || quantum_status || quantum_objcode_status()
+     || quantum_checkpoint_active() || quantum_flush_pending(reg))
+    return 0;
+
+  if((width < 1) || (width > reg->width) || !reg->state
+     || (width >= sizeof(int) * 8 - 1)
+     || ((MAX_UNSIGNED) 1 << width > 4 * (MAX_UNSIGNED) reg->size))
+    return 0;
+
+  /* Collect the values of the higher qubits, unless the register
+     holds every basis state */
+
+  if((reg->width < sizeof(int) * 8 - 1) 
+     && ((MAX_UNSIGNED) 1 << reg->width == reg->size))
+    groups = 1 << (reg->width - width);
+  else
+    {
+      group = malloc(reg->size * sizeof(MAX_UNSIGNED));
+
+      if(!group)
+	quantum_error(QUANTUM_ENOMEM);
+
+      for(i=0; i<reg->size; i++)
+	group[i] = reg->state[i] >> width;
+
+      qsort(group, reg->size, sizeof(MAX_UNSIGNED), quantum_qft_compare);
+
+      for(i=1, groups=1; i<reg->size; i++)
+	{
+	  if(group[i] != group[groups-1])
+	    group[groups++] = group[i];
+	}
+
+      if(((MAX_UNSIGNED) groups << width > 4 * (MAX_UNSIGNED) reg->size)
+	 || ((MAX_UNSIGNED) groups << width > (unsigned int) -1 >> 1))
+	{
+	  free(group);
+	  return 0;
+	}
+    }
+
+  quantum_copy_mapped(reg);
+
+  n = groups << width;
+  mask = ((MAX_UNSIGNED) 1 << width) - 1;
+
+  a = quantum_calloc(n, sizeof(COMPLEX_FLOAT));
+  w = quantum_alloc((1 << (width - 1)) * sizeof(COMPLEX_FLOAT));
+
+  if(!(a && w))
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman((n + (1 << (width - 1))) * sizeof(COMPLEX_FLOAT));
+
+  for(k=0; k<1<<(width-1); k++)
+    w[k] = cos(2 * pi * k / (1 << width)) 
+      + IMAGINARY * sign * sin(2 * pi * k / (1 << width));
+
+  norm = 1 / sqrt(1 << width);
+
+#ifdef _OPENMP
+#pragma omp parallel for private (k)
+#endif
+  for(i=0; i<reg->size; i++)
+    {
+      k = reg->state[i] >> width;
+
+      if(group)
+	k = quantum_qft_group(k, group, groups);
+
+      a[((MAX_UNSIGNED) k << width) | (reg->state[i] & mask)] 
+	= reg->amplitude[i] * norm;
+    }
+
+  /* Each stage is a single loop over the butterflies of all FFTs. H
+     is the distance of the partners, the twiddle factors are taken
+     from every 2^R-th entry of W. */
+
+  for(l=0; l<width; l++)
+    {
+      r = (sign > 0) ? l : width - 1 - l;
+      h = 1 << (width - 1 - r);
+
+#ifdef _OPENMP
+#pragma omp parallel for private (i, j, t)
+#endif
+      for(k=0; k<n/2; k++)
+	{
+	  j = k & (h - 1);
+	  i = ((k - j) << 1) + j;
+
+	  if(sign > 0)
+	    {
+	      t = a[i] - a[i+h];
+	      a[i] += a[i+h];
+	      a[i+h] = t * w[j << r];
+	    }
+	  else
+	    {
+	      t = a[i+h] * w[j << r];
+	      a[i+h] = a[i] - t;
+	      a[i] += t;
+	    }
+	}
+    }
+
+  /* Copy the result back, dropping basis states with extremely small
+     amplitude like quantum_gate1 */
+
+  limit = (1.0 / ((MAX_UNSIGNED) 1 << reg->width)) * epsilon;
+
+  for(k=0, size=0; k<n; k++)
+    {
+      if(!reg->hashw || (quantum_prob_inline(a[k]) >= limit))
+	size++;
+    }
+
+  if(size != reg->size)
+    {
+      reg->state = quantum_realloc(reg->state, size * sizeof(MAX_UNSIGNED));
+      reg->amplitude = quantum_realloc(reg->amplitude, 
+				       size * sizeof(COMPLEX_FLOAT));
+
+      if(size && !(reg->state && reg->amplitude))
+	quantum_error(QUANTUM_ENOMEM);
+
+      quantum_memman((size - reg->size) 
+		     * (long) (sizeof(MAX_UNSIGNED) + sizeof(COMPLEX_FLOAT)));
+
+      reg->size = size;
+    }
+
+  for(k=0, i=0; k<n; k++)
+    {
+      if(!reg->hashw || (quantum_prob_inline(a[k]) >= limit))
+	{
+	  reg->state[i] = group ? (group[k >> width] << width) | (k & mask) : k;
+	  reg->amplitude[i] = a[k];
+	  i++;
+	}
+    }
+
+  free(group);
+  quantum_free(a);
+  quantum_free(w);
+  quantum_memman(-(n + (1 << (width - 1))) * sizeof(COMPLEX_FLOAT));
+
+  quantum_gate_counter(width * (width + 1) / 2);
+
+  return 1;
+}
+
+/* Largest distance of two qubits whose conditional phase shift by
+   pi / 2^distance can still be resolved by COMPLEX_FLOAT. Phase
+   shifts between qubits farther apart change the amplitudes by less
+   than their precision. */
+
+int
+quantum_qft_cutoff()
+{
+  if(sizeof(COMPLEX_FLOAT) > 2 * sizeof(float))
+    return DBL_MANT_DIG + 1;
+
+  return FLT_MANT_DIG + 1;
+}
+
+/* Perform an approximate QFT, skipping the conditional phase shifts
+   between qubits more than MAX_DISTANCE apart. Returns an upper bound
+   on the operator norm of the difference between the approximate and
+   the exact QFT. A skipped shift by an angle t contributes
+   |1 - exp(it)| = 2 sin(t/2), and no two unitary operators are further
+   apart than 2. */
+
+double
+quantum_qft_approx(int width, int max_distance, quantum_reg *reg)
 {
   int i, j;
+  double err = 0;
 
   for(i=width-1; i>=0; i--)
     {
       for(j=width-1; j>i; j--)
-	quantum_cond_phase(j, i, reg);
+	{
+	  if(j - i <= max_distance)
+	    quantum_cond_phase(j, i, reg);
+	  else
+	    err += 2 * sin(ldexp(pi, i - j - 1));
+	}
 
       quantum_hadamard(i, reg);
     }
 
+  return err < 2 ? err : 2;
 }
 
+/* Inverse of quantum_qft_approx */
 
-void quantum_qft_inv(int width, quantum_reg *reg)
+double
+quantum_qft_inv_approx(int width, int max_distance, quantum_reg *reg)
 {
   int i, j;
+  double err = 0;
 
   for(i=0; i<width; i++)
     {
       quantum_hadamard(i, reg);
 
       for(j=i+1; j<width; j++)
-	quantum_cond_phase_inv(j, i, reg);
-
+	{
+	  if(j - i <= max_distance)
+	    quantum_cond_phase_inv(j, i, reg);
+	  else
+	    err += 2 * sin(ldexp(pi, i - j - 1));
+	}
     }
 
+  return err < 2 ? err : 2;
+}
+
+/* Perform a QFT on a quantum register. This is done by an FFT if
+   possible, otherwise by application of conditional phase shifts and
+   hadamard gates, leaving out the shifts below the precision of the
+   amplitudes. At the end, the position of the bits is reversed. */
+
+void quantum_qft(int width, quantum_reg *reg)
+{
+  if(quantum_qft_fft(width, 1, reg))
+    return;
+
+  quantum_qft_approx(width, quantum_qft_cutoff(), reg);
+}
+
+
+void quantum_qft_inv(int width, quantum_reg *reg)
+{
+  if(quantum_qft_fft(width, -1, reg))
+    return;
+
+  quantum_qft_inv_approx(width, quantum_qft_cutoff(), reg);
 }
@@ -29,4 +29,10 @@ extern void quantum_qft(int width, quantum_reg *reg);
 
 extern void quantum_qft_inv(int width, quantum_reg *reg);
 
+extern int quantum_qft_cutoff();
+extern double quantum_qft_approx(int width, int max_distance, 
+				 quantum_reg *reg);
+extern double quantum_qft_inv_approx(int width, int max_distance, 
+				     quantum_reg *reg);
+
 #endif
@@ -28,6 +28,7 @@
 #include "qtime.h"
 #include "qureg.h"
 #include "complex.h"
+#include "defer.h"
 #include "config.h"
 
 /* Forth-order Runge-Kutta
@@ -46,6 +47,8 @@ quantum_rk4(quantum_reg *reg, double t, double dt,
   int hashw;
   COMPLEX_FLOAT step = dt;
 
+  quantum_flush(reg);
+
   hash = reg->hash;
   reg->hash = 0;
 
@@ -122,6 +125,8 @@ quantum_rk4a(quantum_reg *reg, double t, double *dt, double epsilon,
   void *hash;
   int hashw;
 
+  quantum_flush(reg);
+
   hash = reg->hash;
   reg->hash = 0;
 
@@ -33,9 +33,18 @@ int main(int argc, char **argv)
   char *envstr;
   extern char **environ;
 
+  /* -z enables compression of the object code file */
+
+  if(argc > 1 && !strcmp(argv[1], "-z"))
+    {
+      putenv("QUOBCOMPRESS=1");
+      argv++;
+      argc--;
+    }
+
   if(argc < 3)
     {
-      printf("Usage: quopdump [file] [program] [[args]]\n\n");
+      printf("Usage: quopdump [-z] [file] [program] [[args]]\n\n");
       return 1;
     }
 
@@ -0,0 +1,92 @@
+/* quobopt.c: Optimize a quantum object code file
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "circuit.h"
+#include "qureg.h"
+
+/* Replay a circuit and return the elapsed time in seconds */
+
+double
+quobopt_time(quantum_circuit *circ)
+{
+  quantum_reg reg;
+  struct timeval start, end;
+
+  reg.size = 0;
+  reg.hashw = 0;
+  reg.amplitude = 0;
+  reg.state = 0;
+  reg.hash = 0;
+
+  gettimeofday(&start, 0);
+  quantum_circuit_run(circ, &reg);
+  gettimeofday(&end, 0);
+
+  quantum_delete_qureg(&reg);
+
+  return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+  quantum_circuit circ;
+  unsigned long before, after;
+  double t1, t2;
+
+  if(argc != 3)
+    {
+      printf("Usage: quobopt [infile] [outfile]\n\n");
+      return 1;
+    }
+
+  circ = quantum_new_circuit();
+
+  if(quantum_circuit_load(argv[1], &circ))
+    return 1;
+
+  before = quantum_circuit_gates(&circ);
+  t1 = quobopt_time(&circ);
+
+  quantum_circuit_optimize(&circ);
+
+  after = quantum_circuit_gates(&circ);
+  t2 = quobopt_time(&circ);
+
+  if(quantum_circuit_write(argv[2], &circ))
+    {
+      fprintf(stderr, "quobopt: Could not write %s\n", argv[2]);
+      return 1;
+    }
+
+  printf("gates:  %lu -> %lu (%.1f%% removed)\n", before, after, 
+	 before ? 100.0 * (before - after) / before : 0);
+  printf("replay: %.3f s -> %.3f s\n", t1, t2);
+
+  quantum_delete_circuit(&circ);
+
+  return 0;
+}
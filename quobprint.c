@@ -30,14 +30,10 @@
 
 int main(int argc, char **argv)
 {
-  int i, j, k, l;
-  FILE *fhd;
-  unsigned char operation;
-  unsigned char buf[OBJBUF_SIZE];
-  char output[OBJBUF_SIZE];
+  unsigned long i;
+  quantum_objcode_map map;
+  quantum_objcode_insn insn;
   char opname[256][25];
-  MAX_UNSIGNED mu;
-  double d;
 
   strncpy(opname[INIT], "init", 24);
   strncpy(opname[CNOT], "cnot", 24);
@@ -57,6 +53,10 @@ int main(int argc, char **argv)
   strncpy(opname[BMEASURE], "bmeasure", 24);
   strncpy(opname[BMEASURE_P], "bmeasure_preserve", 24);
   strncpy(opname[SWAPLEADS], "swaptheleads", 24);
+  strncpy(opname[ADDSCRATCH], "addscratch", 24);
+  strncpy(opname[MCTOFFOLI], "mctoffoli", 24);
+  strncpy(opname[SWAPBITS], "swap_bits", 24);
+  strncpy(opname[BITREVERSE], "bit_reverse", 24);
   strncpy(opname[NOP], "nop", 24);
   if(argc != 2)
     {
@@ -64,50 +64,35 @@ int main(int argc, char **argv)
       return 1;
     }
 
-  fhd = fopen(argv[1], "r");
+  /* Both file format versions are handled by the library */
 
-  if(!fhd)
-    {
-      fprintf(stderr, "Could not open %s: ", argv[1]);
-      perror(0);
-      return 1;
-    }
+  if(quantum_objcode_open(argv[1], &map))
+    return 1;
 
-  for(i=0; !feof(fhd); i++)
-    {
-      for(j=0; j<OBJBUF_SIZE; j++)
-	{
-	  buf[j] = 0;
-	  output[j] = 0;
-	}
-      operation = fgetc(fhd);
-
-      if(feof(fhd))
-	break;
+  if(map.version > 1)
+    printf("# version %i, width %i, %lu instructions in %lu blocks\n", 
+	   map.version, map.width, map.num, map.blocks);
 
-      switch(operation)
+  for(i=0; quantum_objcode_next(&map, &insn); i++)
+    {
+      switch(insn.op)
 	{
 	case INIT:
-	  fread(buf, sizeof(MAX_UNSIGNED), 1, fhd);
-	  mu = quantum_char2mu(buf);
-	  printf("%5i: %s %llu\n", i, opname[INIT], mu);
+	  printf("%5lu: %s %llu\n", i, opname[INIT], insn.mu);
 	  break;
 	case CNOT:
 	case COND_PHASE:
-	  fread(buf, sizeof(int), 1, fhd);
-	  j = quantum_char2int(buf);
-	  fread(buf, sizeof(int), 1, fhd);
-	  k = quantum_char2int(buf);
-	  printf("%5i: %s %i, %i\n", i, opname[operation], j, k);
+	case SWAPBITS:
+	  printf("%5lu: %s %i, %i\n", i, opname[insn.op], insn.arg[0], 
+		 insn.arg[1]);
 	  break;
 	case TOFFOLI:
-	  fread(buf, sizeof(int), 1, fhd);
-	  j = quantum_char2int(buf);
-	  fread(buf, sizeof(int), 1, fhd);
-	  k = quantum_char2int(buf);
-	  fread(buf, sizeof(int), 1, fhd);
-	  l = quantum_char2int(buf);
-	  printf("%5i: %s %i, %i, %i\n", i, opname[TOFFOLI], j, k, l);
+	  printf("%5lu: %s %i, %i, %i\n", i, opname[TOFFOLI], insn.arg[0], 
+		 insn.arg[1], insn.arg[2]);
+	  break;
+	case MCTOFFOLI:
+	  printf("%5lu: %s %#llx, %i\n", i, opname[MCTOFFOLI], insn.mu, 
+		 insn.arg[0]);
 	  break;
 	case SIGMA_X:
 	case SIGMA_Y:
@@ -116,42 +101,33 @@ int main(int argc, char **argv)
 	case BMEASURE:
 	case BMEASURE_P:
 	case SWAPLEADS:
-	  fread(buf, sizeof(int), 1, fhd);
-	  j = quantum_char2int(buf);
-	  printf("%5i: %s %i\n", i, opname[operation], j);
+	case ADDSCRATCH:
+	case BITREVERSE:
+	  printf("%5lu: %s %i\n", i, opname[insn.op], insn.arg[0]);
 	  break;
 	case ROT_X:
 	case ROT_Y:
 	case ROT_Z:
 	case PHASE_KICK:
 	case PHASE_SCALE:
-	  fread(buf, sizeof(int), 1, fhd);
-	  j = quantum_char2int(buf);
-	  fread(buf, sizeof(double), 1, fhd);
-	  d = quantum_char2double(buf);
-	  printf("%5i: %s %i, %f\n", i, opname[operation], j, d);
+	  printf("%5lu: %s %i, %f\n", i, opname[insn.op], insn.arg[0], insn.d);
 	  break;
 	case CPHASE_KICK:
-	  fread(buf, sizeof(int), 1, fhd);
-	  j = quantum_char2int(buf);
-	  fread(buf, sizeof(int), 1, fhd);
-	  k = quantum_char2int(buf);
-	  fread(buf, sizeof(double), 1, fhd);
-	  d = quantum_char2double(buf);
-	  printf("%5i: %s %i, %i, %f\n", i, opname[operation], j, k, d);
+	  printf("%5lu: %s %i, %i, %f\n", i, opname[insn.op], insn.arg[0], 
+		 insn.arg[1], insn.d);
 	  break;
 	case MEASURE:
 	case NOP:
-	  printf("%5i: %s\n", i, opname[operation]);
+	  printf("%5lu: %s\n", i, opname[insn.op]);
 	  break;
 	default:
-	  printf("%i: Unknown opcode 0x(%X)!\n", i, operation);
+	  printf("%lu: Unknown opcode 0x(%X)!\n", i, insn.op);
 	  exit(EXIT_FAILURE);
 	}
 
     }
 
-  fclose(fhd);
+  quantum_objcode_close(&map);
 
   return 0;
 }
@@ -31,7 +31,14 @@
 #include "config.h"
 #include "complex.h"
 #include "objcode.h"
+#include "defer.h"
+#include "checkpoint.h"
+#include "stabilizer.h"
+#include "dd.h"
+#include "product.h"
+#include "remap.h"
 #include "error.h"
+#include "alloc.h"
 
 /* Convert a vector to a quantum register */
 
@@ -59,8 +66,8 @@ quantum_matrix2qureg(quantum_matrix *m, int width)
   reg.size = size;
   reg.hashw = width + 2;
 
-  reg.amplitude = calloc(size, sizeof(COMPLEX_FLOAT));
-  reg.state = calloc(size, sizeof(MAX_UNSIGNED));
+  reg.amplitude = quantum_calloc(size, sizeof(COMPLEX_FLOAT));
+  reg.state = quantum_calloc(size, sizeof(MAX_UNSIGNED));
 
   if(!(reg.state && reg.amplitude))
     quantum_error(QUANTUM_ENOMEM);
@@ -69,7 +76,7 @@ quantum_matrix2qureg(quantum_matrix *m, int width)
 
   /* Allocate the hash table */
 
-  reg.hash = calloc(1 << reg.hashw, sizeof(int));
+  reg.hash = quantum_calloc(1 << reg.hashw, sizeof(int));
 
   if(!reg.hash)
     quantum_error(QUANTUM_ENOMEM);
@@ -106,8 +113,8 @@ quantum_new_qureg(MAX_UNSIGNED initval, int width)
 
   /* Allocate memory for 1 base state */
 
-  reg.state = calloc(1, sizeof(MAX_UNSIGNED));
-  reg.amplitude = calloc(1, sizeof(COMPLEX_FLOAT));
+  reg.state = quantum_calloc(1, sizeof(MAX_UNSIGNED));
+  reg.amplitude = quantum_calloc(1, sizeof(COMPLEX_FLOAT));
 
   if(!(reg.state && reg.amplitude))
     quantum_error(QUANTUM_ENOMEM);
@@ -116,7 +123,7 @@ quantum_new_qureg(MAX_UNSIGNED initval, int width)
 
   /* Allocate the hash table */
 
-  reg.hash = calloc(1 << reg.hashw, sizeof(int));
+  reg.hash = quantum_calloc(1 << reg.hashw, sizeof(int));
 
   if(!reg.hash)
     quantum_error(QUANTUM_ENOMEM);
@@ -141,7 +148,7 @@ quantum_new_qureg(MAX_UNSIGNED initval, int width)
       atexit((void *) &quantum_objcode_exit);
     }
 
-  quantum_objcode_put(INIT, initval);
+  quantum_objcode_put(INIT, initval, width);
 
   return reg;
 }
@@ -160,7 +167,7 @@ quantum_new_qureg_size(int n, int width)
 
   /* Allocate memory for n basis states */
 
-  reg.amplitude = calloc(n, sizeof(COMPLEX_FLOAT));
+  reg.amplitude = quantum_calloc(n, sizeof(COMPLEX_FLOAT));
   reg.state = 0;
 
   if(!reg.amplitude)
@@ -185,8 +192,8 @@ quantum_new_qureg_sparse(int n, int width)
 
   /* Allocate memory for n basis states */
 
-  reg.amplitude = calloc(n, sizeof(COMPLEX_FLOAT));
-  reg.state = calloc(n, sizeof(MAX_UNSIGNED));
+  reg.amplitude = quantum_calloc(n, sizeof(COMPLEX_FLOAT));
+  reg.state = quantum_calloc(n, sizeof(MAX_UNSIGNED));
 
   if(!(reg.amplitude && reg.state))
     quantum_error(QUANTUM_ENOMEM);
@@ -204,6 +211,8 @@ quantum_qureg2matrix(quantum_reg reg)
   quantum_matrix m;
   int i;
 
+  quantum_flush(&reg);
+
   m = quantum_new_matrix(1, 1 << reg.width);
   
   for(i=0; i<reg.size; i++)
@@ -217,7 +226,7 @@ quantum_qureg2matrix(quantum_reg reg)
 void
 quantum_destroy_hash(quantum_reg *reg)
 {
-  free(reg->hash);
+  quantum_free(reg->hash);
   quantum_memman(-(1 << reg->hashw) * sizeof(int));
   reg->hash = 0;
 }
@@ -227,16 +236,25 @@ quantum_destroy_hash(quantum_reg *reg)
 void
 quantum_delete_qureg(quantum_reg *reg)
 {
+  quantum_defer_drop(reg);
+  quantum_stabilizer_drop(reg);
+  quantum_dd_drop(reg);
+  quantum_product_drop(reg);
+  quantum_remap_drop(reg);
+
   if(reg->hashw && reg->hash)
     quantum_destroy_hash(reg);
 
-  free(reg->amplitude);
+  if(quantum_unmap_qureg(reg))
+    return;
+
+  quantum_free(reg->amplitude);
   quantum_memman(-reg->size * sizeof(COMPLEX_FLOAT));
   reg->amplitude = 0;
 
   if(reg->state)
     {
-      free(reg->state);
+      quantum_free(reg->state);
       quantum_memman(-reg->size * sizeof(MAX_UNSIGNED));
       reg->state = 0;
     }
@@ -248,13 +266,16 @@ quantum_delete_qureg(quantum_reg *reg)
 void
 quantum_delete_qureg_hashpreserve(quantum_reg *reg)
 {
-  free(reg->amplitude);
+  if(quantum_unmap_qureg(reg))
+    return;
+
+  quantum_free(reg->amplitude);
   quantum_memman(-reg->size * sizeof(COMPLEX_FLOAT));
   reg->amplitude = 0;
 
   if(reg->state)
     {
-      free(reg->state);
+      quantum_free(reg->state);
       quantum_memman(-reg->size * sizeof(MAX_UNSIGNED));
       reg->state = 0;
     }
@@ -265,11 +286,13 @@ quantum_delete_qureg_hashpreserve(quantum_reg *reg)
 void
 quantum_copy_qureg(quantum_reg *src, quantum_reg *dst)
 {
+  quantum_flush(src);
+
   *dst = *src;
   
   /* Allocate memory for basis states */
 
-  dst->amplitude = calloc(dst->size, sizeof(COMPLEX_FLOAT));
+  dst->amplitude = quantum_calloc(dst->size, sizeof(COMPLEX_FLOAT));
 
   if(!dst->amplitude)
     quantum_error(QUANTUM_ENOMEM);
@@ -280,7 +303,7 @@ quantum_copy_qureg(quantum_reg *src, quantum_reg *dst)
 
   if(src->state)
     {
-      dst->state = calloc(dst->size, sizeof(MAX_UNSIGNED));
+      dst->state = quantum_calloc(dst->size, sizeof(MAX_UNSIGNED));
 
       if(!dst->state)
 	quantum_error(QUANTUM_ENOMEM);
@@ -295,7 +318,7 @@ quantum_copy_qureg(quantum_reg *src, quantum_reg *dst)
 
   if(dst->hashw)
     {
-      dst->hash = calloc(1 << dst->hashw, sizeof(int));
+      dst->hash = quantum_calloc(1 << dst->hashw, sizeof(int));
       
       if(!dst->hash)
 	quantum_error(QUANTUM_ENOMEM);
@@ -312,6 +335,8 @@ quantum_print_qureg(quantum_reg reg)
 {
   int i,j;
   
+  quantum_flush(&reg);
+
   for(i=0; i<reg.size; i++)
     {
       printf("% f %+fi|%lli> (%e) (|", quantum_real(reg.amplitude[i]),
@@ -337,6 +362,8 @@ quantum_print_expn(quantum_reg reg)
 {
   int i;
   
+  quantum_flush(&reg);
+
   for(i=0; i<reg.size; i++)
     {
       printf("%i: %lli\n", i, reg.state[i] - i * (1 << (reg.width / 2)));
@@ -351,6 +378,34 @@ quantum_addscratch(int bits, quantum_reg *reg)
 {
   int i;
   MAX_UNSIGNED l;
+
+  quantum_defer_flush(reg);
+
+  quantum_objcode_put(ADDSCRATCH, bits);
+
+  /* A register represented by a decision diagram keeps it */
+
+  if(quantum_dd_active(reg))
+    {
+      quantum_dd_addscratch(bits, reg);
+      return;
+    }
+
+  /* A register kept as a product gets the scratch space as a new
+     factor */
+
+  if(quantum_product_active(reg))
+    {
+      quantum_product_addscratch(bits, reg);
+      return;
+    }
+
+  /* A register with a qubit map keeps it */
+
+  if(quantum_remap_active(reg))
+    quantum_remap_addscratch(bits, reg);
+  else
+    quantum_flush(reg);
   
   reg->width += bits;
 
@@ -378,46 +433,101 @@ quantum_print_hash(quantum_reg reg)
 
 }
 
-/* Compute the Kronecker product of two quantum registers */
+/* Check whether REG uses the dense layout, holding the amplitude of
+   basis state I at position I */
+
+static int
+quantum_is_dense(quantum_reg *reg)
+{
+  int i;
+
+  if(reg->hashw || ((MAX_UNSIGNED) reg->size != (MAX_UNSIGNED) 1 << reg->width))
+    return 0;
+
+  if(reg->state)
+    {
+      for(i=0; i<reg->size; i++)
+	{
+	  if(reg->state[i] != i)
+	    return 0;
+	}
+    }
+
+  return 1;
+}
+
+/* Compute the Kronecker product of two quantum registers. The basis
+   states of REG2 are listed for each basis state of REG1 in turn, and
+   each thread fills one contiguous block of the result. As after any
+   other gate, the hash table is only built once it is needed. If both
+   registers use the dense layout (see quantum_new_qureg_size), so
+   does the result. */
 
 quantum_reg
 quantum_kronecker(quantum_reg *reg1, quantum_reg *reg2)
 {
-  int i,j;
+  int i, j, k;
   quantum_reg reg;
   
+  quantum_flush(reg1);
+  quantum_flush(reg2);
+
   reg.width = reg1->width+reg2->width;
   reg.size = reg1->size*reg2->size;
   reg.hashw = reg.width + 2;
+  reg.hash = 0;
+  reg.state = 0;
+
+  if(quantum_is_dense(reg1) && quantum_is_dense(reg2))
+    reg.hashw = 0;
 
   /* allocate memory for the new basis states */
 
-  reg.amplitude = calloc(reg.size, sizeof(COMPLEX_FLOAT));
-  reg.state = calloc(reg.size, sizeof(MAX_UNSIGNED));
+  reg.amplitude = quantum_alloc(reg.size * sizeof(COMPLEX_FLOAT));
 
-  if(!(reg.state && reg.amplitude))
+  if(!reg.amplitude)
     quantum_error(QUANTUM_ENOMEM);
 
-  quantum_memman(reg.size * (sizeof(COMPLEX_FLOAT) + sizeof(MAX_UNSIGNED)));
+  quantum_memman(reg.size * sizeof(COMPLEX_FLOAT));
+
+  /* A dense register only needs a list of basis states if one of its
+     factors has one */
+
+  if(reg.hashw || reg1->state || reg2->state)
+    {
+      reg.state = quantum_alloc(reg.size * sizeof(MAX_UNSIGNED));
+
+      if(!reg.state)
+	quantum_error(QUANTUM_ENOMEM);
+
+      quantum_memman(reg.size * sizeof(MAX_UNSIGNED));
+    }
 
   /* Allocate the hash table */
 
-  reg.hash = calloc(1 << reg.hashw, sizeof(int));
-  if(!reg.hash)
-    quantum_error(QUANTUM_ENOMEM);
+  if(reg.hashw)
+    {
+      reg.hash = quantum_calloc(1 << reg.hashw, sizeof(int));
 
-  quantum_memman((1 << reg.hashw) * sizeof(int));
+      if(!reg.hash)
+	quantum_error(QUANTUM_ENOMEM);
+
+      quantum_memman((1 << reg.hashw) * sizeof(int));
+    }
 
-  for(i=0; i<reg1->size; i++)
-    for(j=0; j<reg2->size; j++)
+#ifdef _OPENMP
+#pragma omp parallel for private (i, j) schedule (static)
+#endif
+  for(k=0; k<reg.size; k++)
     {
-      /* printf("processing |%lli> x |%lli>\n", reg1->state[i], 
-	     reg2->state[j]);
-         printf("%lli\n", (reg1->state[i]) << reg2->width); */
+      i = k / reg2->size;
+      j = k % reg2->size;
 
-      reg.state[i*reg2->size+j] = ((reg1->state[i]) << reg2->width) 
-	| reg2->state[j];
-      reg.amplitude[i*reg2->size+j] = reg1->amplitude[i] * reg2->amplitude[j];
+      reg.amplitude[k] = reg1->amplitude[i] * reg2->amplitude[j];
+
+      if(reg.state)
+	reg.state[k] = ((reg1->state ? reg1->state[i] : i) << reg2->width)
+	  | (reg2->state ? reg2->state[j] : j);
     }
 
   return reg;
@@ -434,6 +544,8 @@ quantum_state_collapse(int pos, int value, quantum_reg reg)
   MAX_UNSIGNED lpat=0, rpat=0, pos2;
   quantum_reg out;
 
+  quantum_flush(&reg);
+
   pos2 = (MAX_UNSIGNED) 1 << pos;
 
   /* Eradicate all amplitudes of base states which have been ruled out
@@ -453,8 +565,8 @@ quantum_state_collapse(int pos, int value, quantum_reg reg)
 
   out.width = reg.width-1;
   out.size = size;
-  out.amplitude = calloc(size, sizeof(COMPLEX_FLOAT));
-  out.state = calloc(size, sizeof(MAX_UNSIGNED));
+  out.amplitude = quantum_calloc(size, sizeof(COMPLEX_FLOAT));
+  out.state = quantum_calloc(size, sizeof(MAX_UNSIGNED));
 
   if(!(out.state && out.amplitude))
     quantum_error(QUANTUM_ENOMEM);
@@ -500,6 +612,9 @@ quantum_dot_product(quantum_reg *reg1, quantum_reg *reg2)
   int i, j;
   COMPLEX_FLOAT f = 0;
 
+  quantum_flush(reg1);
+  quantum_flush(reg2);
+
   /* Check whether quantum registers are sorted */
   
   if(reg2->hashw)
@@ -539,6 +654,9 @@ quantum_dot_product_noconj(quantum_reg *reg1, quantum_reg *reg2)
   int i, j;
   COMPLEX_FLOAT f = 0;
 
+  quantum_flush(reg1);
+  quantum_flush(reg2);
+
   /* Check whether quantum registers are sorted */
   
   if(reg2->hashw)
@@ -576,6 +694,9 @@ quantum_vectoradd(quantum_reg *reg1, quantum_reg *reg2)
   int addsize = 0;
   quantum_reg reg;
 
+  quantum_flush(reg1);
+  quantum_flush(reg2);
+
   quantum_copy_qureg(reg1, &reg);
   
   if(reg1->hashw || reg2->hashw)
@@ -596,8 +717,9 @@ quantum_vectoradd(quantum_reg *reg1, quantum_reg *reg2)
     {
       reg.size += addsize;
 
-      reg.amplitude = realloc(reg.amplitude, reg.size*sizeof(COMPLEX_FLOAT));
-      reg.state = realloc(reg.state, reg.size*sizeof(MAX_UNSIGNED));
+      reg.amplitude = quantum_realloc(reg.amplitude, 
+				      reg.size*sizeof(COMPLEX_FLOAT));
+      reg.state = quantum_realloc(reg.state, reg.size*sizeof(MAX_UNSIGNED));
 
       if(!(reg.state && reg.amplitude))
 	quantum_error(QUANTUM_ENOMEM);
@@ -643,6 +765,10 @@ quantum_vectoradd_inplace(quantum_reg *reg1, quantum_reg *reg2)
   int i, j, k;
   int addsize = 0;
 
+  quantum_flush(reg1);
+  quantum_flush(reg2);
+  quantum_copy_mapped(reg1);
+
   if(reg1->hashw || reg2->hashw)
     {
       quantum_reconstruct_hash(reg1);
@@ -661,9 +787,9 @@ quantum_vectoradd_inplace(quantum_reg *reg1, quantum_reg *reg2)
 
       /* Allocate memory for basis states */
 
-      reg1->amplitude = realloc(reg1->amplitude, 
+      reg1->amplitude = quantum_realloc(reg1->amplitude, 
 				(reg1->size+addsize)*sizeof(COMPLEX_FLOAT));
-      reg1->state = realloc(reg1->state, (reg1->size+addsize)
+      reg1->state = quantum_realloc(reg1->state, (reg1->size+addsize)
 			    *sizeof(MAX_UNSIGNED));
 
       if(!(reg1->state && reg1->amplitude))
@@ -717,12 +843,14 @@ quantum_matrix_qureg(quantum_reg A(MAX_UNSIGNED, double), double t,
   quantum_reg reg2;
   quantum_reg tmp;
 
+  quantum_flush(reg);
+
   reg2.width = reg->width;
   reg2.size = reg->size;
   reg2.hashw = 0;
   reg2.hash = 0;
 
-  reg2.amplitude = calloc(reg2.size, sizeof(COMPLEX_FLOAT));
+  reg2.amplitude = quantum_calloc(reg2.size, sizeof(COMPLEX_FLOAT));
   reg2.state = 0;
 
   if(!reg2.amplitude)
@@ -732,7 +860,7 @@ quantum_matrix_qureg(quantum_reg A(MAX_UNSIGNED, double), double t,
 
   if(reg->state)
     {
-      reg2.state = calloc(reg2.size, sizeof(MAX_UNSIGNED));
+      reg2.state = quantum_calloc(reg2.size, sizeof(MAX_UNSIGNED));
 
       if(!reg2.state)
 	quantum_error(QUANTUM_ENOMEM);
@@ -764,6 +892,8 @@ quantum_mvmult(quantum_reg *y, quantum_matrix A, quantum_reg *x)
 {
   int i, j;
 
+  quantum_flush(x);
+
   for(i=0; i<A.cols; i++)
     {
       y->amplitude[i] = 0;
@@ -782,6 +912,8 @@ quantum_scalar_qureg(COMPLEX_FLOAT r, quantum_reg *reg)
 {
   int i;
   
+  quantum_flush(reg);
+
   for(i=0; i<reg->size; i++)
       reg->amplitude[i] *= r;
 }
@@ -822,6 +954,8 @@ quantum_normalize(quantum_reg *reg)
   int i;
   double r = 0;
 
+  quantum_flush(reg);
+
   for(i=0; i<reg->size; i++)
     r += quantum_prob(reg->amplitude[i]);
 
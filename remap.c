@@ -0,0 +1,407 @@
+/* remap.c: Logical to physical qubit maps
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "remap.h"
+#include "config.h"
+#include "qureg.h"
+#include "objcode.h"
+#include "measure.h"
+#include "gates.h"
+#include "defer.h"
+#include "defs.h"
+#include "error.h"
+
+/* A register with a qubit map keeps qubit Q at bit REMAP_BIT[Q] of its
+   basis states. Swapping two qubits, either by quantum_remap_swap or
+   by quantum_swaptheleads, then only changes the map. Gates are
+   applied to the bits the map points to, and measurement results are
+   translated back. Any other use of the register moves the bits to
+   their places in a single pass and drops the map. As in deferred
+   mode, only one register can have a map at a time. */
+
+/* The register with a map, or 0 */
+
+static quantum_reg *remap_reg = 0;
+
+/* The bit holding each qubit */
+
+static int *remap_bit = 0;
+
+/* Set while the map is bypassed to act on the bits themselves */
+
+static int remap_busy = 0;
+
+/* Translate basis state A from bits to qubits */
+
+static MAX_UNSIGNED
+quantum_remap_state(MAX_UNSIGNED a, int width)
+{
+  MAX_UNSIGNED state = 0;
+  int q;
+
+  for(q=0; q<width; q++)
+    {
+      if(a & ((MAX_UNSIGNED) 1 << remap_bit[q]))
+	state |= (MAX_UNSIGNED) 1 << q;
+    }
+
+  return state;
+}
+
+/* Give REG a qubit map, starting with every qubit at its own bit */
+
+void
+quantum_remap_start(quantum_reg *reg)
+{
+  int q;
+
+  if(quantum_remap_active(reg))
+    return;
+
+  quantum_flush(reg);
+
+  if(remap_reg)
+    quantum_remap_stop(remap_reg);
+
+  remap_bit = malloc((reg->width + 1) * sizeof(int));
+
+  if(!remap_bit)
+    quantum_error(QUANTUM_ENOMEM);
+
+  for(q=0; q<reg->width; q++)
+    remap_bit[q] = q;
+
+  remap_reg = reg;
+}
+
+/* Move all qubits of REG to their own bits and drop the map. REG may
+   also be a copy of the register, as passed by value to
+   quantum_print_qureg, in which case it is updated afterwards. */
+
+void
+quantum_remap_stop(quantum_reg *reg)
+{
+  quantum_reg *out;
+  int i, q;
+
+  if(!quantum_remap_active(reg))
+    return;
+
+  out = remap_reg;
+
+  for(q=0; q<out->width; q++)
+    {
+      if(remap_bit[q] != q)
+	break;
+    }
+
+  if(q < out->width)
+    {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+      for(i=0; i<out->size; i++)
+	out->state[i] = quantum_remap_state(out->state[i], out->width);
+
+      quantum_reconstruct_hash(out);
+    }
+
+  free(remap_bit);
+  remap_bit = 0;
+  remap_reg = 0;
+
+  if(reg != out)
+    *reg = *out;
+}
+
+/* Drop the map of a register which is about to be deleted */
+
+void
+quantum_remap_drop(quantum_reg *reg)
+{
+  if(!quantum_remap_active(reg))
+    return;
+
+  free(remap_bit);
+  remap_bit = 0;
+  remap_reg = 0;
+}
+
+/* Check whether REG has a qubit map */
+
+int
+quantum_remap_active(quantum_reg *reg)
+{
+  return remap_reg && !remap_busy 
+    && ((reg == remap_reg) || (reg->state == remap_reg->state));
+}
+
+/* Return the bit holding QUBIT */
+
+int
+quantum_remap_bit(int qubit, quantum_reg *reg)
+{
+  if(!quantum_remap_active(reg))
+    return qubit;
+
+  return remap_bit[qubit];
+}
+
+/* Swap two qubits. With a qubit map, this is free. */
+
+void
+quantum_remap_swap(int qubit1, int qubit2, quantum_reg *reg)
+{
+  int t;
+
+  if(!quantum_remap_active(reg) || quantum_objcode_status())
+    {
+      quantum_cnot(qubit1, qubit2, reg);
+      quantum_cnot(qubit2, qubit1, reg);
+      quantum_cnot(qubit1, qubit2, reg);
+      return;
+    }
+
+  t = remap_bit[qubit1];
+  remap_bit[qubit1] = remap_bit[qubit2];
+  remap_bit[qubit2] = t;
+}
+
+/* Apply the gate INSN to REG if it has a qubit map. The gate is
+   executed on the bits holding its qubits, while SWAPLEADS only
+   changes the map. Returns 1 if the gate has been handled and must not
+   be executed. Otherwise, the map is dropped first. */
+
+int
+quantum_remap_put(quantum_reg *reg, quantum_objcode_insn *insn)
+{
+  quantum_objcode_insn t;
+  int k, n, b;
+
+  if(!quantum_remap_active(reg))
+    return 0;
+
+  switch(insn->op)
+    {
+    case SIGMA_X:
+    case SIGMA_Y:
+    case SIGMA_Z:
+    case HADAMARD:
+    case ROT_X:
+    case ROT_Y:
+    case ROT_Z:
+    case PHASE_KICK:
+      n = 1;
+      break;
+
+    case MCTOFFOLI:
+      n = 1;
+      break;
+
+    case CNOT:
+    case COND_PHASE:
+    case CPHASE_KICK:
+      n = 2;
+      break;
+
+    case TOFFOLI:
+      n = 3;
+      break;
+
+    case PHASE_SCALE:
+      n = 0;
+      break;
+
+    case SWAPLEADS:
+      if(2 * insn->arg[0] > reg->width)
+	{
+	  quantum_remap_stop(reg);
+	  return 0;
+	}
+
+      for(k=0; k<insn->arg[0]; k++)
+	{
+	  b = remap_bit[k];
+	  remap_bit[k] = remap_bit[insn->arg[0] + k];
+	  remap_bit[insn->arg[0] + k] = b;
+	}
+
+      return 1;
+
+    case SWAPBITS:
+      for(k=0; k<2; k++)
+	{
+	  if((insn->arg[k] < 0) || (insn->arg[k] >= reg->width))
+	    {
+	      quantum_remap_stop(reg);
+	      return 0;
+	    }
+	}
+
+      b = remap_bit[insn->arg[0]];
+      remap_bit[insn->arg[0]] = remap_bit[insn->arg[1]];
+      remap_bit[insn->arg[1]] = b;
+
+      return 1;
+
+    case BITREVERSE:
+      if(insn->arg[0] > reg->width)
+	{
+	  quantum_remap_stop(reg);
+	  return 0;
+	}
+
+      for(k=0; k<insn->arg[0]/2; k++)
+	{
+	  b = remap_bit[k];
+	  remap_bit[k] = remap_bit[insn->arg[0] - k - 1];
+	  remap_bit[insn->arg[0] - k - 1] = b;
+	}
+
+      return 1;
+
+    default:
+      quantum_remap_stop(reg);
+      return 0;
+    }
+
+  t = *insn;
+
+  /* The angle of COND_PHASE depends on the distance of its qubits */
+
+  if(t.op == COND_PHASE)
+    {
+      t.op = CPHASE_KICK;
+      t.d = pi / ((MAX_UNSIGNED) 1 << (t.arg[0] - t.arg[1]));
+    }
+
+  for(k=0; k<n; k++)
+    {
+      if((t.arg[k] < 0) || (t.arg[k] >= reg->width))
+	{
+	  quantum_remap_stop(reg);
+	  return 0;
+	}
+
+      t.arg[k] = remap_bit[t.arg[k]];
+    }
+
+  /* The controls of MCTOFFOLI are given as a bit mask */
+
+  if(t.op == MCTOFFOLI)
+    {
+      if((reg->width < sizeof(MAX_UNSIGNED) * 8) && (t.mu >> reg->width))
+	{
+	  quantum_remap_stop(reg);
+	  return 0;
+	}
+
+      for(k=0, t.mu=0; k<reg->width; k++)
+	{
+	  if(insn->mu & ((MAX_UNSIGNED) 1 << k))
+	    t.mu |= (MAX_UNSIGNED) 1 << remap_bit[k];
+	}
+    }
+
+  remap_busy = 1;
+  quantum_objcode_exec(&t, reg);
+  remap_busy = 0;
+
+  return 1;
+}
+
+/* Measure all qubits of REG without changing it, see
+   quantum_measure */
+
+MAX_UNSIGNED
+quantum_remap_measure(quantum_reg *reg)
+{
+  MAX_UNSIGNED result;
+
+  remap_busy = 1;
+  result = quantum_measure(*reg);
+  remap_busy = 0;
+
+  if(result == (MAX_UNSIGNED) -1)
+    return result;
+
+  return quantum_remap_state(result, reg->width);
+}
+
+/* Measure qubit POS of REG, see quantum_bmeasure and
+   quantum_bmeasure_bitpreserve. Unless PRESERVE is set, the bit is
+   removed from the register and the map is updated accordingly. */
+
+int
+quantum_remap_bmeasure(int pos, int preserve, quantum_reg *reg)
+{
+  int q, b, result;
+
+  b = remap_bit[pos];
+
+  remap_busy = 1;
+
+  if(preserve)
+    result = quantum_bmeasure_bitpreserve(b, reg);
+  else
+    result = quantum_bmeasure(b, reg);
+
+  remap_busy = 0;
+
+  if(!preserve)
+    {
+      for(q=pos; q<reg->width; q++)
+	remap_bit[q] = remap_bit[q+1];
+
+      for(q=0; q<reg->width; q++)
+	{
+	  if(remap_bit[q] > b)
+	    remap_bit[q]--;
+	}
+    }
+
+  return result;
+}
+
+/* Update the map for BITS scratch qubits, which quantum_addscratch
+   adds at the lowest bits */
+
+void
+quantum_remap_addscratch(int bits, quantum_reg *reg)
+{
+  int q;
+
+  remap_bit = realloc(remap_bit, (reg->width + bits + 1) * sizeof(int));
+
+  if(!remap_bit)
+    quantum_error(QUANTUM_ENOMEM);
+
+  for(q=reg->width-1; q>=0; q--)
+    remap_bit[q+bits] = remap_bit[q] + bits;
+
+  for(q=0; q<bits; q++)
+    remap_bit[q] = q;
+}
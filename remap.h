@@ -0,0 +1,43 @@
+/* remap.h: Declarations for remap.c
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#ifndef __REMAP_H
+
+#define __REMAP_H
+
+#include "config.h"
+#include "qureg.h"
+#include "objcode.h"
+
+extern void quantum_remap_start(quantum_reg *reg);
+extern void quantum_remap_stop(quantum_reg *reg);
+extern void quantum_remap_drop(quantum_reg *reg);
+extern int quantum_remap_active(quantum_reg *reg);
+extern int quantum_remap_bit(int qubit, quantum_reg *reg);
+extern void quantum_remap_swap(int qubit1, int qubit2, quantum_reg *reg);
+extern int quantum_remap_put(quantum_reg *reg, quantum_objcode_insn *insn);
+extern MAX_UNSIGNED quantum_remap_measure(quantum_reg *reg);
+extern int quantum_remap_bmeasure(int pos, int preserve, quantum_reg *reg);
+extern void quantum_remap_addscratch(int bits, quantum_reg *reg);
+
+#endif
@@ -23,6 +23,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <time.h>
 
@@ -36,12 +37,35 @@ int main(int argc, char **argv) {
   int x = 0;
   int N;
   int c,q,a,b, factor;
+  int approx = -1, semi = 0;
 
   srand(time(0));
 
+  /* -a limits the distance of the qubits of the conditional phase
+     shifts in the QFT, -s replaces the input register by a single
+     control qubit and the QFT by its semiclassical version */
+
+  while(argc > 1)
+    {
+      if(argc > 2 && !strcmp(argv[1], "-a"))
+	{
+	  approx = atoi(argv[2]);
+	  argv += 2;
+	  argc -= 2;
+	}
+      else if(!strcmp(argv[1], "-s"))
+	{
+	  semi = 1;
+	  argv++;
+	  argc--;
+	}
+      else
+	break;
+    }
+
   if(argc == 1)
     {
-      printf("Usage: shor [number]\n\n");
+      printf("Usage: shor [-a distance] [-s] [number]\n\n");
       return 3;
     }
 
@@ -56,7 +80,8 @@ int main(int argc, char **argv) {
   width=quantum_getwidth(N*N);
   swidth=quantum_getwidth(N);
 
-  printf("N = %i, %i qubits required\n", N, width+3*swidth+2);
+  printf("N = %i, %i qubits required\n", N, 
+	 semi ? 3*swidth+3 : width+3*swidth+2);
 
   if(argc >= 3)
     {
@@ -69,30 +94,43 @@ int main(int argc, char **argv) {
 
   printf("Random seed: %i\n", x);
 
-  qr=quantum_new_qureg(0, width);
-
-  for(i=0;i<width;i++)
-    quantum_hadamard(i, &qr);
+  if(semi)
+    {
+      /* The register holds at most 2N basis states, so its hash
+	 table only needs to be sized for swidth qubits */
 
-  quantum_addscratch(3*swidth+2, &qr);
+      qr=quantum_new_qureg(0, swidth+1);
 
-  quantum_exp_mod_n(N, x, width, swidth, &qr);
+      quantum_addscratch(2*swidth+2, &qr);
 
-  for(i=0;i<3*swidth+2;i++)
-    {
-      quantum_bmeasure(0, &qr);
+      c=quantum_exp_mod_n_semiclassical(N, x, width, swidth, &qr);
     }
+  else
+    {
+      qr=quantum_new_qureg(0, width);
+
+      for(i=0;i<width;i++)
+	quantum_hadamard(i, &qr);
+
+      quantum_addscratch(3*swidth+2, &qr);
+
+      quantum_exp_mod_n(N, x, width, swidth, &qr);
 
-  quantum_qft(width, &qr); 
+      for(i=0;i<3*swidth+2;i++)
+	{
+	  quantum_bmeasure(0, &qr);
+	}
+
+      if(approx >= 0)
+	printf("Approximate QFT, operator norm error at most %g\n", 
+	       quantum_qft_approx(width, approx, &qr));
+      else
+	quantum_qft(width, &qr); 
   
-  for(i=0; i<width/2; i++)
-    {
-      quantum_cnot(i, width-i-1, &qr);
-      quantum_cnot(width-i-1, i, &qr);
-      quantum_cnot(i, width-i-1, &qr);
-    }
+      quantum_bit_reverse(width, &qr);
   
-  c=quantum_measure(qr);
+      c=quantum_measure(qr);
+    }
 
   if(c==-1)
     {
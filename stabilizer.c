@@ -0,0 +1,938 @@
+/* stabilizer.c: Simulation of Clifford circuits with stabilizer tableaux
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "stabilizer.h"
+#include "config.h"
+#include "complex.h"
+#include "qureg.h"
+#include "objcode.h"
+#include "measure.h"
+#include "decoherence.h"
+#include "gates.h"
+#include "defer.h"
+#include "defs.h"
+#include "error.h"
+#include "alloc.h"
+
+/* A register in a stabilizer state can be simulated in polynomial
+   time by keeping track of the Pauli operators stabilizing it instead
+   of its amplitudes (S. Aaronson and D. Gottesman, Phys. Rev. A 70,
+   052328 (2004)). While a register is simulated this way, CNOT,
+   Hadamard and Pauli gates, phase gates by multiples of pi/2 and
+   single-bit measurements only update the tableau. Any other
+   operation first builds the state vector from the tableau and then
+   continues as usual. The state vector is correct up to a global
+   phase. As in deferred mode, only one register can be simulated this
+   way at a time. */
+
+#define TAB_BITS (8 * (int) sizeof(MAX_UNSIGNED))
+#define TAB_WORD(j) ((j) / TAB_BITS)
+#define TAB_BIT(j) ((MAX_UNSIGNED) 1 << ((j) % TAB_BITS))
+
+/* Bit J of the X and Z parts of row I */
+
+#define TAB_X(t, i, j) (((t)->x[(i) * (t)->words + TAB_WORD(j)] \
+                         & TAB_BIT(j)) != 0)
+#define TAB_Z(t, i, j) (((t)->z[(i) * (t)->words + TAB_WORD(j)] \
+                         & TAB_BIT(j)) != 0)
+
+/* The register simulated with a tableau, or 0 */
+
+static quantum_reg *stab_reg = 0;
+
+/* Its tableau */
+
+static quantum_tableau stab;
+
+/* Count the bits set in A */
+
+static inline int
+quantum_popcount(MAX_UNSIGNED a)
+{
+  int n = 0;
+
+  for(; a; n++)
+    a &= a - 1;
+
+  return n;
+}
+
+/* Create the tableau of the basis state 0 of N qubits. The
+   destabilizers are X_j, the stabilizers Z_j. */
+
+static void
+quantum_tableau_new(int n, quantum_tableau *t)
+{
+  int i, rows;
+
+  t->n = n;
+  t->words = n ? (n + TAB_BITS - 1) / TAB_BITS : 1;
+
+  rows = 2 * n + 1;
+
+  t->x = calloc(rows * t->words, sizeof(MAX_UNSIGNED));
+  t->z = calloc(rows * t->words, sizeof(MAX_UNSIGNED));
+  t->r = calloc(rows, sizeof(int));
+
+  if(!(t->x && t->z && t->r))
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman(rows * (2 * t->words * sizeof(MAX_UNSIGNED) + sizeof(int)));
+
+  for(i=0; i<n; i++)
+    {
+      t->x[i * t->words + TAB_WORD(i)] = TAB_BIT(i);
+      t->z[(i + n) * t->words + TAB_WORD(i)] = TAB_BIT(i);
+    }
+}
+
+/* Delete a tableau */
+
+static void
+quantum_tableau_delete(quantum_tableau *t)
+{
+  int rows = 2 * t->n + 1;
+
+  free(t->x);
+  free(t->z);
+  free(t->r);
+
+  quantum_memman(-rows * (2 * t->words * sizeof(MAX_UNSIGNED) 
+			  + sizeof(int)));
+
+  t->x = t->z = 0;
+  t->r = 0;
+}
+
+/* Copy the tableau SRC to DST */
+
+static void
+quantum_tableau_copy(quantum_tableau *src, quantum_tableau *dst)
+{
+  int rows = 2 * src->n + 1;
+
+  quantum_tableau_new(src->n, dst);
+
+  memcpy(dst->x, src->x, rows * src->words * sizeof(MAX_UNSIGNED));
+  memcpy(dst->z, src->z, rows * src->words * sizeof(MAX_UNSIGNED));
+  memcpy(dst->r, src->r, rows * sizeof(int));
+}
+
+/* Replace row H by the product of row I and row H. The phase is
+   obtained by counting the factors of i and -i picked up on each
+   qubit, e.g. XY = iZ and XZ = -iY. */
+
+static void
+quantum_tableau_rowsum(quantum_tableau *t, int h, int i)
+{
+  int j, e;
+  MAX_UNSIGNED x1, z1, x2, z2, plus, minus;
+
+  e = t->r[h] + t->r[i];
+
+  for(j=0; j<t->words; j++)
+    {
+      x1 = t->x[i * t->words + j];
+      z1 = t->z[i * t->words + j];
+      x2 = t->x[h * t->words + j];
+      z2 = t->z[h * t->words + j];
+
+      plus = (x1 & z1 & ~x2 & z2) | (x1 & ~z1 & x2 & z2) 
+	| (~x1 & z1 & x2 & ~z2);
+      minus = (x1 & z1 & x2 & ~z2) | (x1 & ~z1 & ~x2 & z2) 
+	| (~x1 & z1 & x2 & z2);
+
+      e += quantum_popcount(plus) - quantum_popcount(minus);
+
+      t->x[h * t->words + j] = x1 ^ x2;
+      t->z[h * t->words + j] = z1 ^ z2;
+    }
+
+  t->r[h] = ((e % 4) + 4) % 4;
+}
+
+/* Copy row I to row H */
+
+static void
+quantum_tableau_rowcopy(quantum_tableau *t, int h, int i)
+{
+  memcpy(&t->x[h * t->words], &t->x[i * t->words], 
+	 t->words * sizeof(MAX_UNSIGNED));
+  memcpy(&t->z[h * t->words], &t->z[i * t->words], 
+	 t->words * sizeof(MAX_UNSIGNED));
+  t->r[h] = t->r[i];
+}
+
+/* Set row H to the identity */
+
+static void
+quantum_tableau_rowclear(quantum_tableau *t, int h)
+{
+  memset(&t->x[h * t->words], 0, t->words * sizeof(MAX_UNSIGNED));
+  memset(&t->z[h * t->words], 0, t->words * sizeof(MAX_UNSIGNED));
+  t->r[h] = 0;
+}
+
+/* Swap rows H and I */
+
+static void
+quantum_tableau_rowswap(quantum_tableau *t, int h, int i)
+{
+  int j, r;
+  MAX_UNSIGNED tmp;
+
+  for(j=0; j<t->words; j++)
+    {
+      tmp = t->x[h * t->words + j];
+      t->x[h * t->words + j] = t->x[i * t->words + j];
+      t->x[i * t->words + j] = tmp;
+
+      tmp = t->z[h * t->words + j];
+      t->z[h * t->words + j] = t->z[i * t->words + j];
+      t->z[i * t->words + j] = tmp;
+    }
+
+  r = t->r[h];
+  t->r[h] = t->r[i];
+  t->r[i] = r;
+}
+
+/* Apply a Hadamard gate to qubit A */
+
+static void
+quantum_tableau_hadamard(quantum_tableau *t, int a)
+{
+  int i, k;
+  MAX_UNSIGNED b, x, z;
+
+  b = TAB_BIT(a);
+
+  for(i=0; i<2*t->n; i++)
+    {
+      k = i * t->words + TAB_WORD(a);
+      x = t->x[k] & b;
+      z = t->z[k] & b;
+
+      if(x && z)
+	t->r[i] = (t->r[i] + 2) % 4;
+
+      t->x[k] ^= x ^ z;
+      t->z[k] ^= x ^ z;
+    }
+}
+
+/* Apply the phase gate diag(1, i) to qubit A */
+
+static void
+quantum_tableau_phase(quantum_tableau *t, int a)
+{
+  int i, k;
+  MAX_UNSIGNED b;
+
+  b = TAB_BIT(a);
+
+  for(i=0; i<2*t->n; i++)
+    {
+      k = i * t->words + TAB_WORD(a);
+
+      if((t->x[k] & b) && (t->z[k] & b))
+	t->r[i] = (t->r[i] + 2) % 4;
+
+      t->z[k] ^= t->x[k] & b;
+    }
+}
+
+/* Apply a CNOT gate with control A and target B */
+
+static void
+quantum_tableau_cnot(quantum_tableau *t, int a, int b)
+{
+  int i, ka, kb;
+  int xa, za, xb, zb;
+
+  for(i=0; i<2*t->n; i++)
+    {
+      ka = i * t->words + TAB_WORD(a);
+      kb = i * t->words + TAB_WORD(b);
+
+      xa = (t->x[ka] & TAB_BIT(a)) != 0;
+      za = (t->z[ka] & TAB_BIT(a)) != 0;
+      xb = (t->x[kb] & TAB_BIT(b)) != 0;
+      zb = (t->z[kb] & TAB_BIT(b)) != 0;
+
+      if(xa && zb && (xb == za))
+	t->r[i] = (t->r[i] + 2) % 4;
+
+      if(xa)
+	t->x[kb] ^= TAB_BIT(b);
+      if(zb)
+	t->z[ka] ^= TAB_BIT(a);
+    }
+}
+
+/* Apply the Pauli operator X^PX Z^PZ to qubit A. Only the signs of the
+   rows anticommuting with it change. */
+
+static void
+quantum_tableau_pauli(quantum_tableau *t, int a, int px, int pz)
+{
+  int i;
+
+  for(i=0; i<2*t->n; i++)
+    {
+      if((pz && TAB_X(t, i, a)) != (px && TAB_Z(t, i, a)))
+	t->r[i] = (t->r[i] + 2) % 4;
+    }
+}
+
+/* Exchange qubits A and B */
+
+static void
+quantum_tableau_swap(quantum_tableau *t, int a, int b)
+{
+  int i, ka, kb;
+  int xa, za, xb, zb;
+
+  if(a == b)
+    return;
+
+  for(i=0; i<=2*t->n; i++)
+    {
+      ka = i * t->words + TAB_WORD(a);
+      kb = i * t->words + TAB_WORD(b);
+
+      xa = (t->x[ka] & TAB_BIT(a)) != 0;
+      za = (t->z[ka] & TAB_BIT(a)) != 0;
+      xb = (t->x[kb] & TAB_BIT(b)) != 0;
+      zb = (t->z[kb] & TAB_BIT(b)) != 0;
+
+      if(xa != xb)
+	{
+	  t->x[ka] ^= TAB_BIT(a);
+	  t->x[kb] ^= TAB_BIT(b);
+	}
+
+      if(za != zb)
+	{
+	  t->z[ka] ^= TAB_BIT(a);
+	  t->z[kb] ^= TAB_BIT(b);
+	}
+    }
+}
+
+/* Measure qubit A in the computational basis and return the result.
+   If a stabilizer anticommutes with Z_A, the result is random.
+   Otherwise, it follows from the product of the stabilizers whose
+   destabilizers anticommute with Z_A. */
+
+static int
+quantum_tableau_measure(quantum_tableau *t, int a)
+{
+  int i, p, n;
+
+  n = t->n;
+
+  for(p=n; p<2*n; p++)
+    {
+      if(TAB_X(t, p, a))
+	break;
+    }
+
+  if(p < 2*n)
+    {
+      for(i=0; i<2*n; i++)
+	{
+	  if((i != p) && TAB_X(t, i, a))
+	    quantum_tableau_rowsum(t, i, p);
+	}
+
+      quantum_tableau_rowcopy(t, p-n, p);
+      quantum_tableau_rowclear(t, p);
+
+      t->z[p * t->words + TAB_WORD(a)] = TAB_BIT(a);
+
+      if(quantum_frand() > 0.5)
+	t->r[p] = 2;
+
+      return t->r[p] != 0;
+    }
+
+  quantum_tableau_rowclear(t, 2*n);
+
+  for(i=0; i<n; i++)
+    {
+      if(TAB_X(t, i, a))
+	quantum_tableau_rowsum(t, 2*n, i+n);
+    }
+
+  return t->r[2*n] != 0;
+}
+
+/* Remove qubit A, which must be in the state 0. Qubit A is moved to
+   the top, the stabilizers are combined so that only one of them acts
+   on it, and this stabilizer and its destabilizer are dropped. */
+
+static void
+quantum_tableau_remove(quantum_tableau *t, int a)
+{
+  int i, j, k, p, n;
+
+  n = t->n;
+
+  for(j=a; j<n-1; j++)
+    quantum_tableau_swap(t, j, j+1);
+
+  for(p=n; p<2*n; p++)
+    {
+      if(TAB_Z(t, p, n-1))
+	break;
+    }
+
+  for(k=n; k<2*n; k++)
+    {
+      if((k != p) && TAB_Z(t, k, n-1))
+	{
+	  quantum_tableau_rowsum(t, k, p);
+	  quantum_tableau_rowsum(t, p-n, k-n);
+	}
+    }
+
+  for(i=0, k=0; i<=2*n; i++)
+    {
+      if((i == p-n) || (i == p))
+	continue;
+
+      if(k != i)
+	quantum_tableau_rowcopy(t, k, i);
+
+      t->x[k * t->words + TAB_WORD(n-1)] &= ~TAB_BIT(n-1);
+      t->z[k * t->words + TAB_WORD(n-1)] &= ~TAB_BIT(n-1);
+      k++;
+    }
+
+  t->n--;
+
+  t->x = realloc(t->x, k * t->words * sizeof(MAX_UNSIGNED));
+  t->z = realloc(t->z, k * t->words * sizeof(MAX_UNSIGNED));
+  t->r = realloc(t->r, k * sizeof(int));
+
+  if(!(t->x && t->z && t->r))
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman(-2 * (2 * t->words * sizeof(MAX_UNSIGNED) + sizeof(int)));
+}
+
+/* Bring the stabilizers into row echelon form, first with respect to
+   their X parts, then the remaining ones with respect to their Z
+   parts. The destabilizers are updated accordingly. Returns the number
+   of stabilizers with an X part, i.e. the state is a superposition of
+   2^G basis states. */
+
+static int
+quantum_tableau_gaussian(quantum_tableau *t)
+{
+  int i, j, k, k2, n, g, pass;
+
+  n = t->n;
+  i = n;
+  g = 0;
+
+  for(pass=0; pass<2; pass++)
+    {
+      for(j=0; j<n; j++)
+	{
+	  for(k=i; k<2*n; k++)
+	    {
+	      if(pass ? TAB_Z(t, k, j) : TAB_X(t, k, j))
+		break;
+	    }
+
+	  if(k == 2*n)
+	    continue;
+
+	  quantum_tableau_rowswap(t, i, k);
+	  quantum_tableau_rowswap(t, i-n, k-n);
+
+	  for(k2=i+1; k2<2*n; k2++)
+	    {
+	      if(pass ? TAB_Z(t, k2, j) : TAB_X(t, k2, j))
+		{
+		  quantum_tableau_rowsum(t, k2, i);
+		  quantum_tableau_rowsum(t, i-n, k2-n);
+		}
+	    }
+
+	  i++;
+	}
+
+      if(!pass)
+	g = i - n;
+    }
+
+  return g;
+}
+
+/* Find a basis state with non-zero amplitude and store it in the
+   scratch row. The stabilizers without an X part are diagonal and
+   have to leave this state unchanged. G is the value returned by
+   quantum_tableau_gaussian. */
+
+static void
+quantum_tableau_seed(quantum_tableau *t, int g)
+{
+  int i, j, f, min = 0, n;
+
+  n = t->n;
+
+  quantum_tableau_rowclear(t, 2*n);
+
+  for(i=2*n-1; i>=n+g; i--)
+    {
+      f = t->r[i];
+
+      for(j=n-1; j>=0; j--)
+	{
+	  if(TAB_Z(t, i, j))
+	    {
+	      min = j;
+	      if(TAB_X(t, 2*n, j))
+		f = (f + 2) % 4;
+	    }
+	}
+
+      if(f == 2)
+	t->x[2*n * t->words + TAB_WORD(min)] ^= TAB_BIT(min);
+    }
+}
+
+/* Create a new quantum register to be simulated with a stabilizer
+   tableau. Unlike quantum_new_qureg, no hash table is allocated until
+   the state vector is needed, so registers of any width can be
+   created. The register has to be passed to quantum_stabilizer_start
+   before any gates are applied to it. */
+
+quantum_reg
+quantum_new_stabilizer_qureg(MAX_UNSIGNED initval, int width)
+{
+  quantum_reg reg;
+
+  reg.width = width;
+  reg.size = 1;
+  reg.hashw = width + 2;
+  reg.hash = 0;
+
+  reg.state = quantum_calloc(1, sizeof(MAX_UNSIGNED));
+  reg.amplitude = quantum_calloc(1, sizeof(COMPLEX_FLOAT));
+
+  if(!(reg.state && reg.amplitude))
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman(sizeof(MAX_UNSIGNED) + sizeof(COMPLEX_FLOAT));
+
+  reg.state[0] = initval;
+  reg.amplitude[0] = 1;
+
+  quantum_objcode_put(INIT, initval, width);
+
+  return reg;
+}
+
+/* Start simulating REG with a stabilizer tableau. REG has to be a
+   basis state, otherwise this function has no effect. A register
+   previously simulated this way is converted back to a state
+   vector. */
+
+void
+quantum_stabilizer_start(quantum_reg *reg)
+{
+  int i;
+
+  if(quantum_stabilizer_active(reg))
+    return;
+
+  quantum_flush(reg);
+
+  if(stab_reg)
+    quantum_stabilizer_stop(stab_reg);
+
+  if((reg->size != 1) || !reg->state)
+    return;
+
+  quantum_tableau_new(reg->width, &stab);
+
+  for(i=0; i<reg->width && i<TAB_BITS; i++)
+    {
+      if(reg->state[0] & ((MAX_UNSIGNED) 1 << i))
+	quantum_tableau_pauli(&stab, i, 1, 0);
+    }
+
+  stab_reg = reg;
+}
+
+/* Build the state vector of REG from its tableau and stop simulating
+   it with the tableau. REG may also be a copy of the register, as
+   passed by value to quantum_print_qureg, in which case it is updated
+   afterwards. */
+
+void
+quantum_stabilizer_stop(quantum_reg *reg)
+{
+  int i, k, g, n, e, size;
+  quantum_reg *out;
+  MAX_UNSIGNED y;
+  COMPLEX_FLOAT phase[4];
+  float norm;
+
+  if(!quantum_stabilizer_active(reg))
+    return;
+
+  out = stab_reg;
+  n = stab.n;
+
+  g = quantum_tableau_gaussian(&stab);
+
+  /* Basis states are limited to the bits of MAX_UNSIGNED and the
+     number of basis states and the hash table to the range of an
+     int */
+
+  if((n > TAB_BITS) || (g > 30) || (!out->hash && out->hashw > 30))
+    quantum_error(QUANTUM_EWIDTH);
+
+  quantum_tableau_seed(&stab, g);
+
+  size = 1 << g;
+
+  out->state = quantum_realloc(out->state, size * sizeof(MAX_UNSIGNED));
+  out->amplitude = quantum_realloc(out->amplitude, 
+				   size * sizeof(COMPLEX_FLOAT));
+
+  if(!(out->state && out->amplitude))
+    quantum_error(QUANTUM_ENOMEM);
+
+  quantum_memman((size - out->size) * (sizeof(MAX_UNSIGNED) 
+				       + sizeof(COMPLEX_FLOAT)));
+
+  out->size = size;
+
+  norm = sqrt(1.0 / size);
+  phase[0] = norm;
+  phase[1] = norm * IMAGINARY;
+  phase[2] = -norm;
+  phase[3] = -norm * IMAGINARY;
+
+  /* Run through all products of the stabilizers with an X part in
+     binary order. Their action on the seed yields the basis states,
+     the phase of each one is that of the product, with a factor of i
+     for every Y. */
+
+  for(k=0; k<size; k++)
+    {
+      if(k)
+	{
+	  for(i=0; i<g; i++)
+	    {
+	      if((k ^ (k-1)) & (1 << i))
+		quantum_tableau_rowsum(&stab, 2*n, n+i);
+	    }
+	}
+
+      y = stab.x[2*n * stab.words] & stab.z[2*n * stab.words];
+      e = stab.r[2*n] + quantum_popcount(y);
+
+      out->state[k] = stab.x[2*n * stab.words];
+      out->amplitude[k] = phase[e % 4];
+    }
+
+  if(!out->hash)
+    {
+      out->hash = quantum_calloc(1 << out->hashw, sizeof(int));
+
+      if(!out->hash)
+	quantum_error(QUANTUM_ENOMEM);
+
+      quantum_memman((1 << out->hashw) * sizeof(int));
+    }
+
+  quantum_reconstruct_hash(out);
+
+  quantum_tableau_delete(&stab);
+  stab_reg = 0;
+
+  if(reg != out)
+    *reg = *out;
+}
+
+/* Stop simulating a register which is about to be deleted */
+
+void
+quantum_stabilizer_drop(quantum_reg *reg)
+{
+  if(!quantum_stabilizer_active(reg))
+    return;
+
+  quantum_tableau_delete(&stab);
+  stab_reg = 0;
+}
+
+/* Check whether REG is simulated with a stabilizer tableau */
+
+int
+quantum_stabilizer_active(quantum_reg *reg)
+{
+  return stab_reg && ((reg == stab_reg) || (reg->state == stab_reg->state));
+}
+
+/* Return the number of quarter turns, modulo 4, of the angle GAMMA,
+   or -1 if it is not a multiple of pi/2 */
+
+static int
+quantum_stabilizer_quarter(double gamma)
+{
+  double k;
+  long l;
+
+  k = gamma / (pi / 2);
+  l = floor(k + 0.5);
+
+  if(fabs(k - l) > 1e-5)
+    return -1;
+
+  return ((l % 4) + 4) % 4;
+}
+
+/* Check whether A is a qubit of the tableau */
+
+static inline int
+quantum_stabilizer_qubit(int a)
+{
+  return (a >= 0) && (a < stab.n);
+}
+
+/* Apply a gate to the tableau. Returns 0 if it is not a Clifford
+   gate. */
+
+static int
+quantum_stabilizer_apply(quantum_objcode_insn *insn)
+{
+  int i, k;
+  int *a = insn->arg;
+
+  switch(insn->op)
+    {
+    case CNOT:
+      if(!quantum_stabilizer_qubit(a[0]) || !quantum_stabilizer_qubit(a[1])
+	 || (a[0] == a[1]))
+	return 0;
+      quantum_tableau_cnot(&stab, a[0], a[1]);
+      return 1;
+
+    case SIGMA_X:
+    case SIGMA_Y:
+    case SIGMA_Z:
+      if(!quantum_stabilizer_qubit(a[0]))
+	return 0;
+      quantum_tableau_pauli(&stab, a[0], insn->op != SIGMA_Z, 
+			    insn->op != SIGMA_X);
+      return 1;
+
+    case HADAMARD:
+      if(!quantum_stabilizer_qubit(a[0]))
+	return 0;
+      quantum_tableau_hadamard(&stab, a[0]);
+      return 1;
+
+    case SWAPLEADS:
+      if(2 * a[0] > stab.n)
+	return 0;
+      for(i=0; i<a[0]; i++)
+	quantum_tableau_swap(&stab, i, a[0] + i);
+      return 1;
+
+    case SWAPBITS:
+      if(!quantum_stabilizer_qubit(a[0]) || !quantum_stabilizer_qubit(a[1]))
+	return 0;
+      quantum_tableau_swap(&stab, a[0], a[1]);
+      return 1;
+
+    case BITREVERSE:
+      if(a[0] > stab.n)
+	return 0;
+      for(i=0; i<a[0]/2; i++)
+	quantum_tableau_swap(&stab, i, a[0] - i - 1);
+      return 1;
+
+    case PHASE_SCALE:
+      /* A global phase */
+      return 1;
+
+    case ROT_Z:
+    case PHASE_KICK:
+      /* Up to a global phase, both are diag(1, e^(i gamma)) */
+      k = quantum_stabilizer_quarter(insn->d);
+      if(!quantum_stabilizer_qubit(a[0]) || (k < 0))
+	return 0;
+      for(i=0; i<k; i++)
+	quantum_tableau_phase(&stab, a[0]);
+      return 1;
+
+    case ROT_X:
+      /* R_x(pi/2) is H S H up to a global phase */
+      k = quantum_stabilizer_quarter(insn->d);
+      if(!quantum_stabilizer_qubit(a[0]) || (k < 0))
+	return 0;
+      quantum_tableau_hadamard(&stab, a[0]);
+      for(i=0; i<k; i++)
+	quantum_tableau_phase(&stab, a[0]);
+      quantum_tableau_hadamard(&stab, a[0]);
+      return 1;
+
+    case ROT_Y:
+      /* R_y(pi/2) = H Z, R_y(pi) = -iY and R_y(3pi/2) = -Z H */
+      k = quantum_stabilizer_quarter(insn->d);
+      if(!quantum_stabilizer_qubit(a[0]) || (k < 0))
+	return 0;
+      if(k == 1)
+	{
+	  quantum_tableau_pauli(&stab, a[0], 0, 1);
+	  quantum_tableau_hadamard(&stab, a[0]);
+	}
+      else if(k == 2)
+	quantum_tableau_pauli(&stab, a[0], 1, 1);
+      else if(k == 3)
+	{
+	  quantum_tableau_hadamard(&stab, a[0]);
+	  quantum_tableau_pauli(&stab, a[0], 0, 1);
+	}
+      return 1;
+
+    case COND_PHASE:
+      /* The phase is pi / 2^(CONTROL - TARGET) */
+      if(!quantum_stabilizer_qubit(a[0]) || (a[0] != a[1]))
+	return 0;
+      quantum_tableau_pauli(&stab, a[0], 0, 1);
+      return 1;
+
+    case CPHASE_KICK:
+      k = quantum_stabilizer_quarter(insn->d);
+      if(!quantum_stabilizer_qubit(a[0]) || !quantum_stabilizer_qubit(a[1])
+	 || (k < 0))
+	return 0;
+      if(a[0] == a[1])
+	{
+	  for(i=0; i<k; i++)
+	    quantum_tableau_phase(&stab, a[0]);
+	}
+      else if(k == 2)
+	{
+	  /* A controlled Z gate */
+	  quantum_tableau_hadamard(&stab, a[1]);
+	  quantum_tableau_cnot(&stab, a[0], a[1]);
+	  quantum_tableau_hadamard(&stab, a[1]);
+	}
+      else if(k)
+	return 0;
+      return 1;
+
+    default:
+      return 0;
+    }
+}
+
+/* Apply the gate INSN to REG if it is simulated with a tableau.
+   Returns 1 if the gate has been applied and must not be executed.
+   Otherwise, the state vector is built for the gate to act on. As
+   decoherence acts on every single gate, it is only simulated on the
+   state vector. */
+
+int
+quantum_stabilizer_put(quantum_reg *reg, quantum_objcode_insn *insn)
+{
+  if(!quantum_stabilizer_active(reg))
+    return 0;
+
+  if(!quantum_status && quantum_stabilizer_apply(insn))
+    {
+      quantum_gate_counter(1);
+      return 1;
+    }
+
+  quantum_stabilizer_stop(reg);
+
+  return 0;
+}
+
+/* Measure all qubits of REG without changing it, see
+   quantum_measure. For registers wider than MAX_UNSIGNED, only the
+   lower bits are returned. */
+
+MAX_UNSIGNED
+quantum_stabilizer_measure(quantum_reg *reg)
+{
+  int i;
+  MAX_UNSIGNED result = 0;
+  quantum_tableau t;
+
+  quantum_tableau_copy(&stab, &t);
+
+  for(i=0; i<t.n && i<TAB_BITS; i++)
+    {
+      if(quantum_tableau_measure(&t, i))
+	result |= (MAX_UNSIGNED) 1 << i;
+    }
+
+  quantum_tableau_delete(&t);
+
+  return result;
+}
+
+/* Measure qubit POS of REG, see quantum_bmeasure and
+   quantum_bmeasure_bitpreserve. Unless PRESERVE is set, the qubit is
+   removed from the register afterwards. */
+
+int
+quantum_stabilizer_bmeasure(int pos, int preserve, quantum_reg *reg)
+{
+  int result;
+
+  if(!quantum_stabilizer_qubit(pos))
+    return 0;
+
+  result = quantum_tableau_measure(&stab, pos);
+
+  if(!preserve)
+    {
+      if(result)
+	quantum_tableau_pauli(&stab, pos, 1, 0);
+
+      quantum_tableau_remove(&stab, pos);
+
+      stab_reg->width--;
+      reg->width = stab_reg->width;
+    }
+
+  return result;
+}
@@ -0,0 +1,60 @@
+/* stabilizer.h: Declarations for stabilizer.c
+
+   Copyright 2026 Bjoern Butscher, Hendrik Weimer
+
+   This file is part of libquantum
+
+   libquantum is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   libquantum is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libquantum; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA
+
+*/
+
+#ifndef __STABILIZER_H
+
+#define __STABILIZER_H
+
+#include "config.h"
+#include "qureg.h"
+#include "objcode.h"
+
+/* A stabilizer tableau. Rows 0 to N-1 hold the destabilizers, rows N
+   to 2N-1 the stabilizer generators and row 2N is scratch space. Each
+   row is a Pauli operator with WORDS words of X and Z bits and a phase
+   R, which is 0 for +1, 1 for i, 2 for -1 and 3 for -i. */
+
+struct quantum_tableau_struct
+{
+  int n;           /* number of qubits */
+  int words;       /* words per row */
+  MAX_UNSIGNED *x; /* X bits */
+  MAX_UNSIGNED *z; /* Z bits */
+  int *r;          /* phases */
+};
+
+typedef struct quantum_tableau_struct quantum_tableau;
+
+extern quantum_reg quantum_new_stabilizer_qureg(MAX_UNSIGNED initval, 
+						int width);
+extern void quantum_stabilizer_start(quantum_reg *reg);
+extern void quantum_stabilizer_stop(quantum_reg *reg);
+extern void quantum_stabilizer_drop(quantum_reg *reg);
+extern int quantum_stabilizer_active(quantum_reg *reg);
+extern int quantum_stabilizer_put(quantum_reg *reg, 
+				  quantum_objcode_insn *insn);
+extern MAX_UNSIGNED quantum_stabilizer_measure(quantum_reg *reg);
+extern int quantum_stabilizer_bmeasure(int pos, int preserve, 
+				       quantum_reg *reg);
+
+#endif